@@ -0,0 +1,304 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "aggregate.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+
+#include "field_path.h"
+#include "log.h"
+#include "number.h"
+#include "parallel.h"
+
+// The last of |fields| from |msg|, through singular messages. Returns false if it or a message on the way is
+// unset.
+static bool find_value(const ::google::protobuf::Message& msg,
+                       const std::vector<const ::google::protobuf::FieldDescriptor*>& fields,
+                       const ::google::protobuf::Message** parent) {
+  const ::google::protobuf::Message* current = &msg;
+  for (size_t i = 0; i + 1 < fields.size(); ++i) {
+    if (!current->GetReflection()->HasField(*current, fields[i])) {
+      return false;
+    }
+    current = &current->GetReflection()->GetMessage(*current, fields[i]);
+  }
+  *parent = current;
+  return !fields.back()->has_presence() || current->GetReflection()->HasField(*current, fields.back());
+}
+
+static std::string value_bytes(double val) {
+  std::string bytes(sizeof(val), '\0');
+  memcpy(&bytes[0], &val, sizeof(val));
+  return bytes;
+}
+
+static std::string value_bytes(int64_t val) {
+  std::string bytes(sizeof(val), '\0');
+  memcpy(&bytes[0], &val, sizeof(val));
+  return bytes;
+}
+
+static std::string value_bytes(uint64_t val) {
+  std::string bytes(sizeof(val), '\0');
+  memcpy(&bytes[0], &val, sizeof(val));
+  return bytes;
+}
+
+static void add_number(double val, AggregateStats* stats) {
+  stats->sum += val;
+  stats->min = std::min(stats->min, val);
+  stats->max = std::max(stats->max, val);
+}
+
+// Reduces the elements it is handed into |result_|.
+class AggregateSink : public QuerySink {
+ public:
+  AggregateSink(const Aggregate& aggregate, AggregateResult* result) : aggregate_(aggregate), result_(result) {}
+
+  void Message(const ::google::protobuf::Message& msg) override {
+    AggregateStats* stats = Group(msg);
+    ++stats->count;
+    const ::google::protobuf::Message* parent;
+    if (aggregate_.value_fields.empty() || !find_value(msg, aggregate_.value_fields, &parent)) {
+      return;
+    }
+    ++stats->values;
+    const auto* field_desc = aggregate_.value_fields.back();
+    const auto* reflection = parent->GetReflection();
+    switch (field_desc->cpp_type()) {
+      case ::google::protobuf::FieldDescriptor::CPPTYPE_INT32: {
+        int64_t val = reflection->GetInt32(*parent, field_desc);
+        add_number(static_cast<double>(val), stats);
+        stats->distinct.insert(value_bytes(val));
+        break;
+      }
+      case ::google::protobuf::FieldDescriptor::CPPTYPE_INT64: {
+        int64_t val = reflection->GetInt64(*parent, field_desc);
+        add_number(static_cast<double>(val), stats);
+        stats->distinct.insert(value_bytes(val));
+        break;
+      }
+      case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32: {
+        uint64_t val = reflection->GetUInt32(*parent, field_desc);
+        add_number(static_cast<double>(val), stats);
+        stats->distinct.insert(value_bytes(val));
+        break;
+      }
+      case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64: {
+        uint64_t val = reflection->GetUInt64(*parent, field_desc);
+        add_number(static_cast<double>(val), stats);
+        stats->distinct.insert(value_bytes(val));
+        break;
+      }
+      case ::google::protobuf::FieldDescriptor::CPPTYPE_FLOAT: {
+        double val = reflection->GetFloat(*parent, field_desc);
+        add_number(val, stats);
+        stats->distinct.insert(value_bytes(val));
+        break;
+      }
+      case ::google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE: {
+        double val = reflection->GetDouble(*parent, field_desc);
+        add_number(val, stats);
+        stats->distinct.insert(value_bytes(val));
+        break;
+      }
+      case ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL: {
+        bool val = reflection->GetBool(*parent, field_desc);
+        add_number(val ? 1.0 : 0.0, stats);
+        stats->distinct.insert(val ? "1" : "0");
+        break;
+      }
+      case ::google::protobuf::FieldDescriptor::CPPTYPE_ENUM:
+        stats->distinct.insert(value_bytes(static_cast<int64_t>(reflection->GetEnumValue(*parent, field_desc))));
+        break;
+      case ::google::protobuf::FieldDescriptor::CPPTYPE_STRING: {
+        std::string scratch;
+        stats->distinct.insert(reflection->GetStringReference(*parent, field_desc, &scratch));
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  // parse_aggregate() only lets queries that end in messages through
+  void Value(const ::google::protobuf::Message&, const ::google::protobuf::FieldDescriptor*, int) override {}
+
+ private:
+  AggregateStats* Group(const ::google::protobuf::Message& msg) {
+    if (aggregate_.key_fields.empty()) {
+      return &(*result_)[std::string()];
+    }
+    // an unset key reads as its default, like it would from the generated getter
+    const ::google::protobuf::Message* parent = &msg;
+    for (size_t i = 0; i + 1 < aggregate_.key_fields.size(); ++i) {
+      parent = &parent->GetReflection()->GetMessage(*parent, aggregate_.key_fields[i]);
+    }
+    const auto* field_desc = aggregate_.key_fields.back();
+    const auto* reflection = parent->GetReflection();
+    if (field_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_ENUM) {
+      int number = reflection->GetEnumValue(*parent, field_desc);
+      const auto* value = field_desc->enum_type()->FindValueByNumber(number);
+      return &(*result_)[nullptr == value ? std::to_string(number) : value->name()];
+    }
+    std::string scratch;
+    return &(*result_)[reflection->GetStringReference(*parent, field_desc, &scratch)];
+  }
+
+  const Aggregate& aggregate_;
+  AggregateResult* result_;
+};
+
+static bool parse_relative(const ::google::protobuf::Descriptor* desc, const std::string& dotted,
+                           std::vector<const ::google::protobuf::FieldDescriptor*>* out) {
+  if (dotted.empty()) {
+    out->clear();
+    return true;
+  }
+  if (!parse_field_names(desc, dotted, out)) {
+    return false;
+  }
+  for (const auto* field_desc : *out) {
+    if (field_desc->is_repeated()) {
+      PBE_LOG_ERROR("%s: %s is repeated\n", dotted.c_str(), field_desc->name().c_str());
+      return false;
+    }
+  }
+  if (out->back()->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+    PBE_LOG_ERROR("%s is a message\n", dotted.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool parse_aggregate(const ::google::protobuf::Descriptor* root_desc, const std::string& selection,
+                     const std::string& value, const std::string& key, Aggregate* out) {
+  if (!parse_query(root_desc, selection, &out->selection)) {
+    return false;
+  }
+  if (!query_yields_messages(out->selection) || !out->selection.projection.empty()) {
+    PBE_LOG_ERROR("%s doesn't select whole messages\n", selection.c_str());
+    return false;
+  }
+  const auto* element_desc = out->selection.steps.back().field_desc->message_type();
+  if (!parse_relative(element_desc, value, &out->value_fields) ||
+      !parse_relative(element_desc, key, &out->key_fields)) {
+    return false;
+  }
+  if (!out->key_fields.empty()) {
+    auto type = out->key_fields.back()->cpp_type();
+    if (type != ::google::protobuf::FieldDescriptor::CPPTYPE_ENUM &&
+        type != ::google::protobuf::FieldDescriptor::CPPTYPE_STRING) {
+      PBE_LOG_ERROR("%s is not an enum or string field\n", key.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+bool aggregate_is_numeric(const Aggregate& aggregate) {
+  if (aggregate.value_fields.empty()) {
+    return false;
+  }
+  auto type = aggregate.value_fields.back()->cpp_type();
+  return type != ::google::protobuf::FieldDescriptor::CPPTYPE_ENUM &&
+         type != ::google::protobuf::FieldDescriptor::CPPTYPE_STRING;
+}
+
+static void merge_results(std::vector<AggregateResult>* partials, AggregateResult* out) {
+  out->clear();
+  for (auto& partial : *partials) {
+    for (auto& group : partial) {
+      AggregateStats& stats = (*out)[group.first];
+      stats.count += group.second.count;
+      stats.values += group.second.values;
+      stats.sum += group.second.sum;
+      stats.min = std::min(stats.min, group.second.min);
+      stats.max = std::max(stats.max, group.second.max);
+      if (stats.distinct.size() < group.second.distinct.size()) {
+        stats.distinct.swap(group.second.distinct);
+      }
+      stats.distinct.insert(group.second.distinct.begin(), group.second.distinct.end());
+    }
+    partial.clear();
+  }
+}
+
+// Calls |run| with a sink per thread, then merges what they reduced into |out|.
+static bool reduce(const Aggregate& aggregate, AggregateResult* out,
+                   const std::function<bool(const std::vector<QuerySink*>& sinks)>& run) {
+  std::vector<AggregateResult> partials(worker_count());
+  std::vector<std::unique_ptr<AggregateSink>> sinks;
+  std::vector<QuerySink*> sink_ptrs;
+  for (auto& partial : partials) {
+    sinks.emplace_back(new AggregateSink(aggregate, &partial));
+    sink_ptrs.push_back(sinks.back().get());
+  }
+  bool ok = run(sink_ptrs);
+  merge_results(&partials, out);
+  return ok;
+}
+
+void aggregate_message(const Aggregate& aggregate, const ::google::protobuf::Message& msg, AggregateResult* out) {
+  reduce(aggregate, out, [&](const std::vector<QuerySink*>& sinks) {
+    run_query_parallel(aggregate.selection, msg, sinks);
+    return true;
+  });
+}
+
+bool aggregate_files(const Aggregate& aggregate, const ::google::protobuf::Message& prototype,
+                     const std::vector<std::string>& paths, bool delimited, AggregateResult* out) {
+  return reduce(aggregate, out, [&](const std::vector<QuerySink*>& sinks) {
+    return scan_files(aggregate.selection, prototype, paths, delimited, sinks, []() { return true; });
+  });
+}
+
+static std::string format_double(double val) {
+  char buf[kMaxNumberLength];
+  return std::string(buf, format_number(val, buf));
+}
+
+std::string format_aggregate(const Aggregate& aggregate, const AggregateResult& result) {
+  bool numeric = aggregate_is_numeric(aggregate);
+  bool has_value = !aggregate.value_fields.empty();
+  std::string out = "group\tcount";
+  if (has_value) {
+    out += numeric ? "\tvalues\tsum\tmin\tmax\tdistinct" : "\tvalues\tdistinct";
+  }
+  out += '\n';
+  for (const auto& group : result) {
+    const AggregateStats& stats = group.second;
+    out += group.first + '\t' + std::to_string(stats.count);
+    if (has_value) {
+      out += '\t' + std::to_string(stats.values);
+      if (numeric) {
+        bool any = stats.values > 0;
+        out += '\t' + format_double(stats.sum) + '\t' + (any ? format_double(stats.min) : "-") + '\t' +
+               (any ? format_double(stats.max) : "-");
+      }
+      out += '\t' + std::to_string(stats.distinct.size());
+    }
+    out += '\n';
+  }
+  return out;
+}
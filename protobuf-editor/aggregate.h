@@ -0,0 +1,78 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef AGGREGATE_H_
+#define AGGREGATE_H_
+
+#include <stdint.h>
+
+#include <limits>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "protobuf_include.h"
+#include "query.h"
+
+// What the value field of the elements of one group adds up to.
+struct AggregateStats {
+  uint64_t count = 0;   // elements in the group
+  uint64_t values = 0;  // of them with the value field set
+  // numeric and bool values only
+  double sum = 0.0;
+  double min = std::numeric_limits<double>::infinity();
+  double max = -std::numeric_limits<double>::infinity();
+  // the values, as their bytes
+  std::unordered_set<std::string> distinct;
+};
+
+// "count, sum, min, max and distinct of phones[*].number grouped by type".
+struct Aggregate {
+  // ends in the messages aggregated, like "people[*].phones"
+  Query selection;
+  // singular fields from an element to the value aggregated, empty to only count
+  std::vector<const ::google::protobuf::FieldDescriptor*> value_fields;
+  // singular fields from an element to its enum or string group key, empty for a single group
+  std::vector<const ::google::protobuf::FieldDescriptor*> key_fields;
+};
+
+// by group key
+typedef std::map<std::string, AggregateStats> AggregateResult;
+
+// |value| and |key| are dotted paths from an element of |selection|, and may be empty. Logs and returns false
+// if any of them doesn't fit.
+bool parse_aggregate(const ::google::protobuf::Descriptor* root_desc, const std::string& selection,
+                     const std::string& value, const std::string& key, Aggregate* out);
+
+// Whether the value of |aggregate| has a sum, min and max.
+bool aggregate_is_numeric(const Aggregate& aggregate);
+
+// Each of worker_count() threads reduces its share of the elements into its own result, and those are merged
+// at the end.
+void aggregate_message(const Aggregate& aggregate, const ::google::protobuf::Message& msg, AggregateResult* out);
+bool aggregate_files(const Aggregate& aggregate, const ::google::protobuf::Message& prototype,
+                     const std::vector<std::string>& paths, bool delimited, AggregateResult* out);
+
+// A header line and a tab-separated line per group.
+std::string format_aggregate(const Aggregate& aggregate, const AggregateResult& result);
+
+#endif  // AGGREGATE_H_
@@ -0,0 +1,435 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "array_io.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "field_traits.h"
+#include "file.h"
+#include "log.h"
+#include "number.h"
+
+enum CharClass : uint8_t {
+  kNumberChar = 0,
+  kBlank,          // spaces and quotes around a cell
+  kCellSeparator,  // between the cells of a line
+  kNewline,
+};
+
+// One lookup per byte, for the passes that split the text into cells and numbers.
+struct CharClasses {
+  uint8_t of[256];
+  CharClasses() {
+    memset(of, kNumberChar, sizeof(of));
+    for (char c : {' ', '\r', '"', '\''}) {
+      of[static_cast<unsigned char>(c)] = kBlank;
+    }
+    for (char c : {',', ';', '\t'}) {
+      of[static_cast<unsigned char>(c)] = kCellSeparator;
+    }
+    of[static_cast<unsigned char>('\n')] = kNewline;
+  }
+  uint8_t operator[](char c) const { return of[static_cast<unsigned char>(c)]; }
+};
+
+static const CharClasses kClasses;
+
+// the chars count_tokens() compares with, the same as those kClasses doesn't class as kNumberChar
+static inline uint32_t is_number_char(char c) {
+  return (c != ' ') & (c != '\r') & (c != '"') & (c != '\'') & (c != ',') & (c != ';') & (c != '\t') & (c != '\n');
+}
+
+// The starts of runs of number chars. With SSE2, 16 chars are classed at a time by comparisons, and the starts
+// are the number chars whose previous char isn't one, found with shifts of their bit mask.
+static size_t count_tokens(const char* begin, const char* end) {
+  size_t count = 0;
+  const char* p = begin;
+  uint32_t previous = 0;  // whether the char before p is a number char
+#ifdef __SSE2__
+  for (; end - p >= 16; p += 16) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i other = _mm_cmpeq_epi8(chars, _mm_set1_epi8(' '));
+    for (char c : {'\r', '"', '\'', ',', ';', '\t', '\n'}) {
+      other = _mm_or_si128(other, _mm_cmpeq_epi8(chars, _mm_set1_epi8(c)));
+    }
+    uint32_t number = ~static_cast<uint32_t>(_mm_movemask_epi8(other)) & 0xffffu;
+    count += static_cast<size_t>(__builtin_popcount(number & ~((number << 1) | previous)));
+    previous = number >> 15;
+  }
+#endif
+  for (; p != end; ++p) {
+    uint32_t is_number = is_number_char(*p);
+    count += is_number & (previous ^ 1);
+    previous = is_number;
+  }
+  return count;
+}
+
+template <typename T>
+static bool parse_list(const char* begin, const char* end, ::google::protobuf::RepeatedField<T>* out,
+                       ArrayImportReport* report) {
+  size_t count = count_tokens(begin, end);
+  if (count > INT_MAX) {
+    report->error_offset = 0;
+    return false;
+  }
+  out->Clear();
+  out->Reserve(static_cast<int>(count));
+  const char* p = begin;
+  for (;;) {
+    while (p != end && kClasses[*p] != kNumberChar) {
+      ++p;
+    }
+    if (p == end) {
+      break;
+    }
+    const char* token = p;
+    while (p != end && kClasses[*p] == kNumberChar) {
+      ++p;
+    }
+    T val;
+    if (!parse_number(token, p, &val)) {
+      report->error_offset = static_cast<size_t>(token - begin);
+      return false;
+    }
+    out->AddAlreadyReserved(val);
+  }
+  report->values = count;
+  return true;
+}
+
+template <typename T>
+static bool parse_column(const char* begin, const char* end, int column, ::google::protobuf::RepeatedField<T>* out,
+                         ArrayImportReport* report) {
+  size_t lines = static_cast<size_t>(std::count(begin, end, '\n')) + 1;
+  if (lines > INT_MAX) {
+    report->error_offset = 0;
+    return false;
+  }
+  out->Clear();
+  out->Reserve(static_cast<int>(lines));
+  bool first_line = true;
+  for (const char* line = begin; line < end;) {
+    const char* line_end = static_cast<const char*>(memchr(line, '\n', static_cast<size_t>(end - line)));
+    if (nullptr == line_end) {
+      line_end = end;
+    }
+    const char* cell = line;
+    for (int k = 0; k < column && cell != line_end; ++k) {
+      while (cell != line_end && kClasses[*cell] != kCellSeparator) {
+        ++cell;
+      }
+      if (cell != line_end) {
+        ++cell;
+      }
+    }
+    const char* cell_end = cell;
+    while (cell_end != line_end && kClasses[*cell_end] != kCellSeparator) {
+      ++cell_end;
+    }
+    while (cell != cell_end && kClasses[*cell] == kBlank) {
+      ++cell;
+    }
+    while (cell_end != cell && kClasses[*(cell_end - 1)] == kBlank) {
+      --cell_end;
+    }
+
+    bool blank_line = true;
+    for (const char* p = line; p != line_end && blank_line; ++p) {
+      blank_line = kClasses[*p] == kBlank;
+    }
+    if (!blank_line) {
+      T val;
+      if (parse_number(cell, cell_end, &val)) {
+        out->AddAlreadyReserved(val);
+      } else if (first_line) {
+        report->skipped_header = true;
+      } else {
+        report->error_offset = static_cast<size_t>(cell - begin);
+        return false;
+      }
+      first_line = false;
+    }
+    line = line_end + 1;
+  }
+  report->values = static_cast<size_t>(out->size());
+  return true;
+}
+
+template <typename T>
+static void copy_raw(const char* data, size_t count, T* out) {
+  memcpy(out, data, count * sizeof(T));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  for (size_t i = 0; i < count; ++i) {
+    auto* bytes = reinterpret_cast<unsigned char*>(out + i);
+    std::reverse(bytes, bytes + sizeof(T));
+  }
+#endif
+}
+
+// any nonzero byte is true
+static void copy_raw(const char* data, size_t count, bool* out) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = data[i] != 0;
+  }
+}
+
+template <typename T>
+static bool parse_raw(const char* begin, const char* end, ::google::protobuf::RepeatedField<T>* out,
+                      ArrayImportReport* report) {
+  size_t size = static_cast<size_t>(end - begin);
+  size_t count = size / sizeof(T);
+  if (size % sizeof(T) != 0 || count > INT_MAX) {
+    report->error_offset = size - size % sizeof(T);
+    return false;
+  }
+  out->Clear();
+  out->Resize(static_cast<int>(count), T());
+  copy_raw(begin, count, out->mutable_data());
+  report->values = count;
+  return true;
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static const char kByteOrder = '>';
+#else
+static const char kByteOrder = '<';
+#endif
+
+// magic, version and header length of a version 1 .npy file
+static const char kNpyMagic[] = "\x93NUMPY";
+static const size_t kNpyPrefix = 10;
+
+// as in the 'descr' of a .npy header
+static std::string npy_type(::google::protobuf::FieldDescriptor::CppType cpp_type) {
+  switch (cpp_type) {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+      return std::string(1, kByteOrder) + "i4";
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+      return std::string(1, kByteOrder) + "i8";
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+      return std::string(1, kByteOrder) + "u4";
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+      return std::string(1, kByteOrder) + "u8";
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+      return std::string(1, kByteOrder) + "f4";
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+      return std::string(1, kByteOrder) + "f8";
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+      return "|b1";
+    default:
+      return "";
+  }
+}
+
+static std::string npy_header(const std::string& type, size_t count) {
+  std::string dict = "{'descr': '" + type + "', 'fortran_order': False, 'shape': (" + std::to_string(count) + ",), }";
+  // the data starts 64-byte aligned, and the header ends with a newline
+  dict.append((64 - (kNpyPrefix + dict.size() + 1) % 64) % 64, ' ');
+  dict += '\n';
+  std::string header(kNpyMagic, sizeof(kNpyMagic) - 1);
+  header += '\x01';
+  header += '\x00';
+  header += static_cast<char>(dict.size() & 0xff);
+  header += static_cast<char>(dict.size() >> 8);
+  return header + dict;
+}
+
+// Checks the header is of a C-ordered array of T, and parses the data after it. Any shape is taken, flat.
+template <typename T>
+static bool parse_npy(const char* begin, const char* end, ::google::protobuf::RepeatedField<T>* out,
+                      ArrayImportReport* report) {
+  size_t size = static_cast<size_t>(end - begin);
+  if (size < kNpyPrefix || memcmp(begin, kNpyMagic, sizeof(kNpyMagic) - 1) != 0) {
+    report->error_offset = 0;
+    return false;
+  }
+  auto byte = [begin](size_t i) { return static_cast<size_t>(static_cast<unsigned char>(begin[i])); };
+  // version 1 has a 2-byte header length, later ones 4 bytes
+  size_t header_begin = byte(6) == 1 ? kNpyPrefix : kNpyPrefix + 2;
+  size_t header_size = byte(8) | byte(9) << 8;
+  if (byte(6) != 1 && size >= header_begin) {
+    header_size |= byte(10) << 16 | byte(11) << 24;
+  }
+  if (header_begin + header_size > size) {
+    report->error_offset = kNpyPrefix;
+    return false;
+  }
+  std::string header(begin + header_begin, header_size);
+  std::string type = "'descr': '" + npy_type(FieldTraits<T>::kCppType) + "'";
+  if (header.find(type) == std::string::npos || header.find("'fortran_order': False") == std::string::npos) {
+    report->error_offset = header_begin;
+    return false;
+  }
+  if (!parse_raw(begin + header_begin + header_size, end, out, report)) {
+    report->error_offset += header_begin + header_size;
+    return false;
+  }
+  return true;
+}
+
+template <typename T>
+bool parse_array(const char* begin, const char* end, ArrayFormat format, int column,
+                 ::google::protobuf::RepeatedField<T>* out, ArrayImportReport* report) {
+  *report = ArrayImportReport();
+  if (format == ArrayFormat::kRaw) {
+    return parse_raw(begin, end, out, report);
+  }
+  if (format == ArrayFormat::kNpy) {
+    return parse_npy(begin, end, out, report);
+  }
+  if (column >= 0) {
+    return parse_column(begin, end, column, out, report);
+  }
+  return parse_list(begin, end, out, report);
+}
+
+template <typename T>
+bool load_array_file(const std::string& path, ArrayFormat format, int column, ::google::protobuf::RepeatedField<T>* out,
+                     ArrayImportReport* report) {
+  MappedFile file;
+  if (!file.Open(path, true)) {
+    return false;
+  }
+  const auto* data = reinterpret_cast<const char*>(file.data());
+  if (!parse_array(data, data + file.size(), format, column, out, report)) {
+    PBE_LOG_ERROR("%s: can't read a value at offset %zu\n", path.c_str(), report->error_offset);
+    return false;
+  }
+  return true;
+}
+
+size_t array_value_size(const ::google::protobuf::FieldDescriptor* field_desc) {
+  switch (field_desc->cpp_type()) {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+      return 4;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+      return 8;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+template <typename T>
+static void append_values(const ::google::protobuf::Message& msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                          std::string* out) {
+  if (field_desc->is_repeated()) {
+    const auto& field = repeated_field<T>(msg, field_desc);
+    out->append(reinterpret_cast<const char*>(field.data()), static_cast<size_t>(field.size()) * sizeof(T));
+  } else {
+    T val = FieldTraits<T>::Get(msg, field_desc);
+    out->append(reinterpret_cast<const char*>(&val), sizeof(val));
+  }
+}
+
+static void gather(const ::google::protobuf::Message& msg,
+                   const std::vector<const ::google::protobuf::FieldDescriptor*>& fields, size_t depth,
+                   std::string* out) {
+  const auto* field_desc = fields[depth];
+  if (depth + 1 < fields.size()) {
+    auto* reflection = msg.GetReflection();
+    if (field_desc->is_repeated()) {
+      int size = reflection->FieldSize(msg, field_desc);
+      for (int k = 0; k < size; ++k) {
+        gather(reflection->GetRepeatedMessage(msg, field_desc, k), fields, depth + 1, out);
+      }
+    } else {
+      gather(reflection->GetMessage(msg, field_desc), fields, depth + 1, out);
+    }
+    return;
+  }
+  switch (field_desc->cpp_type()) {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+      append_values<int32_t>(msg, field_desc, out);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+      append_values<int64_t>(msg, field_desc, out);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+      append_values<uint32_t>(msg, field_desc, out);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+      append_values<uint64_t>(msg, field_desc, out);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+      append_values<float>(msg, field_desc, out);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+      append_values<double>(msg, field_desc, out);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+      append_values<bool>(msg, field_desc, out);
+      break;
+    default:
+      break;
+  }
+}
+
+void gather_array(const ::google::protobuf::Message& msg,
+                  const std::vector<const ::google::protobuf::FieldDescriptor*>& fields, std::string* out) {
+  if (!fields.empty()) {
+    gather(msg, fields, 0, out);
+  }
+}
+
+bool write_array_file(const std::string& path, ArrayFormat format, const ::google::protobuf::FieldDescriptor* field_desc,
+                      const void* data, size_t count) {
+  size_t value_size = array_value_size(field_desc);
+  if (0 == value_size || format == ArrayFormat::kText) {
+    PBE_LOG_ERROR("%s can't be exported to %s\n", field_desc->full_name().c_str(), path.c_str());
+    return false;
+  }
+  std::string header;
+  if (format == ArrayFormat::kNpy) {
+    header = npy_header(npy_type(field_desc->cpp_type()), count);
+  }
+  return write_file(path, {{header.data(), header.size()}, {data, count * value_size}});
+}
+
+#define PBE_INSTANTIATE_ARRAY_IO(TYPE)                                                                          \
+  template bool parse_array(const char* begin, const char* end, ArrayFormat format, int column,                 \
+                            ::google::protobuf::RepeatedField<TYPE>* out, ArrayImportReport* report);          \
+  template bool load_array_file(const std::string& path, ArrayFormat format, int column,                       \
+                                ::google::protobuf::RepeatedField<TYPE>* out, ArrayImportReport* report)
+
+PBE_INSTANTIATE_ARRAY_IO(int32_t);
+PBE_INSTANTIATE_ARRAY_IO(int64_t);
+PBE_INSTANTIATE_ARRAY_IO(uint32_t);
+PBE_INSTANTIATE_ARRAY_IO(uint64_t);
+PBE_INSTANTIATE_ARRAY_IO(float);
+PBE_INSTANTIATE_ARRAY_IO(double);
+PBE_INSTANTIATE_ARRAY_IO(bool);
+
+#undef PBE_INSTANTIATE_ARRAY_IO
@@ -0,0 +1,76 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ARRAY_IO_H_
+#define ARRAY_IO_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "protobuf_include.h"
+
+// Bulk transfer of repeated numeric and bool fields, for arrays too large for the per-element inputs. The
+// templates are instantiated for the C++ types of FieldTraits.
+
+enum class ArrayFormat {
+  // numbers separated by commas, semicolons, tabs, spaces, quotes or newlines
+  kText,
+  // packed little-endian values of the field's C++ type, one byte per bool
+  kRaw,
+  // a NumPy .npy file of the same values
+  kNpy,
+};
+
+struct ArrayImportReport {
+  size_t values = 0;
+  bool skipped_header = false;
+  size_t error_offset = 0;  // of what couldn't be parsed, when the import failed
+};
+
+// Parses [begin, end) into |out|, replacing its elements. A .npy file must hold the field's type. For kText, |column| >= 0 takes only that cell of
+// each line, counting from 0, for a column of a CSV or TSV table; a first line that isn't a number there is
+// a header and is skipped. The field is allocated once: the values are counted before they are parsed.
+template <typename T>
+bool parse_array(const char* begin, const char* end, ArrayFormat format, int column,
+                 ::google::protobuf::RepeatedField<T>* out, ArrayImportReport* report);
+
+// parse_array() over a memory-mapped file.
+template <typename T>
+bool load_array_file(const std::string& path, ArrayFormat format, int column, ::google::protobuf::RepeatedField<T>* out,
+                     ArrayImportReport* report);
+
+// Bytes per value of a numeric or bool field, 0 for fields of other types.
+size_t array_value_size(const ::google::protobuf::FieldDescriptor* field_desc);
+
+// Appends the values of the last of |fields| under |msg| to |out|, packed as they are in memory. The fields
+// before it are message fields, walked into every element when repeated. A repeated last field is appended
+// with one copy of its storage; a singular one adds its value even when unset, so records line up.
+void gather_array(const ::google::protobuf::Message& msg,
+                  const std::vector<const ::google::protobuf::FieldDescriptor*>& fields, std::string* out);
+
+// Writes |count| values of the type of |field_desc| from |data| to |path| with one write_file(), behind a
+// NumPy header for kNpy. kText isn't written: formatting is what this is meant to avoid.
+bool write_array_file(const std::string& path, ArrayFormat format, const ::google::protobuf::FieldDescriptor* field_desc,
+                      const void* data, size_t count);
+
+#endif  // ARRAY_IO_H_
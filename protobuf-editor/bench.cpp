@@ -0,0 +1,221 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "bench.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "array_io.h"
+#include "codec.h"
+#include "number.h"
+#include "string.h"
+
+// the validators the editor used before number.h, kept as the baseline
+
+static bool baseline_validate_uint(const std::string& str, uint32_t* val) {
+  if (str.empty() || str.size() > 10) {
+    return false;
+  }
+  for (const auto& c : str) {
+    if (!isdigit(c)) {
+      return false;
+    }
+  }
+  uint64_t temp = static_cast<uint64_t>(stoll(str));
+  if (temp > UINT32_MAX) {
+    return false;
+  }
+  *val = static_cast<uint32_t>(temp);
+  return true;
+}
+
+static bool baseline_validate_double(const std::string& str, double* val) {
+  try {
+    *val = std::stod(str);
+    return true;
+  } catch (const std::invalid_argument&) {
+    return false;
+  } catch (const std::out_of_range&) {
+    return false;
+  }
+}
+
+static bool baseline_validate_float(const std::string& str, float* val) {
+  try {
+    *val = std::stof(str);
+    return true;
+  } catch (const std::invalid_argument&) {
+    return false;
+  } catch (const std::out_of_range&) {
+    return false;
+  }
+}
+
+// Runs |fn| over every string and prints the time per call. The sum of the results keeps the calls from
+// being optimized away.
+template <typename T, typename Fn>
+static void run_case(const char* name, const std::vector<std::string>& inputs, Fn fn) {
+  T sum = 0;
+  size_t failed = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const auto& input : inputs) {
+    T val = 0;
+    if (fn(input, &val)) {
+      sum += val;
+    } else {
+      ++failed;
+    }
+  }
+  auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  printf("  %-28s %8.1f ns/value  (%zu rejected, checksum %g)\n", name, elapsed / static_cast<double>(inputs.size()),
+         failed, static_cast<double>(sum));
+}
+
+void bench_number_parsing(size_t count) {
+  std::mt19937_64 rng(42);
+  std::vector<std::string> uints(count);
+  std::vector<std::string> doubles(count);
+  std::vector<std::string> invalid(count);
+  std::uniform_real_distribution<double> real(-1e6, 1e6);
+  for (size_t i = 0; i < count; ++i) {
+    uints[i] = std::to_string(static_cast<uint32_t>(rng()));
+    doubles[i] = std::to_string(real(rng));
+    invalid[i] = doubles[i] + "x";
+  }
+
+  printf("parsing %zu values\n", count);
+  printf("uint32:\n");
+  run_case<uint32_t>("stoll (baseline)", uints, baseline_validate_uint);
+  run_case<uint32_t>("parse_number", uints, [](const std::string& str, uint32_t* val) { return parse_number(str, val); });
+  printf("float:\n");
+  run_case<float>("stof (baseline)", doubles, baseline_validate_float);
+  run_case<float>("parse_number", doubles, [](const std::string& str, float* val) { return parse_number(str, val); });
+  printf("double:\n");
+  run_case<double>("stod (baseline)", doubles, baseline_validate_double);
+  run_case<double>("parse_number", doubles, [](const std::string& str, double* val) { return parse_number(str, val); });
+  printf("invalid double:\n");
+  run_case<double>("stod (baseline)", invalid, baseline_validate_double);
+  run_case<double>("parse_number", invalid, [](const std::string& str, double* val) { return parse_number(str, val); });
+}
+
+// Joins all the values with commas, like the "-all" input of a repeated field, and prints the time per value.
+template <typename T, typename Fn>
+static void run_join_case(const char* name, const std::vector<T>& values, Fn fn) {
+  auto start = std::chrono::steady_clock::now();
+  std::string joined;
+  for (const auto& val : values) {
+    fn(val, &joined);
+    joined += ',';
+  }
+  auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  printf("  %-28s %8.1f ns/value  (%zu chars)\n", name, elapsed / static_cast<double>(values.size()), joined.size());
+}
+
+template <typename T>
+static void append_formatted(T val, std::string* out) {
+  char buf[kMaxNumberLength];
+  out->append(buf, format_number(val, buf));
+}
+
+void bench_number_formatting(size_t count) {
+  std::mt19937_64 rng(42);
+  std::vector<double> doubles(count);
+  std::vector<float> floats(count);
+  std::uniform_real_distribution<double> real(-1e6, 1e6);
+  for (size_t i = 0; i < count; ++i) {
+    doubles[i] = real(rng);
+    floats[i] = static_cast<float>(doubles[i]);
+  }
+
+  printf("formatting %zu values\n", count);
+  printf("float:\n");
+  run_join_case("to_string (baseline)", floats, [](float val, std::string* out) { *out += std::to_string(val); });
+  run_join_case("format_number", floats, append_formatted<float>);
+  printf("double:\n");
+  run_join_case("to_string (baseline)", doubles, [](double val, std::string* out) { *out += std::to_string(val); });
+  run_join_case("format_number", doubles, append_formatted<double>);
+}
+
+void bench_array_import(size_t count) {
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> real(-1e6, 1e6);
+  std::string text;
+  char buf[kMaxNumberLength];
+  for (size_t i = 0; i < count; ++i) {
+    text.append(buf, format_number(static_cast<float>(real(rng)), buf));
+    text += ',';
+  }
+
+  printf("importing %zu comma-separated floats\n", count);
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::string> tokens;
+  split_by_multiple_delimiters(",", text, &tokens);
+  ::google::protobuf::RepeatedField<float> split_field;
+  for (const auto& token : tokens) {
+    float val;
+    if (baseline_validate_float(token, &val)) {
+      split_field.Add(val);
+    }
+  }
+  auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  printf("  %-28s %8.1f ms  (%d values)\n", "split + stof (baseline)", elapsed, split_field.size());
+
+  start = std::chrono::steady_clock::now();
+  ::google::protobuf::RepeatedField<float> parsed_field;
+  ArrayImportReport report;
+  parse_array(text.data(), text.data() + text.size(), ArrayFormat::kText, -1, &parsed_field, &report);
+  elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  printf("  %-28s %8.1f ms  (%d values)\n", "parse_array", elapsed, parsed_field.size());
+}
+
+// Runs |fn| once and prints the throughput over |size| bytes.
+template <typename Fn>
+static void run_throughput_case(const char* name, size_t size, Fn fn) {
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("  %-28s %8.0f MB/s\n", name, static_cast<double>(size) / elapsed / (1 << 20));
+}
+
+void bench_codecs(size_t size) {
+  std::mt19937_64 rng(42);
+  std::string blob(size, '\0');
+  for (auto& c : blob) {
+    c = static_cast<char>(rng());
+  }
+
+  printf("encoding %zu bytes\n", size);
+  std::string hex;
+  std::string base64;
+  std::string decoded;
+  run_throughput_case("hex_encode", size, [&]() { hex = hex_encode(blob); });
+  run_throughput_case("hex_decode", size, [&]() { hex_decode(hex.data(), hex.data() + hex.size(), &decoded); });
+  run_throughput_case("base64_encode", size, [&]() { base64 = base64_encode(blob); });
+  run_throughput_case("base64_decode", size,
+                      [&]() { base64_decode(base64.data(), base64.data() + base64.size(), &decoded); });
+}
@@ -0,0 +1,380 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "cli.h"
+
+#include <limits.h>
+#include <stdio.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "aggregate.h"
+#include "array_io.h"
+#include "bench.h"
+#include "codec.h"
+#include "field_path.h"
+#include "file.h"
+#include "log.h"
+#include "number.h"
+#include "proto.h"
+#include "protobuf_include.h"
+#include "query.h"
+#include "recover.h"
+#include "wire.h"
+
+static void usage() {
+  fprintf(stderr,
+          "usage: protobuf-editor                                      open the editor\n"
+          "       protobuf-editor salvage [--delimited] <in> <out>     recover what is readable of a damaged file\n"
+          "       protobuf-editor export [--delimited] [--raw] <in> <out-prefix> <field.path>...\n"
+          "                                                            write numeric fields of every record as .npy\n"
+          "                                                            (or raw) arrays named <out-prefix><field.path>\n"
+          "       protobuf-editor bytes [--hex] <in> <field.path>        print a bytes field as base64 (or hex)\n"
+          "       protobuf-editor bytes [--hex] <in> <field.path> <text> <out>\n"
+          "                                                            set it from a base64 (or hex) text file\n"
+          "       protobuf-editor query [--delimited] [--json|--proto] <expression> <in>...\n"
+          "                                                            print what e.g. people[*].phones[type=PHONE_TYPE_MOBILE].number\n"
+          "                                                            selects in every file (or record), as text, JSON\n"
+          "                                                            or delimited messages\n"
+          "       protobuf-editor aggregate [--delimited] [--value <field>] [--by <field>] <selection> <in>...\n"
+          "                                                            count, sum, min, max and distinct of a field of\n"
+          "                                                            the messages e.g. people[*].phones selects,\n"
+          "                                                            grouped by an enum or string field\n"
+          "       protobuf-editor bench [count]                        time the number conversions\n");
+}
+
+static void print_report(const SalvageReport& report, size_t size, bool delimited) {
+  if (report.damaged) {
+    PBE_LOG_INFO("damaged at offset %llu of %zu\n", static_cast<unsigned long long>(report.damage_offset), size);
+  } else {
+    PBE_LOG_INFO("no damage found\n");
+  }
+  if (delimited) {
+    PBE_LOG_INFO("%zu records kept, %zu of them partial, %llu bytes skipped\n", report.records,
+                 report.partial_records, static_cast<unsigned long long>(report.skipped_bytes));
+  }
+}
+
+static int salvage(const std::vector<std::string>& args) {
+  bool delimited = false;
+  std::vector<std::string> paths;
+  for (const auto& arg : args) {
+    if (arg == "--delimited") {
+      delimited = true;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.size() != 2) {
+    usage();
+    return 1;
+  }
+
+  MappedFile input;
+  if (!input.Open(paths[0], true)) {
+    return 1;
+  }
+  std::ofstream output(paths[1], std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!output) {
+    PBE_LOG_ERROR("can't write %s\n", paths[1].c_str());
+    return 1;
+  }
+
+  protobuf::editor::MyRecord record;
+  SalvageReport report;
+  bool ok;
+  if (delimited) {
+    ::google::protobuf::io::OstreamOutputStream stream(&output);
+    ::google::protobuf::io::CodedOutputStream coded(&stream);
+    ok = salvage_delimited(input.data(), input.size(), &record,
+                           [&coded](const ::google::protobuf::Message& msg) {
+                             coded.WriteVarint64(msg.ByteSizeLong());
+                             msg.SerializeWithCachedSizes(&coded);
+                           },
+                           &report);
+  } else {
+    ok = salvage_message(input.data(), input.size(), &record, &report) && record.SerializePartialToOstream(&output);
+  }
+  print_report(report, input.size(), delimited);
+  if (!ok) {
+    PBE_LOG_ERROR("nothing recovered from %s\n", paths[0].c_str());
+    return 1;
+  }
+  return 0;
+}
+
+// the values of one field path across all records
+struct ExportColumn {
+  std::string name;
+  std::vector<const ::google::protobuf::FieldDescriptor*> fields;
+  std::string values;
+};
+
+static int export_arrays(const std::vector<std::string>& args) {
+  bool delimited = false;
+  ArrayFormat format = ArrayFormat::kNpy;
+  std::vector<std::string> positional;
+  for (const auto& arg : args) {
+    if (arg == "--delimited") {
+      delimited = true;
+    } else if (arg == "--raw") {
+      format = ArrayFormat::kRaw;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.size() < 3) {
+    usage();
+    return 1;
+  }
+
+  protobuf::editor::MyRecord record;
+  std::vector<ExportColumn> columns(positional.size() - 2);
+  for (size_t i = 0; i < columns.size(); ++i) {
+    columns[i].name = positional[i + 2];
+    if (!parse_field_names(record.GetDescriptor(), columns[i].name, &columns[i].fields)) {
+      return 1;
+    }
+    if (0 == array_value_size(columns[i].fields.back())) {
+      PBE_LOG_ERROR("%s is not a numeric or bool field\n", columns[i].name.c_str());
+      return 1;
+    }
+  }
+
+  size_t records = 0;
+  if (delimited) {
+    MappedFile input;
+    if (!input.Open(positional[0], true)) {
+      return 1;
+    }
+    uint64_t offset = 0;
+    uint64_t begin;
+    uint64_t end;
+    while (offset < input.size()) {
+      uint64_t record_offset = offset;
+      if (!next_delimited(input.data(), input.size(), &offset, &begin, &end) || end - begin > INT_MAX ||
+          !record.ParsePartialFromArray(input.data() + begin, static_cast<int>(end - begin))) {
+        PBE_LOG_ERROR("%s: can't parse the record at offset %llu\n", positional[0].c_str(),
+                      static_cast<unsigned long long>(record_offset));
+        return 1;
+      }
+      for (auto& column : columns) {
+        gather_array(record, column.fields, &column.values);
+      }
+      ++records;
+    }
+  } else {
+    if (!read_file(positional[0], &record)) {
+      return 1;
+    }
+    for (auto& column : columns) {
+      gather_array(record, column.fields, &column.values);
+    }
+    records = 1;
+  }
+
+  for (const auto& column : columns) {
+    std::string path = positional[1] + column.name + (format == ArrayFormat::kNpy ? ".npy" : ".bin");
+    size_t count = column.values.size() / array_value_size(column.fields.back());
+    if (!write_array_file(path, format, column.fields.back(), column.values.data(), count)) {
+      return 1;
+    }
+    PBE_LOG_INFO("%s: %zu values from %zu records\n", path.c_str(), count, records);
+  }
+  return 0;
+}
+
+// The message holding the last of |fields|, through singular message fields from |root|.
+static ::google::protobuf::Message* singular_parent(::google::protobuf::Message* root,
+                                                    const std::vector<const ::google::protobuf::FieldDescriptor*>& fields) {
+  ::google::protobuf::Message* msg = root;
+  for (size_t i = 0; i + 1 < fields.size(); ++i) {
+    if (fields[i]->is_repeated()) {
+      PBE_LOG_ERROR("%s is repeated\n", fields[i]->name().c_str());
+      return nullptr;
+    }
+    msg = msg->GetReflection()->MutableMessage(msg, fields[i]);
+  }
+  return msg;
+}
+
+static int bytes_field(const std::vector<std::string>& args) {
+  bool hex = false;
+  std::vector<std::string> positional;
+  for (const auto& arg : args) {
+    if (arg == "--hex") {
+      hex = true;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.size() != 2 && positional.size() != 4) {
+    usage();
+    return 1;
+  }
+
+  protobuf::editor::MyRecord record;
+  std::vector<const ::google::protobuf::FieldDescriptor*> fields;
+  if (!read_file(positional[0], &record) || !parse_field_names(record.GetDescriptor(), positional[1], &fields)) {
+    return 1;
+  }
+  const auto* field_desc = fields.back();
+  if (field_desc->cpp_type() != ::google::protobuf::FieldDescriptor::CPPTYPE_STRING || field_desc->is_repeated()) {
+    PBE_LOG_ERROR("%s is not a singular bytes or string field\n", positional[1].c_str());
+    return 1;
+  }
+  auto* msg = singular_parent(&record, fields);
+  if (nullptr == msg) {
+    return 1;
+  }
+
+  if (positional.size() == 2) {
+    std::string scratch;
+    const std::string& value = msg->GetReflection()->GetStringReference(*msg, field_desc, &scratch);
+    std::string text = hex ? hex_encode(value) : base64_encode(value);
+    text += '\n';
+    return fwrite(text.data(), 1, text.size(), stdout) == text.size() ? 0 : 1;
+  }
+
+  MappedFile input;
+  if (!input.Open(positional[2], true)) {
+    return 1;
+  }
+  const auto* text = reinterpret_cast<const char*>(input.data());
+  std::string value;
+  if (!(hex ? hex_decode(text, text + input.size(), &value) : base64_decode(text, text + input.size(), &value))) {
+    PBE_LOG_ERROR("%s is not %s\n", positional[2].c_str(), hex ? "hex" : "base64");
+    return 1;
+  }
+  msg->GetReflection()->SetString(msg, field_desc, std::move(value));
+  std::ofstream output(positional[3], std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!record.SerializePartialToOstream(&output)) {
+    PBE_LOG_ERROR("can't write %s\n", positional[3].c_str());
+    return 1;
+  }
+  return 0;
+}
+
+static int query(const std::vector<std::string>& args) {
+  bool delimited = false;
+  QueryOutput output = QueryOutput::kText;
+  std::vector<std::string> positional;
+  for (const auto& arg : args) {
+    if (arg == "--delimited") {
+      delimited = true;
+    } else if (arg == "--json") {
+      output = QueryOutput::kJson;
+    } else if (arg == "--proto") {
+      output = QueryOutput::kDelimited;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.size() < 2) {
+    usage();
+    return 1;
+  }
+
+  protobuf::editor::MyRecord record;
+  Query parsed;
+  if (!parse_query(record.GetDescriptor(), positional[0], &parsed)) {
+    return 1;
+  }
+  if (output == QueryOutput::kDelimited && !query_yields_messages(parsed)) {
+    PBE_LOG_ERROR("%s selects values, not messages\n", positional[0].c_str());
+    return 1;
+  }
+  std::vector<std::string> paths(positional.begin() + 1, positional.end());
+  return query_files(parsed, record, paths, delimited, output, stdout) ? 0 : 1;
+}
+
+static int aggregate(const std::vector<std::string>& args) {
+  bool delimited = false;
+  std::string value;
+  std::string key;
+  std::vector<std::string> positional;
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (args[i] == "--delimited") {
+      delimited = true;
+    } else if ((args[i] == "--value" || args[i] == "--by") && i + 1 < args.size()) {
+      (args[i] == "--value" ? value : key) = args[i + 1];
+      ++i;
+    } else {
+      positional.push_back(args[i]);
+    }
+  }
+  if (positional.size() < 2) {
+    usage();
+    return 1;
+  }
+
+  protobuf::editor::MyRecord record;
+  Aggregate parsed;
+  if (!parse_aggregate(record.GetDescriptor(), positional[0], value, key, &parsed)) {
+    return 1;
+  }
+  std::vector<std::string> paths(positional.begin() + 1, positional.end());
+  AggregateResult result;
+  if (!aggregate_files(parsed, record, paths, delimited, &result)) {
+    return 1;
+  }
+  std::string text = format_aggregate(parsed, result);
+  return fwrite(text.data(), 1, text.size(), stdout) == text.size() ? 0 : 1;
+}
+
+static int bench(const std::vector<std::string>& args) {
+  size_t count = 1000000;
+  if (args.size() > 1 || (args.size() == 1 && !parse_number(args[0], &count))) {
+    usage();
+    return 1;
+  }
+  bench_number_parsing(count);
+  bench_number_formatting(count);
+  bench_array_import(count);
+  bench_codecs(count * 16);
+  return 0;
+}
+
+int run_cli(int argc, char** argv) {
+  std::string command = argv[1];
+  std::vector<std::string> args(argv + 2, argv + argc);
+  if (command == "salvage") {
+    return salvage(args);
+  }
+  if (command == "export") {
+    return export_arrays(args);
+  }
+  if (command == "bytes") {
+    return bytes_field(args);
+  }
+  if (command == "query") {
+    return query(args);
+  }
+  if (command == "aggregate") {
+    return aggregate(args);
+  }
+  if (command == "bench") {
+    return bench(args);
+  }
+  usage();
+  return 1;
+}
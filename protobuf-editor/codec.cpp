@@ -0,0 +1,240 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "codec.h"
+
+#include <string.h>
+
+// the two digits of every byte value, in output order
+struct HexPairs {
+  char of[256][2];
+  HexPairs() {
+    static const char kDigits[] = "0123456789abcdef";
+    for (int i = 0; i < 256; ++i) {
+      of[i][0] = kDigits[i >> 4];
+      of[i][1] = kDigits[i & 15];
+    }
+  }
+};
+
+static const HexPairs kHexPairs;
+
+void hex_encode(const uint8_t* data, size_t size, char* out) {
+  // Four bytes at a time within a 64-bit word: spread them one per 16-bit lane, split each into its two
+  // nibbles, and turn all eight nibbles into digits at once. Bytes go in and digits come out in memory
+  // order, so this assumes a little-endian host like the rest of the byte handling.
+  const uint64_t kNibbles = 0x000F000F000F000Full;
+  const uint64_t kOnes = 0x0101010101010101ull;
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    uint32_t word;
+    memcpy(&word, data + i, sizeof(word));
+    uint64_t lanes = word;
+    lanes = (lanes | lanes << 16) & 0x0000FFFF0000FFFFull;
+    lanes = (lanes | lanes << 8) & 0x00FF00FF00FF00FFull;
+    uint64_t nibbles = ((lanes >> 4) & kNibbles) | (lanes & kNibbles) << 8;
+    // '0' + n, plus the gap up to 'a' for n > 9
+    uint64_t letters = ((nibbles + 6 * kOnes) >> 4) & kOnes;
+    uint64_t digits = nibbles + '0' * kOnes + letters * ('a' - '0' - 10);
+    memcpy(out + 2 * i, &digits, sizeof(digits));
+  }
+  for (; i < size; ++i) {
+    memcpy(out + 2 * i, kHexPairs.of[data[i]], 2);
+  }
+}
+
+std::string hex_encode(const std::string& data) {
+  std::string out(2 * data.size(), '\0');
+  hex_encode(reinterpret_cast<const uint8_t*>(data.data()), data.size(), &out[0]);
+  return out;
+}
+
+enum : uint8_t {
+  kHexSpace = 16,
+  kHexInvalid = 255,
+};
+
+// the value of every hex digit, in either case
+struct HexValues {
+  uint8_t of[256];
+  HexValues() {
+    memset(of, kHexInvalid, sizeof(of));
+    for (uint8_t i = 0; i < 10; ++i) {
+      of['0' + i] = i;
+    }
+    for (uint8_t i = 0; i < 6; ++i) {
+      of['a' + i] = static_cast<uint8_t>(10 + i);
+      of['A' + i] = static_cast<uint8_t>(10 + i);
+    }
+    for (char c : {' ', '\t', '\r', '\n'}) {
+      of[static_cast<unsigned char>(c)] = kHexSpace;
+    }
+  }
+  uint8_t operator[](char c) const { return of[static_cast<unsigned char>(c)]; }
+};
+
+static const HexValues kHexValues;
+
+bool hex_decode(const char* begin, const char* end, std::string* out) {
+  out->resize(static_cast<size_t>(end - begin) / 2);
+  auto* written = reinterpret_cast<uint8_t*>(&(*out)[0]);
+  for (const char* p = begin; p != end;) {
+    uint8_t high = kHexValues[*p];
+    if (high == kHexSpace) {
+      ++p;
+      continue;
+    }
+    uint8_t low = p + 1 != end ? kHexValues[p[1]] : kHexInvalid;
+    if ((high | low) >= 16) {
+      out->clear();
+      return false;
+    }
+    *written++ = static_cast<uint8_t>(high << 4 | low);
+    p += 2;
+  }
+  out->resize(static_cast<size_t>(written - reinterpret_cast<uint8_t*>(&(*out)[0])));
+  return true;
+}
+
+static const char kBase64Digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// the two digits of every 12-bit value, so three bytes take two lookups
+struct Base64Pairs {
+  char of[4096][2];
+  Base64Pairs() {
+    for (int i = 0; i < 4096; ++i) {
+      of[i][0] = kBase64Digits[i >> 6];
+      of[i][1] = kBase64Digits[i & 63];
+    }
+  }
+};
+
+static const Base64Pairs kBase64Pairs;
+
+size_t base64_encoded_size(size_t size) { return (size + 2) / 3 * 4; }
+
+void base64_encode(const uint8_t* data, size_t size, char* out) {
+  size_t i = 0;
+  for (; i + 3 <= size; i += 3, out += 4) {
+    uint32_t group = static_cast<uint32_t>(data[i]) << 16 | static_cast<uint32_t>(data[i + 1]) << 8 | data[i + 2];
+    memcpy(out, kBase64Pairs.of[group >> 12], 2);
+    memcpy(out + 2, kBase64Pairs.of[group & 0xfff], 2);
+  }
+  if (i < size) {
+    uint32_t group = static_cast<uint32_t>(data[i]) << 16;
+    if (i + 1 < size) {
+      group |= static_cast<uint32_t>(data[i + 1]) << 8;
+    }
+    memcpy(out, kBase64Pairs.of[group >> 12], 2);
+    out[2] = i + 1 < size ? kBase64Digits[(group >> 6) & 63] : '=';
+    out[3] = '=';
+  }
+}
+
+std::string base64_encode(const std::string& data) {
+  std::string out(base64_encoded_size(data.size()), '\0');
+  base64_encode(reinterpret_cast<const uint8_t*>(data.data()), data.size(), &out[0]);
+  return out;
+}
+
+enum : uint8_t {
+  kBase64Space = 64,
+  kBase64Pad = 65,
+  kBase64Invalid = 255,
+};
+
+// the 6-bit value of every base64 digit, in both alphabets
+struct Base64Values {
+  uint8_t of[256];
+  Base64Values() {
+    memset(of, kBase64Invalid, sizeof(of));
+    for (uint8_t i = 0; i < 64; ++i) {
+      of[static_cast<unsigned char>(kBase64Digits[i])] = i;
+    }
+    of[static_cast<unsigned char>('-')] = 62;
+    of[static_cast<unsigned char>('_')] = 63;
+    for (char c : {' ', '\t', '\r', '\n'}) {
+      of[static_cast<unsigned char>(c)] = kBase64Space;
+    }
+    of[static_cast<unsigned char>('=')] = kBase64Pad;
+  }
+  uint8_t operator[](char c) const { return of[static_cast<unsigned char>(c)]; }
+};
+
+static const Base64Values kBase64Values;
+
+bool base64_decode(const char* begin, const char* end, std::string* out) {
+  out->resize(static_cast<size_t>(end - begin) / 4 * 3 + 3);
+  auto* written = reinterpret_cast<uint8_t*>(&(*out)[0]);
+  uint32_t group = 0;
+  int digits = 0;  // in |group|
+  bool padded = false;
+  for (const char* p = begin; p != end;) {
+    // four digits at once while they are all digits, which is almost always
+    if (digits == 0 && !padded && end - p >= 4) {
+      uint32_t a = kBase64Values[p[0]];
+      uint32_t b = kBase64Values[p[1]];
+      uint32_t c = kBase64Values[p[2]];
+      uint32_t d = kBase64Values[p[3]];
+      if ((a | b | c | d) < 64) {
+        uint32_t bits = a << 18 | b << 12 | c << 6 | d;
+        written[0] = static_cast<uint8_t>(bits >> 16);
+        written[1] = static_cast<uint8_t>(bits >> 8);
+        written[2] = static_cast<uint8_t>(bits);
+        written += 3;
+        p += 4;
+        continue;
+      }
+    }
+    uint8_t value = kBase64Values[*p++];
+    if (value == kBase64Space) {
+      continue;
+    }
+    if (value == kBase64Pad) {
+      padded = true;
+      continue;
+    }
+    if (value == kBase64Invalid || padded) {
+      out->clear();
+      return false;
+    }
+    group = group << 6 | value;
+    if (++digits == 4) {
+      *written++ = static_cast<uint8_t>(group >> 16);
+      *written++ = static_cast<uint8_t>(group >> 8);
+      *written++ = static_cast<uint8_t>(group);
+      group = 0;
+      digits = 0;
+    }
+  }
+  // a last group of two or three digits holds one or two bytes
+  if (digits == 1) {
+    out->clear();
+    return false;
+  }
+  if (digits == 2) {
+    *written++ = static_cast<uint8_t>(group >> 4);
+  } else if (digits == 3) {
+    *written++ = static_cast<uint8_t>(group >> 10);
+    *written++ = static_cast<uint8_t>(group >> 2);
+  }
+  out->resize(static_cast<size_t>(written - reinterpret_cast<uint8_t*>(&(*out)[0])));
+  return true;
+}
@@ -0,0 +1,47 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CODEC_H_
+#define CODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// Writes two lowercase hex digits per byte of [data, data + size) to |out|, 2 * size chars, no NUL.
+void hex_encode(const uint8_t* data, size_t size, char* out);
+std::string hex_encode(const std::string& data);
+
+// Two hex digits per byte, in either case, optionally separated by whitespace. Returns false on anything
+// else, or an odd digit out.
+bool hex_decode(const char* begin, const char* end, std::string* out);
+
+// Standard base64 with padding, 4 * ceil(size / 3) chars, no NUL.
+size_t base64_encoded_size(size_t size);
+void base64_encode(const uint8_t* data, size_t size, char* out);
+std::string base64_encode(const std::string& data);
+
+// Standard or URL-safe base64, padded or not, with any whitespace in between as in wrapped or indented
+// text. Returns false on anything else.
+bool base64_decode(const char* begin, const char* end, std::string* out);
+
+#endif  // CODEC_H_
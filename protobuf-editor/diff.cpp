@@ -0,0 +1,391 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "diff.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "parallel.h"
+
+static const size_t kMaxValueLength = 200;
+
+static uint64_t mix(uint64_t h, uint64_t v) {
+  v *= 0x9e3779b97f4a7c15ULL;
+  v ^= v >> 32;
+  h ^= v;
+  h *= 0xff51afd7ed558ccdULL;
+  return h ^ (h >> 33);
+}
+
+static uint64_t hash_bytes(const std::string& str) {
+  uint64_t h = str.size();
+  size_t i = 0;
+  for (; i + 8 <= str.size(); i += 8) {
+    uint64_t word;
+    memcpy(&word, str.data() + i, sizeof(word));
+    h = mix(h, word);
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, str.data() + i, str.size() - i);
+  return mix(h, tail);
+}
+
+// |index| is -1 for singular fields.
+static uint64_t hash_value(const ::google::protobuf::Message& msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                           int index, HashCache* cache) {
+  auto* reflection = msg.GetReflection();
+  bool repeated = index >= 0;
+  switch (field_desc->cpp_type()) {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+      return static_cast<uint64_t>(repeated ? reflection->GetRepeatedInt32(msg, field_desc, index)
+                                            : reflection->GetInt32(msg, field_desc));
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+      return static_cast<uint64_t>(repeated ? reflection->GetRepeatedInt64(msg, field_desc, index)
+                                            : reflection->GetInt64(msg, field_desc));
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+      return repeated ? reflection->GetRepeatedUInt32(msg, field_desc, index) : reflection->GetUInt32(msg, field_desc);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+      return repeated ? reflection->GetRepeatedUInt64(msg, field_desc, index) : reflection->GetUInt64(msg, field_desc);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE: {
+      double val =
+          repeated ? reflection->GetRepeatedDouble(msg, field_desc, index) : reflection->GetDouble(msg, field_desc);
+      uint64_t bits;
+      memcpy(&bits, &val, sizeof(bits));
+      return bits;
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_FLOAT: {
+      float val = repeated ? reflection->GetRepeatedFloat(msg, field_desc, index) : reflection->GetFloat(msg, field_desc);
+      uint32_t bits;
+      memcpy(&bits, &val, sizeof(bits));
+      return bits;
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+      return repeated ? reflection->GetRepeatedBool(msg, field_desc, index) : reflection->GetBool(msg, field_desc);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_ENUM:
+      return static_cast<uint64_t>(repeated ? reflection->GetRepeatedEnumValue(msg, field_desc, index)
+                                            : reflection->GetEnumValue(msg, field_desc));
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_STRING: {
+      std::string scratch;
+      return hash_bytes(repeated ? reflection->GetRepeatedStringReference(msg, field_desc, index, &scratch)
+                                 : reflection->GetStringReference(msg, field_desc, &scratch));
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE:
+      return hash_message(
+          repeated ? reflection->GetRepeatedMessage(msg, field_desc, index) : reflection->GetMessage(msg, field_desc),
+          cache);
+  }
+  return 0;
+}
+
+uint64_t hash_message(const ::google::protobuf::Message& msg, HashCache* cache) {
+  auto it = cache->find(&msg);
+  if (it != cache->end()) {
+    return it->second;
+  }
+
+  std::vector<const ::google::protobuf::FieldDescriptor*> fields;
+  msg.GetReflection()->ListFields(msg, &fields);
+  uint64_t h = fields.size();
+  for (auto* field_desc : fields) {
+    h = mix(h, static_cast<uint64_t>(field_desc->number()));
+    if (field_desc->is_repeated()) {
+      int size = msg.GetReflection()->FieldSize(msg, field_desc);
+      h = mix(h, static_cast<uint64_t>(size));
+      for (int i = 0; i < size; ++i) {
+        h = mix(h, hash_value(msg, field_desc, i, cache));
+      }
+    } else {
+      h = mix(h, hash_value(msg, field_desc, -1, cache));
+    }
+  }
+  (*cache)[&msg] = h;
+  return h;
+}
+
+static void child_messages(const ::google::protobuf::Message& msg, std::vector<const ::google::protobuf::Message*>* out) {
+  auto* reflection = msg.GetReflection();
+  std::vector<const ::google::protobuf::FieldDescriptor*> fields;
+  reflection->ListFields(msg, &fields);
+  for (auto* field_desc : fields) {
+    if (field_desc->cpp_type() != ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+      continue;
+    }
+    if (field_desc->is_repeated()) {
+      int size = reflection->FieldSize(msg, field_desc);
+      for (int i = 0; i < size; ++i) {
+        out->push_back(&reflection->GetRepeatedMessage(msg, field_desc, i));
+      }
+    } else {
+      out->push_back(&reflection->GetMessage(msg, field_desc));
+    }
+  }
+}
+
+uint64_t hash_tree(const ::google::protobuf::Message& root, HashCache* cache) {
+  // go down level by level until there are enough independent subtrees to keep all cores busy
+  std::vector<const ::google::protobuf::Message*> upper;
+  std::vector<const ::google::protobuf::Message*> frontier{&root};
+  const size_t wanted = worker_count() * 64;
+  while (!frontier.empty() && frontier.size() < wanted) {
+    std::vector<const ::google::protobuf::Message*> next;
+    for (auto* msg : frontier) {
+      upper.push_back(msg);
+      child_messages(*msg, &next);
+    }
+    frontier.swap(next);
+  }
+
+  std::vector<HashCache> partial(worker_count());
+  parallel_for(frontier.size(), [&](size_t chunk, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      hash_message(*frontier[i], &partial[chunk]);
+    }
+  });
+  size_t total = cache->size();
+  for (const auto& part : partial) {
+    total += part.size();
+  }
+  cache->reserve(total + upper.size());
+  for (const auto& part : partial) {
+    cache->insert(part.begin(), part.end());
+  }
+
+  // the upper levels only combine hashes of their children, deepest first
+  for (auto it = upper.rbegin(); it != upper.rend(); ++it) {
+    hash_message(**it, cache);
+  }
+  return hash_message(root, cache);
+}
+
+static std::string value_string(const ::google::protobuf::Message& msg,
+                                const ::google::protobuf::FieldDescriptor* field_desc, int index) {
+  if (field_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+    return "<" + field_desc->message_type()->name() + ">";
+  }
+  std::string out;
+  ::google::protobuf::TextFormat::PrintFieldValueToString(msg, field_desc, index, &out);
+  if (out.size() > kMaxValueLength) {
+    out.resize(kMaxValueLength);
+    out += "...";
+  }
+  return out;
+}
+
+class Differ {
+ public:
+  Differ(const DiffOptions& options, DiffResult* out) : options_(options), out_(out) {}
+
+  void Run(const ::google::protobuf::Message& left, const ::google::protobuf::Message& right) {
+    if (hash_tree(left, &left_cache_) == hash_tree(right, &right_cache_)) {
+      ++out_->skipped_subtrees;
+      return;
+    }
+    Walk(left, right, 0);
+  }
+
+ private:
+  void Walk(const ::google::protobuf::Message& left, const ::google::protobuf::Message& right, int depth) {
+    auto* desc = left.GetDescriptor();
+    for (int i = 0; i < desc->field_count() && !out_->truncated; ++i) {
+      auto* field_desc = desc->field(i);
+      if (field_desc->is_repeated()) {
+        DiffRepeated(left, right, field_desc, depth);
+      } else {
+        DiffSingular(left, right, field_desc, depth);
+      }
+    }
+  }
+
+  void Push(DiffEntry::Kind kind, int depth, bool is_message, std::string name, std::string left, std::string right) {
+    if (out_->entries.size() >= options_.max_entries) {
+      out_->truncated = true;
+      return;
+    }
+    out_->entries.push_back({kind, depth, is_message, std::move(name), std::move(left), std::move(right)});
+  }
+
+  bool SameValue(const ::google::protobuf::Message& left, const ::google::protobuf::Message& right,
+                 const ::google::protobuf::FieldDescriptor* field_desc, int left_index, int right_index) {
+    if (field_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_STRING) {
+      std::string left_scratch, right_scratch;
+      auto* reflection = left.GetReflection();
+      return (left_index < 0 ? reflection->GetStringReference(left, field_desc, &left_scratch)
+                             : reflection->GetRepeatedStringReference(left, field_desc, left_index, &left_scratch)) ==
+             (right_index < 0 ? reflection->GetStringReference(right, field_desc, &right_scratch)
+                              : reflection->GetRepeatedStringReference(right, field_desc, right_index, &right_scratch));
+    }
+    return hash_value(left, field_desc, left_index, &left_cache_) ==
+           hash_value(right, field_desc, right_index, &right_cache_);
+  }
+
+  void DiffSingular(const ::google::protobuf::Message& left, const ::google::protobuf::Message& right,
+                    const ::google::protobuf::FieldDescriptor* field_desc, int depth) {
+    bool left_has = left.GetReflection()->HasField(left, field_desc);
+    bool right_has = right.GetReflection()->HasField(right, field_desc);
+    if (!left_has && !right_has) {
+      return;
+    }
+    if (left_has && right_has) {
+      if (SameValue(left, right, field_desc, -1, -1)) {
+        if (field_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+          ++out_->skipped_subtrees;
+        }
+        return;
+      }
+      if (field_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+        Push(DiffEntry::Kind::kChanged, depth, true, field_desc->name(), "", "");
+        Walk(left.GetReflection()->GetMessage(left, field_desc), right.GetReflection()->GetMessage(right, field_desc),
+             depth + 1);
+        return;
+      }
+      Push(DiffEntry::Kind::kChanged, depth, false, field_desc->name(), value_string(left, field_desc, -1),
+           value_string(right, field_desc, -1));
+      return;
+    }
+    Push(left_has ? DiffEntry::Kind::kRemoved : DiffEntry::Kind::kAdded, depth, false, field_desc->name(),
+         left_has ? value_string(left, field_desc, -1) : "", right_has ? value_string(right, field_desc, -1) : "");
+  }
+
+  // Pairs up the elements of a repeated field, -1 marks an element without a partner. Elements are
+  // matched by the key field when there is one, otherwise identical elements are matched by their
+  // hash and the rest are paired in order, so one inserted element does not shift all the others.
+  void Align(const ::google::protobuf::Message& left, const ::google::protobuf::Message& right,
+             const ::google::protobuf::FieldDescriptor* field_desc, std::vector<std::pair<int, int>>* pairs) {
+    int left_size = left.GetReflection()->FieldSize(left, field_desc);
+    int right_size = right.GetReflection()->FieldSize(right, field_desc);
+
+    const ::google::protobuf::FieldDescriptor* key_desc = nullptr;
+    if (!options_.key_field.empty() && nullptr != field_desc->message_type()) {
+      key_desc = field_desc->message_type()->FindFieldByName(options_.key_field);
+      if (nullptr != key_desc &&
+          (key_desc->is_repeated() || key_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE)) {
+        key_desc = nullptr;
+      }
+    }
+    auto key = [&](const ::google::protobuf::Message& msg, int index, HashCache* cache) {
+      if (nullptr == key_desc) {
+        return hash_value(msg, field_desc, index, cache);
+      }
+      return hash_value(msg.GetReflection()->GetRepeatedMessage(msg, field_desc, index), key_desc, -1, cache);
+    };
+
+    struct Candidates {
+      std::vector<int> indexes;
+      size_t next = 0;
+    };
+    std::unordered_map<uint64_t, Candidates> right_by_key;
+    for (int j = 0; j < right_size; ++j) {
+      right_by_key[key(right, j, &right_cache_)].indexes.push_back(j);
+    }
+    std::vector<bool> matched(static_cast<size_t>(right_size), false);
+    std::vector<int> left_unmatched;
+    for (int i = 0; i < left_size; ++i) {
+      auto it = right_by_key.find(key(left, i, &left_cache_));
+      if (it == right_by_key.end() || it->second.next == it->second.indexes.size()) {
+        left_unmatched.push_back(i);
+        continue;
+      }
+      int j = it->second.indexes[it->second.next++];
+      matched[static_cast<size_t>(j)] = true;
+      pairs->emplace_back(i, j);
+    }
+    std::vector<int> right_unmatched;
+    for (int j = 0; j < right_size; ++j) {
+      if (!matched[static_cast<size_t>(j)]) {
+        right_unmatched.push_back(j);
+      }
+    }
+
+    size_t paired = nullptr == key_desc ? std::min(left_unmatched.size(), right_unmatched.size()) : 0;
+    for (size_t k = 0; k < paired; ++k) {
+      pairs->emplace_back(left_unmatched[k], right_unmatched[k]);
+    }
+    for (size_t k = paired; k < left_unmatched.size(); ++k) {
+      pairs->emplace_back(left_unmatched[k], -1);
+    }
+    for (size_t k = paired; k < right_unmatched.size(); ++k) {
+      pairs->emplace_back(-1, right_unmatched[k]);
+    }
+  }
+
+  void DiffRepeated(const ::google::protobuf::Message& left, const ::google::protobuf::Message& right,
+                    const ::google::protobuf::FieldDescriptor* field_desc, int depth) {
+    int left_size = left.GetReflection()->FieldSize(left, field_desc);
+    int right_size = right.GetReflection()->FieldSize(right, field_desc);
+    if (0 == left_size && 0 == right_size) {
+      return;
+    }
+    bool is_message = field_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE;
+
+    size_t mark = out_->entries.size();
+    Push(DiffEntry::Kind::kChanged, depth, true, field_desc->name(), std::to_string(left_size) + " items",
+         std::to_string(right_size) + " items");
+
+    std::vector<std::pair<int, int>> pairs;
+    Align(left, right, field_desc, &pairs);
+    for (const auto& pair : pairs) {
+      if (out_->truncated) {
+        return;
+      }
+      int i = pair.first;
+      int j = pair.second;
+      std::string name = field_desc->name() + "[" + std::to_string(i >= 0 ? i : j) + "]";
+      if (i >= 0 && j >= 0) {
+        if (SameValue(left, right, field_desc, i, j)) {
+          out_->skipped_subtrees += is_message;
+          continue;
+        }
+        if (i != j) {
+          name += " / [" + std::to_string(j) + "]";
+        }
+        if (!is_message) {
+          Push(DiffEntry::Kind::kChanged, depth + 1, false, name, value_string(left, field_desc, i),
+               value_string(right, field_desc, j));
+          continue;
+        }
+        Push(DiffEntry::Kind::kChanged, depth + 1, true, name, "", "");
+        Walk(left.GetReflection()->GetRepeatedMessage(left, field_desc, i),
+             right.GetReflection()->GetRepeatedMessage(right, field_desc, j), depth + 2);
+      } else if (i >= 0) {
+        Push(DiffEntry::Kind::kRemoved, depth + 1, false, name, value_string(left, field_desc, i), "");
+      } else {
+        Push(DiffEntry::Kind::kAdded, depth + 1, false, name, "", value_string(right, field_desc, j));
+      }
+    }
+
+    if (out_->entries.size() == mark + 1) {
+      // the header alone, nothing changed
+      out_->entries.pop_back();
+    }
+  }
+
+  const DiffOptions& options_;
+  DiffResult* out_;
+  HashCache left_cache_;
+  HashCache right_cache_;
+};
+
+void diff_messages(const ::google::protobuf::Message& left, const ::google::protobuf::Message& right,
+                   const DiffOptions& options, DiffResult* out) {
+  *out = DiffResult();
+  Differ(options, out).Run(left, right);
+}
@@ -0,0 +1,74 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef DIFF_H_
+#define DIFF_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "protobuf_include.h"
+
+// Subtree hash of every message that was hashed, keyed by the message itself.
+typedef std::unordered_map<const ::google::protobuf::Message*, uint64_t> HashCache;
+
+// Merkle style hash: a message hash combines the values of its set fields, and a message field
+// contributes the (cached) hash of its own subtree.
+uint64_t hash_message(const ::google::protobuf::Message& msg, HashCache* cache);
+
+// Hashes every subtree of |root| into |cache|, spreading independent subtrees over all cores.
+uint64_t hash_tree(const ::google::protobuf::Message& root, HashCache* cache);
+
+struct DiffOptions {
+  // Elements of repeated messages that have a field with this name are matched by its value
+  // instead of by their index.
+  std::string key_field;
+  size_t max_entries = 1000000;
+};
+
+// One row of the diff, listed in tree order. A message row is followed by the rows of its
+// differences, one level deeper.
+struct DiffEntry {
+  enum class Kind { kChanged, kAdded, kRemoved };
+
+  Kind kind;
+  int depth;
+  bool is_message;
+  std::string name;
+  std::string left;
+  std::string right;
+};
+
+struct DiffResult {
+  std::vector<DiffEntry> entries;
+  size_t skipped_subtrees = 0;
+  bool truncated = false;
+};
+
+// Lists the differences between |left| and |right|, which must be of the same type. Subtrees
+// with equal hashes are skipped without being walked.
+void diff_messages(const ::google::protobuf::Message& left, const ::google::protobuf::Message& right,
+                   const DiffOptions& options, DiffResult* out);
+
+#endif  // DIFF_H_
@@ -0,0 +1,97 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "field_path.h"
+
+#include "log.h"
+
+::google::protobuf::Message* resolve_path(::google::protobuf::Message* root, const FieldPath& path) {
+  ::google::protobuf::Message* msg = root;
+  for (const auto& step : path) {
+    auto* field_desc = msg->GetDescriptor()->FindFieldByNumber(step.field_number);
+    if (nullptr == field_desc || field_desc->cpp_type() != ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+      return nullptr;
+    }
+    auto* reflection = msg->GetReflection();
+    if (field_desc->is_repeated()) {
+      if (step.index < 0 || step.index >= reflection->FieldSize(*msg, field_desc)) {
+        return nullptr;
+      }
+      msg = reflection->MutableRepeatedMessage(msg, field_desc, step.index);
+    } else {
+      if (!reflection->HasField(*msg, field_desc)) {
+        return nullptr;
+      }
+      msg = reflection->MutableMessage(msg, field_desc);
+    }
+  }
+  return msg;
+}
+
+bool same_path(const FieldPath& a, const FieldPath& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].field_number != b[i].field_number || a[i].index != b[i].index) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string path_to_string(const ::google::protobuf::Descriptor* root_desc, const FieldPath& path) {
+  std::string out;
+  const ::google::protobuf::Descriptor* desc = root_desc;
+  for (const auto& step : path) {
+    if (!out.empty()) {
+      out += ".";
+    }
+    auto* field_desc = nullptr == desc ? nullptr : desc->FindFieldByNumber(step.field_number);
+    out += nullptr == field_desc ? std::to_string(step.field_number) : field_desc->name();
+    if (step.index >= 0) {
+      out += "[" + std::to_string(step.index) + "]";
+    }
+    desc = nullptr == field_desc ? nullptr : field_desc->message_type();
+  }
+  return out;
+}
+
+bool parse_field_names(const ::google::protobuf::Descriptor* root_desc, const std::string& dotted,
+                       std::vector<const ::google::protobuf::FieldDescriptor*>* out) {
+  out->clear();
+  const ::google::protobuf::Descriptor* desc = root_desc;
+  size_t begin = 0;
+  for (;;) {
+    size_t end = dotted.find('.', begin);
+    std::string name = dotted.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+    auto* field_desc = nullptr == desc ? nullptr : desc->FindFieldByName(name);
+    if (nullptr == field_desc) {
+      PBE_LOG_ERROR("%s: no field %s\n", dotted.c_str(), name.c_str());
+      return false;
+    }
+    out->push_back(field_desc);
+    if (end == std::string::npos) {
+      return true;
+    }
+    desc = field_desc->message_type();
+    begin = end + 1;
+  }
+}
@@ -0,0 +1,52 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FIELD_PATH_H_
+#define FIELD_PATH_H_
+
+#include <string>
+#include <vector>
+
+#include "protobuf_include.h"
+
+// One step from a message into one of its message fields.
+// |index| is the element index for repeated fields and -1 for singular ones.
+struct PathStep {
+  int field_number;
+  int index;
+};
+
+typedef std::vector<PathStep> FieldPath;
+
+// Walks |path| from |root|. Returns nullptr if a step does not exist (anymore).
+::google::protobuf::Message* resolve_path(::google::protobuf::Message* root, const FieldPath& path);
+
+bool same_path(const FieldPath& a, const FieldPath& b);
+
+// Human readable form of |path|, e.g. "people[3].phones[0]".
+std::string path_to_string(const ::google::protobuf::Descriptor* root_desc, const FieldPath& path);
+
+// The fields named by a dotted path like "people.phones.number", starting at |root_desc|. All but the last
+// must be message fields. Logs and returns false if a name doesn't exist.
+bool parse_field_names(const ::google::protobuf::Descriptor* root_desc, const std::string& dotted,
+                       std::vector<const ::google::protobuf::FieldDescriptor*>* out);
+
+#endif  // FIELD_PATH_H_
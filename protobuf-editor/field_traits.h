@@ -0,0 +1,123 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FIELD_TRAITS_H_
+#define FIELD_TRAITS_H_
+
+#include <stdint.h>
+
+#include "protobuf_include.h"
+
+// What the editor needs to know about each field type, indexed by FieldDescriptor::Type.
+struct FieldTypeInfo {
+  const char* name;  // as written in a .proto file
+  ::google::protobuf::FieldDescriptor::CppType cpp_type;
+  bool scalar;
+};
+
+constexpr FieldTypeInfo kFieldTypes[] = {
+    {"", ::google::protobuf::FieldDescriptor::CPPTYPE_INT32, false},  // no type 0
+    {"double", ::google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE, true},
+    {"float", ::google::protobuf::FieldDescriptor::CPPTYPE_FLOAT, true},
+    {"int64", ::google::protobuf::FieldDescriptor::CPPTYPE_INT64, true},
+    {"uint64", ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64, true},
+    {"int32", ::google::protobuf::FieldDescriptor::CPPTYPE_INT32, true},
+    {"fixed64", ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64, true},
+    {"fixed32", ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32, true},
+    {"bool", ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL, true},
+    {"string", ::google::protobuf::FieldDescriptor::CPPTYPE_STRING, true},
+    {"group", ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE, false},
+    {"message", ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE, false},
+    {"bytes", ::google::protobuf::FieldDescriptor::CPPTYPE_STRING, true},
+    {"uint32", ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32, true},
+    {"enum", ::google::protobuf::FieldDescriptor::CPPTYPE_ENUM, true},
+    {"sfixed32", ::google::protobuf::FieldDescriptor::CPPTYPE_INT32, true},
+    {"sfixed64", ::google::protobuf::FieldDescriptor::CPPTYPE_INT64, true},
+    {"sint32", ::google::protobuf::FieldDescriptor::CPPTYPE_INT32, true},
+    {"sint64", ::google::protobuf::FieldDescriptor::CPPTYPE_INT64, true},
+};
+
+static_assert(sizeof(kFieldTypes) / sizeof(kFieldTypes[0]) == ::google::protobuf::FieldDescriptor::MAX_TYPE + 1,
+              "kFieldTypes must cover every FieldDescriptor::Type");
+
+inline const FieldTypeInfo& field_type_info(const ::google::protobuf::FieldDescriptor* field_desc) {
+  return kFieldTypes[field_desc->type()];
+}
+
+// The reflection accessors of the C++ type a numeric or bool field is held in. One specialization per
+// CppType covers all the wire types that share it (int32, sint32 and sfixed32 are all int32_t).
+template <typename T>
+struct FieldTraits;
+
+#define PBE_FIELD_TRAITS(TYPE, ACCESSOR, CPPTYPE)                                                                   \
+  template <>                                                                                                       \
+  struct FieldTraits<TYPE> {                                                                                        \
+    static constexpr ::google::protobuf::FieldDescriptor::CppType kCppType =                                       \
+        ::google::protobuf::FieldDescriptor::CPPTYPE;                                                               \
+    static TYPE Get(const ::google::protobuf::Message& msg, const ::google::protobuf::FieldDescriptor* field_desc) { \
+      return msg.GetReflection()->Get##ACCESSOR(msg, field_desc);                                                   \
+    }                                                                                                               \
+    static TYPE GetRepeated(const ::google::protobuf::Message& msg,                                                 \
+                            const ::google::protobuf::FieldDescriptor* field_desc, int index) {                     \
+      return msg.GetReflection()->GetRepeated##ACCESSOR(msg, field_desc, index);                                    \
+    }                                                                                                               \
+    static void Set(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,        \
+                    TYPE val) {                                                                                     \
+      msg->GetReflection()->Set##ACCESSOR(msg, field_desc, val);                                                    \
+    }                                                                                                               \
+    static void SetRepeated(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc, \
+                            int index, TYPE val) {                                                                  \
+      msg->GetReflection()->SetRepeated##ACCESSOR(msg, field_desc, index, val);                                     \
+    }                                                                                                               \
+    static void Add(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,        \
+                    TYPE val) {                                                                                     \
+      msg->GetReflection()->Add##ACCESSOR(msg, field_desc, val);                                                    \
+    }                                                                                                               \
+  }
+
+PBE_FIELD_TRAITS(int32_t, Int32, CPPTYPE_INT32);
+PBE_FIELD_TRAITS(int64_t, Int64, CPPTYPE_INT64);
+PBE_FIELD_TRAITS(uint32_t, UInt32, CPPTYPE_UINT32);
+PBE_FIELD_TRAITS(uint64_t, UInt64, CPPTYPE_UINT64);
+PBE_FIELD_TRAITS(float, Float, CPPTYPE_FLOAT);
+PBE_FIELD_TRAITS(double, Double, CPPTYPE_DOUBLE);
+PBE_FIELD_TRAITS(bool, Bool, CPPTYPE_BOOL);
+
+#undef PBE_FIELD_TRAITS
+
+// The contiguous storage of a repeated numeric or bool field, for bulk reads and writes. Reflection marks
+// these deprecated in favor of RepeatedFieldRef, which can neither reserve nor hand out the memory.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+template <typename T>
+const ::google::protobuf::RepeatedField<T>& repeated_field(const ::google::protobuf::Message& msg,
+                                                           const ::google::protobuf::FieldDescriptor* field_desc) {
+  return msg.GetReflection()->GetRepeatedField<T>(msg, field_desc);
+}
+
+template <typename T>
+::google::protobuf::RepeatedField<T>* mutable_repeated_field(::google::protobuf::Message* msg,
+                                                             const ::google::protobuf::FieldDescriptor* field_desc) {
+  return msg->GetReflection()->MutableRepeatedField<T>(msg, field_desc);
+}
+#pragma GCC diagnostic pop
+
+#endif  // FIELD_TRAITS_H_
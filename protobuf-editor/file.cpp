@@ -21,10 +21,16 @@
 #include "file.h"
 
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <cstring>
 
 #include "log.h"
 
@@ -32,3 +38,268 @@ bool regular_file_exists(const std::string &name) {
   struct stat buffer;
   return (stat(name.c_str(), &buffer) == 0 && S_ISREG(buffer.st_mode)) && access(name.c_str(), R_OK) != -1;
 }
+
+bool write_file(const std::string &path, const std::vector<WriteBuffer> &buffers) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    PBE_LOG_ERROR("can't write %s\n", path.c_str());
+    return false;
+  }
+  std::vector<struct iovec> pending;
+  for (const auto &buffer : buffers) {
+    if (buffer.size > 0) {
+      pending.push_back({const_cast<void *>(buffer.data), buffer.size});
+    }
+  }
+  size_t first = 0;
+  while (first < pending.size()) {
+    int count = static_cast<int>(std::min<size_t>(pending.size() - first, IOV_MAX));
+    ssize_t written = writev(fd, pending.data() + first, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      PBE_LOG_ERROR("can't write %s\n", path.c_str());
+      close(fd);
+      return false;
+    }
+    // skip what was written, which may end in the middle of a buffer
+    size_t left = static_cast<size_t>(written);
+    while (first < pending.size() && left >= pending[first].iov_len) {
+      left -= pending[first].iov_len;
+      ++first;
+    }
+    if (left > 0) {
+      pending[first].iov_base = static_cast<char *>(pending[first].iov_base) + left;
+      pending[first].iov_len -= left;
+    }
+  }
+  if (close(fd) != 0) {
+    PBE_LOG_ERROR("can't write %s\n", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool MappedFile::Open(const std::string &path, bool sequential) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    PBE_LOG_ERROR("can't open %s\n", path.c_str());
+    return false;
+  }
+  struct stat buffer;
+  if (fstat(fd, &buffer) != 0 || !S_ISREG(buffer.st_mode)) {
+    PBE_LOG_ERROR("%s is not a regular file\n", path.c_str());
+    close(fd);
+    return false;
+  }
+  size_t size = static_cast<size_t>(buffer.st_size);
+  if (size > 0) {
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      PBE_LOG_ERROR("can't map %s\n", path.c_str());
+      close(fd);
+      return false;
+    }
+    if (sequential) {
+      madvise(mapped, size, MADV_SEQUENTIAL);
+    }
+    data_ = static_cast<const uint8_t *>(mapped);
+  }
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  size_ = size;
+  open_ = true;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (nullptr != data_) {
+    munmap(const_cast<uint8_t *>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  open_ = false;
+}
+
+bool BackgroundRead::Start(const std::string &path) {
+  Cancel();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    PBE_LOG_ERROR("can't open %s\n", path.c_str());
+    return false;
+  }
+  struct stat buffer;
+  if (fstat(fd, &buffer) != 0 || !S_ISREG(buffer.st_mode)) {
+    PBE_LOG_ERROR("%s is not a regular file\n", path.c_str());
+    close(fd);
+    return false;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  size_ = static_cast<size_t>(buffer.st_size);
+  running_ = true;
+  thread_ = std::thread(&BackgroundRead::Run, this, fd, size_);
+  return true;
+}
+
+void BackgroundRead::Run(int fd, size_t size) {
+  // large enough for few syscalls, small enough for a smooth progress bar
+  static const size_t kChunk = 8 << 20;
+
+  ok_ = true;
+  try {
+    data_.resize(size);
+  } catch (const std::bad_alloc &) {
+    PBE_LOG_ERROR("no memory for %zu bytes\n", size);
+    ok_ = false;
+  }
+  size_t done = 0;
+  while (ok_ && done < size && !cancel_) {
+    ssize_t got = read(fd, &data_[done], std::min(kChunk, size - done));
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      // an error, or the file shrank since it was measured
+      ok_ = got == 0;
+      data_.resize(done);
+      break;
+    }
+    done += static_cast<size_t>(got);
+    read_ = done;
+  }
+  close(fd);
+  done_ = true;
+}
+
+void BackgroundRead::Cancel() {
+  cancel_ = true;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  std::string().swap(data_);
+  ok_ = false;
+  read_ = 0;
+  done_ = false;
+  cancel_ = false;
+  running_ = false;
+}
+
+float BackgroundRead::progress() const {
+  return 0 == size_ ? 1.0f : static_cast<float>(static_cast<double>(read_) / static_cast<double>(size_));
+}
+
+bool BackgroundRead::Take(std::string *out) {
+  if (!done_) {
+    return false;
+  }
+  thread_.join();
+  bool ok = ok_;
+  if (ok) {
+    *out = std::move(data_);
+  }
+  Cancel();
+  return ok;
+}
+
+static bool dirs_first(const DirEntry &a, const DirEntry &b) {
+  if (a.is_dir != b.is_dir) {
+    return a.is_dir;
+  }
+  return a.name < b.name;
+}
+
+// fstatat() on a directory of 100k files is most of the listing, so it goes through the open directory rather
+// than a full path each time
+static void list_dir(const std::string &dir, std::atomic<size_t> *found, DirListing *out) {
+  DIR *handle = opendir(dir.c_str());
+  if (nullptr == handle) {
+    PBE_LOG_ERROR("can't list %s\n", dir.c_str());
+    return;
+  }
+  int dir_fd = dirfd(handle);
+  while (struct dirent *entry = readdir(handle)) {
+    if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    DirEntry dir_entry = {entry->d_name, entry->d_type == DT_DIR, 0, 0};
+    struct stat buffer;
+    // follows links, so a link to a directory can be entered
+    if (fstatat(dir_fd, entry->d_name, &buffer, 0) == 0) {
+      dir_entry.is_dir = S_ISDIR(buffer.st_mode);
+      dir_entry.size = static_cast<uint64_t>(buffer.st_size);
+      dir_entry.mtime = buffer.st_mtime;
+    }
+    out->entries.push_back(std::move(dir_entry));
+    *found = out->entries.size();
+  }
+  closedir(handle);
+  std::sort(out->entries.begin(), out->entries.end(), dirs_first);
+  out->ok = true;
+}
+
+DirectoryLister::~DirectoryLister() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+std::shared_ptr<const DirListing> DirectoryLister::Get(const std::string &dir, size_t *found) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = listings_.find(dir);
+  if (it != listings_.end()) {
+    it->second.used = ++uses_;
+    return it->second.listing;
+  }
+  if (std::find(queue_.begin(), queue_.end(), dir) == queue_.end()) {
+    queue_.push_back(dir);
+    if (!thread_.joinable()) {
+      thread_ = std::thread(&DirectoryLister::Run, this);
+    }
+    wake_.notify_one();
+  }
+  if (nullptr != found) {
+    // only the front of the queue is being listed
+    *found = queue_.front() == dir ? found_.load() : 0;
+  }
+  return nullptr;
+}
+
+void DirectoryLister::Refresh(const std::string &dir) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  listings_.erase(dir);
+}
+
+void DirectoryLister::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+    if (stop_) {
+      return;
+    }
+    // stays at the front of the queue while it's listed, so Get() doesn't queue it again
+    std::string dir = queue_.front();
+    found_ = 0;
+    lock.unlock();
+    auto listing = std::make_shared<DirListing>();
+    list_dir(dir, &found_, listing.get());
+    lock.lock();
+    queue_.pop_front();
+    if (listings_.size() >= kMaxListings) {
+      auto oldest = listings_.begin();
+      for (auto it = listings_.begin(); it != listings_.end(); ++it) {
+        if (it->second.used < oldest->second.used) {
+          oldest = it;
+        }
+      }
+      listings_.erase(oldest);
+    }
+    listings_[dir] = {std::move(listing), ++uses_};
+  }
+}
@@ -1,10 +1,137 @@
 #ifndef FILE_H_
 #define FILE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 bool regular_file_exists(const std::string &name);
 
+// A piece of a file being written.
+struct WriteBuffer {
+  const void *data;
+  size_t size;
+};
+
+// Replaces |path| with the buffers one after another. They go to the kernel with a single writev() unless it
+// takes less than everything, then with more until all is written.
+bool write_file(const std::string &path, const std::vector<WriteBuffer> &buffers);
+
+// Read-only mapping of a whole file, unmapped on destruction.
+class MappedFile {
+ public:
+  MappedFile() {}
+  ~MappedFile() { Close(); }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // |sequential| tells the kernel to read ahead, for a single pass over the file
+  bool Open(const std::string &path, bool sequential = false);
+  void Close();
+
+  bool is_open() const { return open_; }
+  // nullptr for an empty file
+  const uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+  bool open_ = false;
+};
+
+// Reads a whole file on a background thread, into a buffer sized once from the file size, so that a large
+// payload neither blocks a frame nor gets copied on its way into a message.
+class BackgroundRead {
+ public:
+  BackgroundRead() {}
+  ~BackgroundRead() { Cancel(); }
+  BackgroundRead(const BackgroundRead &) = delete;
+  BackgroundRead &operator=(const BackgroundRead &) = delete;
+
+  // Replaces a read in progress. Returns false if |path| can't be opened.
+  bool Start(const std::string &path);
+  // Stops the read in progress, if any, and drops what was read.
+  void Cancel();
+
+  // from Start() until Take() or Cancel()
+  bool running() const { return running_; }
+  bool done() const { return done_; }
+  // fraction of the file read so far
+  float progress() const;
+  // Once done(), ends the read and hands over the contents. Returns false if the read failed.
+  bool Take(std::string *out);
+
+ private:
+  void Run(int fd, size_t size);
+
+  std::thread thread_;
+  std::string data_;  // owned by the thread until done_
+  bool ok_ = false;
+  size_t size_ = 0;
+  std::atomic<size_t> read_{0};
+  std::atomic<bool> done_{false};
+  std::atomic<bool> cancel_{false};
+  bool running_ = false;
+};
+
+struct DirEntry {
+  std::string name;
+  bool is_dir;
+  uint64_t size;
+  int64_t mtime;  // seconds since the epoch
+};
+
+struct DirListing {
+  bool ok = false;
+  // directories first, each group sorted by name; "." and ".." left out
+  std::vector<DirEntry> entries;
+};
+
+// Lists directories, and stats what is in them, on a background thread. Listings are kept until Refresh(), so
+// returning to a directory of many files costs nothing.
+class DirectoryLister {
+ public:
+  DirectoryLister() {}
+  ~DirectoryLister();
+  DirectoryLister(const DirectoryLister &) = delete;
+  DirectoryLister &operator=(const DirectoryLister &) = delete;
+
+  // The listing of |dir|, or nullptr while it is being made, and then it's queued if it wasn't. |found| is set to
+  // how many entries the listing in progress has so far.
+  std::shared_ptr<const DirListing> Get(const std::string &dir, size_t *found = nullptr);
+  // Drops the listing of |dir|, so the next Get() lists it again.
+  void Refresh(const std::string &dir);
+
+ private:
+  // listings kept, the least recently asked for goes first
+  static const size_t kMaxListings = 32;
+
+  struct Kept {
+    std::shared_ptr<const DirListing> listing;
+    uint64_t used;
+  };
+
+  void Run();
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<std::string> queue_;
+  std::map<std::string, Kept> listings_;
+  uint64_t uses_ = 0;
+  std::atomic<size_t> found_{0};
+  bool stop_ = false;
+  std::thread thread_;
+};
+
 #endif  // FILE_H_`
@@ -0,0 +1,224 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "file_browser.h"
+
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "imgui_includes.h"
+#include "string.h"
+
+static std::string join_path(const std::string& dir, const std::string& name) {
+  return dir == "/" ? dir + name : dir + "/" + name;
+}
+
+static std::string parent_dir(const std::string& dir) {
+  size_t slash = dir.rfind('/');
+  return slash == 0 || slash == std::string::npos ? "/" : dir.substr(0, slash);
+}
+
+static std::string absolute_dir(const std::string& dir) {
+  std::string abs = dir;
+  if (abs.empty() || abs[0] != '/') {
+    char cwd[PATH_MAX];
+    std::string base = nullptr != getcwd(cwd, sizeof(cwd)) ? cwd : "/";
+    abs = abs.empty() ? base : join_path(base, abs);
+  }
+  while (abs.size() > 1 && abs.back() == '/') {
+    abs.pop_back();
+  }
+  return abs;
+}
+
+static std::string format_mtime(int64_t mtime) {
+  time_t time = mtime;
+  struct tm local;
+  char buf[32];
+  if (nullptr == localtime_r(&time, &local) || 0 == strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M", &local)) {
+    return "";
+  }
+  return buf;
+}
+
+void FileBrowser::Open(const std::string& owner, const std::string& title, const std::string& path, bool save) {
+  owner_ = owner;
+  title_ = title;
+  save_ = save;
+  chosen_ = false;
+  filter_.clear();
+  size_t slash = path.rfind('/');
+  if (slash == std::string::npos) {
+    Enter("");
+    name_ = path;
+  } else {
+    Enter(slash == 0 ? "/" : path.substr(0, slash));
+    name_ = path.substr(slash + 1);
+  }
+  open_ = true;
+}
+
+void FileBrowser::Enter(const std::string& dir) {
+  dir_ = absolute_dir(dir);
+  dir_text_ = dir_;
+  filter_.clear();
+}
+
+void FileBrowser::Choose() {
+  if (name_.empty()) {
+    return;
+  }
+  std::string path = name_[0] == '/' ? name_ : join_path(dir_, name_);
+  if (!save_ && !regular_file_exists(path)) {
+    // a typed directory name goes into it
+    Enter(path);
+    name_.clear();
+    return;
+  }
+  if (save_) {
+    // gets a new file, or a newer one
+    lister_.Refresh(parent_dir(path));
+  }
+  chosen_path_ = path;
+  chosen_ = true;
+  open_ = false;
+}
+
+bool FileBrowser::Take(const std::string& owner, std::string* path) {
+  if (!chosen_ || owner != owner_) {
+    return false;
+  }
+  *path = std::move(chosen_path_);
+  chosen_ = false;
+  return true;
+}
+
+void FileBrowser::Filter(const std::shared_ptr<const DirListing>& listing) {
+  rows_.clear();
+  for (size_t i = 0; i < listing->entries.size(); ++i) {
+    if (filter_.empty() || listing->entries[i].name.find(filter_) != std::string::npos) {
+      rows_.push_back(i);
+    }
+  }
+  rows_listing_ = listing;
+  rows_filter_ = filter_;
+}
+
+void FileBrowser::Draw() {
+  if (!open_) {
+    return;
+  }
+  ImGui::SetNextWindowSize(ImVec2(720.0f, 480.0f), ImGuiCond_FirstUseEver);
+  // the same window whatever the title
+  if (!ImGui::Begin((title_ + "###file browser").c_str(), &open_)) {
+    ImGui::End();
+    return;
+  }
+
+  // applied after the listing is drawn, which refers to the current one
+  std::string enter_dir;
+  if (ImGui::Button("Up")) {
+    enter_dir = parent_dir(dir_);
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("Refresh")) {
+    lister_.Refresh(dir_);
+  }
+  ImGui::SameLine();
+  if (ImGui::InputText("directory", &dir_text_, ImGuiInputTextFlags_EnterReturnsTrue)) {
+    enter_dir = dir_text_;
+  }
+  ImGui::InputText("filter", &filter_);
+
+  // room for the file name row below the listing
+  ImVec2 listing_size(0.0f, -ImGui::GetFrameHeightWithSpacing());
+  size_t found = 0;
+  auto listing = lister_.Get(dir_, &found);
+  if (nullptr == listing) {
+    ImGui::BeginChild("listing", listing_size);
+    ImGui::Text("listing %s, %s entries so far", dir_.c_str(), human_count(found).c_str());
+    ImGui::EndChild();
+  } else if (!listing->ok) {
+    ImGui::BeginChild("listing", listing_size);
+    ImGui::Text("can't list %s", dir_.c_str());
+    ImGui::EndChild();
+  } else {
+    if (listing != rows_listing_ || filter_ != rows_filter_) {
+      Filter(listing);
+    }
+    int flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable;
+    if (ImGui::BeginTable("listing", 3, flags, listing_size)) {
+      ImGui::TableSetupScrollFreeze(0, 1);
+      ImGui::TableSetupColumn("name", ImGuiTableColumnFlags_WidthStretch);
+      ImGui::TableSetupColumn("size", ImGuiTableColumnFlags_WidthFixed, 80.0f);
+      ImGui::TableSetupColumn("modified", ImGuiTableColumnFlags_WidthFixed, 130.0f);
+      ImGui::TableHeadersRow();
+      ImGuiListClipper clipper;
+      clipper.Begin(static_cast<int>(rows_.size()));
+      while (clipper.Step()) {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+          const DirEntry& entry = listing->entries[rows_[static_cast<size_t>(row)]];
+          ImGui::TableNextRow();
+          ImGui::TableNextColumn();
+          ImGui::PushID(row);
+          std::string label = entry.is_dir ? entry.name + "/" : entry.name;
+          if (ImGui::Selectable(label.c_str(), !entry.is_dir && entry.name == name_,
+                                ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowDoubleClick)) {
+            bool twice = ImGui::IsMouseDoubleClicked(0);
+            if (entry.is_dir) {
+              if (twice) {
+                enter_dir = join_path(dir_, entry.name);
+              }
+            } else {
+              name_ = entry.name;
+              if (twice) {
+                Choose();
+              }
+            }
+          }
+          ImGui::PopID();
+          ImGui::TableNextColumn();
+          if (!entry.is_dir) {
+            ImGui::TextUnformatted(human_bytes(entry.size).c_str());
+          }
+          ImGui::TableNextColumn();
+          ImGui::TextUnformatted(format_mtime(entry.mtime).c_str());
+        }
+      }
+      ImGui::EndTable();
+    }
+  }
+
+  bool choose = ImGui::InputText("file name", &name_, ImGuiInputTextFlags_EnterReturnsTrue);
+  ImGui::SameLine();
+  choose = ImGui::Button(save_ ? "Save" : "Open") || choose;
+  ImGui::SameLine();
+  if (ImGui::Button("Cancel")) {
+    open_ = false;
+  }
+  if (choose) {
+    Choose();
+  }
+  if (!enter_dir.empty()) {
+    Enter(enter_dir);
+  }
+  ImGui::End();
+}
@@ -0,0 +1,71 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FILE_BROWSER_H_
+#define FILE_BROWSER_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file.h"
+
+// File dialog drawn with ImGui in a window of its own. Directories are listed by a DirectoryLister, so one of
+// 100k files neither holds up a frame nor gets listed again each time it's shown. Whoever opens the dialog is its
+// |owner|, and picks the chosen path up with Take() in a later frame.
+class FileBrowser {
+ public:
+  // Starts in the directory of |path|, with its file name filled in. With |save| the file doesn't have to exist.
+  void Open(const std::string& owner, const std::string& title, const std::string& path, bool save);
+  // Once a frame, outside of any other window.
+  void Draw();
+  // True once, after the dialog of |owner| was closed with a path, which goes to |path|.
+  bool Take(const std::string& owner, std::string* path);
+
+ private:
+  void Enter(const std::string& dir);
+  void Choose();
+  // rows_ from the entries of |listing| that pass filter_
+  void Filter(const std::shared_ptr<const DirListing>& listing);
+
+  DirectoryLister lister_;
+  bool open_ = false;
+  std::string owner_;
+  std::string title_;
+  bool save_ = false;
+  // absolute, and without a trailing slash unless it's the root
+  std::string dir_;
+  std::string dir_text_;
+  std::string name_;
+  std::string filter_;
+
+  // indexes into the entries of rows_listing_, of those shown
+  std::shared_ptr<const DirListing> rows_listing_;
+  std::string rows_filter_;
+  std::vector<size_t> rows_;
+
+  bool chosen_ = false;
+  std::string chosen_path_;
+};
+
+#endif  // FILE_BROWSER_H_
@@ -0,0 +1,177 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "hex_view.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "codec.h"
+#include "imgui_includes.h"
+#include "number.h"
+#include "string.h"
+
+static const size_t kBytesPerRow = 16;
+
+// rows shown at once
+static const float kVisibleRows = 16.0f;
+
+// "0000001f  de ad be ef 00 ...  |....|" for the row of up to 16 bytes at |offset|
+static std::string format_row(const uint8_t* data, size_t size, uint64_t offset, int offset_digits) {
+  char hex[2 * kBytesPerRow];
+  size_t count = std::min<size_t>(kBytesPerRow, size - offset);
+  hex_encode(data + offset, count, hex);
+
+  char line[128];
+  int written = snprintf(line, sizeof(line), "%0*llx  ", offset_digits, static_cast<unsigned long long>(offset));
+  char* out = line + written;
+  for (size_t i = 0; i < kBytesPerRow; ++i) {
+    if (i < count) {
+      *out++ = hex[2 * i];
+      *out++ = hex[2 * i + 1];
+    } else {
+      *out++ = ' ';
+      *out++ = ' ';
+    }
+    *out++ = ' ';
+    if (i == kBytesPerRow / 2 - 1) {
+      *out++ = ' ';
+    }
+  }
+  *out++ = ' ';
+  *out++ = '|';
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t byte = data[offset + i];
+    *out++ = byte >= 0x20 && byte < 0x7f ? static_cast<char>(byte) : '.';
+  }
+  *out++ = '|';
+  return std::string(line, out);
+}
+
+// decimal, or hex with a 0x prefix
+static bool parse_offset(const std::string& text, uint64_t* out) {
+  if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+    char* end;
+    errno = 0;
+    *out = strtoull(text.c_str() + 2, &end, 16);
+    return errno == 0 && *end == '\0';
+  }
+  return parse_number(text, out);
+}
+
+void HexView::ScrollTo(uint64_t offset, size_t length) {
+  mark_ = offset;
+  mark_size_ = length;
+  scroll_pending_ = true;
+}
+
+void HexView::Find(const uint8_t* data, size_t size) {
+  std::string needle;
+  if (search_hex_) {
+    if (!hex_decode(search_text_.data(), search_text_.data() + search_text_.size(), &needle)) {
+      note_ = "not hex bytes";
+      return;
+    }
+  } else {
+    needle = search_text_;
+  }
+  if (needle.empty() || needle.size() > size) {
+    note_ = "not found";
+    return;
+  }
+  // continue after the current match, then wrap around
+  size_t start = mark_size_ > 0 ? std::min<size_t>(mark_ + 1, size) : 0;
+  const void* found = memmem(data + start, size - start, needle.data(), needle.size());
+  if (nullptr == found && start > 0) {
+    found = memmem(data, std::min(size, start + needle.size() - 1), needle.data(), needle.size());
+  }
+  if (nullptr == found) {
+    note_ = "not found";
+    return;
+  }
+  uint64_t offset = static_cast<uint64_t>(static_cast<const uint8_t*>(found) - data);
+  char buf[48];
+  snprintf(buf, sizeof(buf), "at 0x%llx", static_cast<unsigned long long>(offset));
+  note_ = buf;
+  ScrollTo(offset, needle.size());
+}
+
+void HexView::Draw(const char* id, const uint8_t* data, size_t size) {
+  ImGui::PushID(id);
+  ImGui::Text("%s", human_bytes(size).c_str());
+
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(120.0f);
+  if (ImGui::InputText("go to", &goto_text_, ImGuiInputTextFlags_EnterReturnsTrue)) {
+    uint64_t offset;
+    if (!parse_offset(goto_text_, &offset) || offset >= size) {
+      note_ = "no such offset";
+    } else {
+      note_.clear();
+      ScrollTo(offset, 1);
+    }
+  }
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(200.0f);
+  bool find = ImGui::InputText("find", &search_text_, ImGuiInputTextFlags_EnterReturnsTrue);
+  ImGui::SameLine();
+  find = ImGui::Button("next") || find;
+  ImGui::SameLine();
+  ImGui::Checkbox("hex bytes", &search_hex_);
+  if (find) {
+    Find(data, size);
+  }
+  if (!note_.empty()) {
+    ImGui::SameLine();
+    ImGui::Text("%s", note_.c_str());
+  }
+
+  int offset_digits = 8;
+  while (offset_digits < 16 && (size >> (4 * offset_digits)) != 0) {
+    ++offset_digits;
+  }
+  size_t rows = (size + kBytesPerRow - 1) / kBytesPerRow;
+  float row_height = ImGui::GetTextLineHeightWithSpacing();
+  ImGui::BeginChild("rows", ImVec2(0.0f, row_height * std::min(kVisibleRows, static_cast<float>(rows) + 1.0f)), true);
+  if (scroll_pending_) {
+    ImGui::SetScrollY(static_cast<float>(mark_ / kBytesPerRow) * row_height);
+    scroll_pending_ = false;
+  }
+  ImGuiListClipper clipper;
+  clipper.Begin(static_cast<int>(std::min<size_t>(rows, INT_MAX)), row_height);
+  while (clipper.Step()) {
+    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+      uint64_t offset = static_cast<uint64_t>(row) * kBytesPerRow;
+      std::string line = format_row(data, size, offset, offset_digits);
+      bool marked = mark_size_ > 0 && offset < mark_ + mark_size_ && mark_ < offset + kBytesPerRow;
+      if (marked) {
+        ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.3f, 1.0f), "%s", line.c_str());
+      } else {
+        ImGui::TextUnformatted(line.c_str());
+      }
+    }
+  }
+  ImGui::EndChild();
+  ImGui::PopID();
+}
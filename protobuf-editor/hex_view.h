@@ -0,0 +1,53 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef HEX_VIEW_H_
+#define HEX_VIEW_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// Hex and ASCII dump of a buffer of any size, 16 bytes per row. Only the rows in view are formatted, so the
+// cost of a frame doesn't depend on the size. Keeps the go-to and search state of one buffer between frames.
+class HexView {
+ public:
+  void Draw(const char* id, const uint8_t* data, size_t size);
+  void Draw(const char* id, const std::string& data) {
+    Draw(id, reinterpret_cast<const uint8_t*>(data.data()), data.size());
+  }
+
+ private:
+  void Find(const uint8_t* data, size_t size);
+  void ScrollTo(uint64_t offset, size_t length);
+
+  std::string goto_text_;
+  std::string search_text_;
+  bool search_hex_ = false;
+  std::string note_;
+  // highlighted range, from the last go-to or search
+  uint64_t mark_ = 0;
+  size_t mark_size_ = 0;
+  bool scroll_pending_ = false;
+};
+
+#endif  // HEX_VIEW_H_
@@ -0,0 +1,217 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lazy.h"
+
+#include <limits.h>
+
+#include <atomic>
+
+#include "log.h"
+#include "parallel.h"
+#include "proto.h"
+#include "wire.h"
+
+typedef ::google::protobuf::internal::WireFormatLite WireFormatLite;
+
+static bool merge_range(const uint8_t* data, uint64_t begin, uint64_t end, ::google::protobuf::Message* msg) {
+  if (end - begin > INT_MAX) {
+    return false;
+  }
+  ::google::protobuf::io::CodedInputStream input(data + begin, static_cast<int>(end - begin));
+  input.SetRecursionLimit(kMaxParseDepth);
+  return msg->MergePartialFromCodedStream(&input) && input.ConsumedEntireMessage();
+}
+
+::google::protobuf::Message* LazyElements::Get(size_t index) {
+  auto edited = edited_.find(index);
+  if (edited != edited_.end()) {
+    return edited->second.get();
+  }
+  auto found = cache_.find(index);
+  if (found != cache_.end()) {
+    found->second.used = ++uses_;
+    return found->second.msg.get();
+  }
+  std::unique_ptr<::google::protobuf::Message> msg(prototype_->New());
+  if (!merge_range(data_, ranges_[index].begin, ranges_[index].end, msg.get())) {
+    return nullptr;
+  }
+  if (cache_.size() >= kMaxCached) {
+    auto oldest = cache_.begin();
+    for (auto it = cache_.begin(); it != cache_.end(); ++it) {
+      if (it->second.used < oldest->second.used) {
+        oldest = it;
+      }
+    }
+    cache_.erase(oldest);
+  }
+  auto* element = msg.get();
+  cache_[index] = {std::move(msg), ++uses_};
+  return element;
+}
+
+void LazyElements::MarkEdited(size_t index) {
+  auto found = cache_.find(index);
+  if (found == cache_.end()) {
+    return;
+  }
+  edited_[index] = std::move(found->second.msg);
+  cache_.erase(found);
+}
+
+bool LazyElements::Materialize(::google::protobuf::Message* record, bool* initialized) const {
+  // the elements are parsed on the worker threads, each into its own heap object, and only handed over to
+  // |record| once they all parsed, on this thread
+  std::vector<::google::protobuf::Message*> elements(ranges_.size(), nullptr);
+  std::atomic<bool> failed(false);
+  std::atomic<bool> missing(false);
+  parallel_for(
+      ranges_.size(),
+      [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end && !failed; ++i) {
+          std::unique_ptr<::google::protobuf::Message> element(prototype_->New());
+          auto edited = edited_.find(i);
+          if (edited != edited_.end()) {
+            element->CopyFrom(*edited->second);
+          } else if (!merge_range(data_, ranges_[i].begin, ranges_[i].end, element.get())) {
+            failed = true;
+            break;
+          }
+          if (nullptr != initialized && !element->IsInitialized()) {
+            missing = true;
+          }
+          elements[i] = element.release();
+        }
+      },
+      kMinParallelElements);
+  if (failed) {
+    for (auto* element : elements) {
+      delete element;
+    }
+    return false;
+  }
+  const auto* reflection = record->GetReflection();
+  for (auto* element : elements) {
+    reflection->AddAllocatedMessage(record, field_desc_, element);
+  }
+  if (nullptr != initialized) {
+    *initialized = !missing;
+  }
+  return true;
+}
+
+void LazyElements::AppendWire(std::vector<WriteBuffer>* out, std::deque<std::string>* encoded) const {
+  auto edited = edited_.begin();
+  size_t i = 0;
+  while (i < ranges_.size()) {
+    if (edited != edited_.end() && edited->first == i) {
+      encoded->emplace_back();
+      ::google::protobuf::io::StringOutputStream stream(&encoded->back());
+      ::google::protobuf::io::CodedOutputStream coded(&stream);
+      WireFormatLite::WriteTag(field_desc_->number(), WireFormatLite::WIRETYPE_LENGTH_DELIMITED, &coded);
+      coded.WriteVarint64(edited->second->ByteSizeLong());
+      edited->second->SerializeWithCachedSizes(&coded);
+      coded.Trim();
+      out->push_back({encoded->back().data(), encoded->back().size()});
+      ++edited;
+      ++i;
+      continue;
+    }
+    // the untouched elements up to the next edited one, in as few buffers as they are contiguous in the file
+    size_t stop = edited == edited_.end() ? ranges_.size() : edited->first;
+    uint64_t begin = ranges_[i].field_begin;
+    uint64_t end = ranges_[i].end;
+    for (++i; i < stop; ++i) {
+      if (ranges_[i].field_begin != end) {
+        out->push_back({data_ + begin, end - begin});
+        begin = ranges_[i].field_begin;
+      }
+      end = ranges_[i].end;
+    }
+    out->push_back({data_ + begin, end - begin});
+  }
+}
+
+static bool lazy_load_failed(const std::string& path, const ::google::protobuf::Descriptor* desc, MappedFile* file,
+                             std::map<int, std::unique_ptr<LazyElements>>* lazy) {
+  PBE_LOG_ERROR("can't parse %s as %s\n", path.c_str(), desc->full_name().c_str());
+  lazy->clear();
+  file->Close();
+  return false;
+}
+
+bool read_file_lazy(const std::string& path, protobuf::editor::MyRecord* record, MappedFile* file,
+                    std::map<int, std::unique_ptr<LazyElements>>* lazy) {
+  lazy->clear();
+  record->Clear();
+  if (!file->Open(path)) {
+    return false;
+  }
+  const uint8_t* data = file->data();
+  uint64_t size = file->size();
+  const auto* desc = record->GetDescriptor();
+  auto* factory = record->GetReflection()->GetMessageFactory();
+
+  // first pass: count the elements of each repeated message field
+  std::map<int, size_t> counts;
+  WireField wire;
+  for (uint64_t offset = 0; offset < size; offset = wire.end) {
+    if (!decode_field(data, offset, size, &wire)) {
+      return lazy_load_failed(path, desc, file, lazy);
+    }
+    const auto* field_desc = desc->FindFieldByNumber(static_cast<int>(wire.field_number));
+    if (nullptr != field_desc && field_desc->is_repeated() &&
+        field_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE &&
+        wire.wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      ++counts[field_desc->number()];
+    }
+  }
+  for (const auto& count : counts) {
+    if (count.second >= kMinLazyElements) {
+      const auto* field_desc = desc->FindFieldByNumber(count.first);
+      (*lazy)[count.first].reset(
+          new LazyElements(data, field_desc, factory->GetPrototype(field_desc->message_type())));
+    }
+  }
+
+  // second pass: index the elements of the large fields, and parse the runs of fields between them
+  uint64_t run_begin = 0;
+  for (uint64_t offset = 0; offset < size; offset = wire.end) {
+    decode_field(data, offset, size, &wire);
+    auto found = lazy->find(static_cast<int>(wire.field_number));
+    if (found == lazy->end() || wire.wire_type != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      continue;
+    }
+    if (!merge_range(data, run_begin, offset, record)) {
+      return lazy_load_failed(path, desc, file, lazy);
+    }
+    found->second->Add(wire.offset, wire.payload_begin, wire.payload_end);
+    run_begin = wire.end;
+  }
+  // required fields are checked like read_file() does, except in the elements left unparsed
+  if (!merge_range(data, run_begin, size, record) || !record->IsInitialized()) {
+    return lazy_load_failed(path, desc, file, lazy);
+  }
+  if (lazy->empty()) {
+    file->Close();
+  }
+  return true;
+}
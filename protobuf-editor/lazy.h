@@ -0,0 +1,112 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LAZY_H_
+#define LAZY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file.h"
+#include "protobuf_include.h"
+
+// Top-level repeated message fields with at least this many elements are indexed instead of parsed.
+static const size_t kMinLazyElements = 10000;
+
+// The elements of a large top-level repeated message field, left in the mapped file and parsed one at a time
+// as they are shown. Elements are edited copy-on-write: an edited element is kept parsed, and is the only one
+// encoded again on save.
+class LazyElements {
+ public:
+  // |data| is the file the elements are in, and outlives this
+  LazyElements(const uint8_t* data, const ::google::protobuf::FieldDescriptor* field_desc,
+               const ::google::protobuf::Message* prototype)
+      : data_(data), field_desc_(field_desc), prototype_(prototype) {}
+  LazyElements(const LazyElements&) = delete;
+  LazyElements& operator=(const LazyElements&) = delete;
+
+  // the next element: its field from the tag on is [field_begin, end), and its payload [begin, end)
+  void Add(uint64_t field_begin, uint64_t begin, uint64_t end) {
+    ranges_.push_back({field_begin, begin, end});
+    wire_size_ += end - field_begin;
+  }
+
+  const ::google::protobuf::FieldDescriptor* field_desc() const { return field_desc_; }
+  size_t size() const { return ranges_.size(); }
+  // of all the elements, with their tags and lengths
+  uint64_t wire_size() const { return wire_size_; }
+
+  // Element |index|, parsed on first use and kept while it is among the kMaxCached most recently used, unless
+  // it was edited. nullptr if it doesn't parse. An edit made through it is lost on eviction unless followed by
+  // MarkEdited().
+  ::google::protobuf::Message* Get(size_t index);
+  // Keeps element |index|, which Get() returned last, parsed from now on.
+  void MarkEdited(size_t index);
+  bool edited(size_t index) const { return edited_.count(index) > 0; }
+  size_t edited_count() const { return edited_.size(); }
+
+  // Parses all of the elements into the field of |record|, in chunks on the worker threads. Nothing is added
+  // if one of them doesn't parse. |initialized|, if given, tells whether all their required fields are set.
+  bool Materialize(::google::protobuf::Message* record, bool* initialized = nullptr) const;
+
+  // Appends the encoded elements to |out|: the untouched ones as they are in the file, with neighbours in one
+  // buffer, and the edited ones encoded into |encoded| with a tag and length of their new size.
+  void AppendWire(std::vector<WriteBuffer>* out, std::deque<std::string>* encoded) const;
+
+ private:
+  static const size_t kMaxCached = 1024;
+  // fewest elements a worker thread is given to parse
+  static const size_t kMinParallelElements = 256;
+
+  struct Range {
+    uint64_t field_begin;
+    uint64_t begin;
+    uint64_t end;
+  };
+
+  struct Cached {
+    std::unique_ptr<::google::protobuf::Message> msg;
+    uint64_t used;
+  };
+
+  const uint8_t* data_;
+  const ::google::protobuf::FieldDescriptor* field_desc_;
+  const ::google::protobuf::Message* prototype_;
+  std::vector<Range> ranges_;
+  uint64_t wire_size_ = 0;
+  std::map<size_t, Cached> cache_;
+  uint64_t uses_ = 0;
+  std::map<size_t, std::unique_ptr<::google::protobuf::Message>> edited_;
+};
+
+// Like read_file(), but with a cheap first pass over the top-level fields that leaves those holding at least
+// kMinLazyElements messages in |file|, mapped from |path|, and adds them to |lazy| by field number instead of
+// parsing them into |record|.
+bool read_file_lazy(const std::string& path, protobuf::editor::MyRecord* record, MappedFile* file,
+                    std::map<int, std::unique_ptr<LazyElements>>* lazy);
+
+#endif  // LAZY_H_
@@ -1,7 +1,12 @@
+#include "cli.h"
 #include "protobuf_editor.h"
 
-int main() {
-  ProtobufEditor editor = ProtobufEditor();
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    return run_cli(argc, argv);
+  }
+
+  ProtobufEditor editor;
 
   editor.Init();
   editor.MainLoop();
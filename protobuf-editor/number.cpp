@@ -0,0 +1,582 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "number.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+template <typename T>
+static bool parse_unsigned(const char* p, const char* end, T* out) {
+  if (p == end) {
+    return false;
+  }
+  T val = 0;
+  for (; p != end; ++p) {
+    unsigned digit = static_cast<unsigned>(*p - '0');
+    if (digit > 9 || val > (std::numeric_limits<T>::max() - digit) / 10) {
+      return false;
+    }
+    val = val * 10 + digit;
+  }
+  *out = val;
+  return true;
+}
+
+template <typename T>
+static bool parse_signed(const char* p, const char* end, T* out) {
+  typedef typename std::make_unsigned<T>::type Unsigned;
+  bool negative = p != end && *p == '-';
+  if (p != end && (*p == '-' || *p == '+')) {
+    ++p;
+  }
+  Unsigned magnitude;
+  if (!parse_unsigned(p, end, &magnitude)) {
+    return false;
+  }
+  Unsigned max = static_cast<Unsigned>(std::numeric_limits<T>::max());
+  if (magnitude > max + (negative ? 1u : 0u)) {
+    return false;
+  }
+  // -(max + 1) is not representable before the subtraction
+  *out = negative && magnitude != 0 ? static_cast<T>(-static_cast<T>(magnitude - 1) - 1) : static_cast<T>(magnitude);
+  return true;
+}
+
+bool parse_number(const char* begin, const char* end, int32_t* out) { return parse_signed(begin, end, out); }
+
+bool parse_number(const char* begin, const char* end, int64_t* out) { return parse_signed(begin, end, out); }
+
+bool parse_number(const char* begin, const char* end, uint32_t* out) { return parse_unsigned(begin, end, out); }
+
+bool parse_number(const char* begin, const char* end, uint64_t* out) { return parse_unsigned(begin, end, out); }
+
+// strtod / strtof need a terminating NUL, so the text is copied to the stack unless it is very long
+template <typename T>
+static bool parse_float_slow(const char* begin, const char* end, T (*convert)(const char*, char**), T* out) {
+  char buf[128];
+  size_t size = static_cast<size_t>(end - begin);
+  std::string long_text;
+  const char* text = buf;
+  if (size < sizeof(buf)) {
+    memcpy(buf, begin, size);
+    buf[size] = '\0';
+  } else {
+    long_text.assign(begin, end);
+    text = long_text.c_str();
+  }
+  errno = 0;
+  char* parsed_end;
+  T val = convert(text, &parsed_end);
+  // ERANGE also comes with subnormal and underflowed results, which are what the text reads as; only an
+  // overflow to +-HUGE_VAL is refused
+  if ((errno != 0 && (errno != ERANGE || std::isinf(val))) || parsed_end != text + size) {
+    return false;
+  }
+  *out = val;
+  return true;
+}
+
+// Clinger's fast path: a mantissa and a power of ten that are both exact in a double give a correctly
+// rounded double with one multiplication or division.
+template <typename T>
+struct FastPath;
+template <>
+struct FastPath<double> {
+  static constexpr uint64_t kMaxMantissa = uint64_t(1) << 53;
+  static constexpr int kMaxExponent = 22;
+  static double Power(int exponent) {
+    static const double kPowers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    return kPowers[exponent];
+  }
+  static bool Narrow(double val, double* out) {
+    *out = val;
+    return true;
+  }
+};
+template <>
+struct FastPath<float> {
+  // Rounding the double again to a float is only wrong when the double landed exactly halfway between two
+  // floats, or below the normal floats where the halfway bits are elsewhere.
+  static bool Narrow(double val, float* out) {
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    const uint64_t kDroppedBits = (uint64_t(1) << 29) - 1;
+    if ((bits & kDroppedBits) == (uint64_t(1) << 28) || val > std::numeric_limits<float>::max() ||
+        (bits != 0 && val < static_cast<double>(std::numeric_limits<float>::min()))) {
+      return false;
+    }
+    *out = static_cast<float>(val);
+    return true;
+  }
+};
+
+template <typename T>
+static bool parse_float(const char* begin, const char* end, T (*convert)(const char*, char**), T* out) {
+  const char* p = begin;
+  if (p == end || *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == '\f' || *p == '\v') {
+    return false;
+  }
+  bool negative = *p == '-';
+  if (*p == '-' || *p == '+') {
+    ++p;
+  }
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  int digits = 0;
+  bool any_digit = false;
+  for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+    any_digit = true;
+    if (digits < 19) {
+      mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+      digits += mantissa != 0 ? 1 : 0;
+    } else {
+      ++exponent;
+      digits = 20;  // digits were dropped, not exact anymore
+    }
+  }
+  if (p != end && *p == '.') {
+    for (++p; p != end && *p >= '0' && *p <= '9'; ++p) {
+      any_digit = true;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+        digits += mantissa != 0 ? 1 : 0;
+        --exponent;
+      } else if (*p != '0') {
+        digits = 20;
+      }
+    }
+  }
+  if (any_digit && p != end && (*p == 'e' || *p == 'E')) {
+    ++p;
+    bool negative_exponent = p != end && *p == '-';
+    if (p != end && (*p == '-' || *p == '+')) {
+      ++p;
+    }
+    int written = 0;
+    bool exponent_digit = false;
+    for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+      exponent_digit = true;
+      if (written < 100000) {
+        written = written * 10 + (*p - '0');
+      }
+    }
+    if (!exponent_digit) {
+      return false;
+    }
+    exponent += negative_exponent ? -written : written;
+  }
+
+  if (!any_digit) {
+    // "inf" and "nan" are left to the C library
+    bool word = p != end && (*p == 'i' || *p == 'I' || *p == 'n' || *p == 'N');
+    return word && parse_float_slow(begin, end, convert, out);
+  }
+  if (p != end) {
+    // so are hex floats
+    bool hex = mantissa == 0 && digits == 0 && (*p == 'x' || *p == 'X') && p - begin <= 2;
+    return hex && parse_float_slow(begin, end, convert, out);
+  }
+  if (digits > 19 || mantissa > FastPath<double>::kMaxMantissa || exponent > FastPath<double>::kMaxExponent ||
+      exponent < -FastPath<double>::kMaxExponent) {
+    return parse_float_slow(begin, end, convert, out);
+  }
+  // one correctly rounded operation on exact operands
+  double val = static_cast<double>(mantissa);
+  val = exponent >= 0 ? val * FastPath<double>::Power(exponent) : val / FastPath<double>::Power(-exponent);
+  if (!FastPath<T>::Narrow(val, out)) {
+    return parse_float_slow(begin, end, convert, out);
+  }
+  if (negative) {
+    *out = -*out;
+  }
+  return true;
+}
+
+static float strtof_adapter(const char* text, char** end) { return strtof(text, end); }
+
+static double strtod_adapter(const char* text, char** end) { return strtod(text, end); }
+
+bool parse_number(const char* begin, const char* end, float* out) {
+  return parse_float(begin, end, strtof_adapter, out);
+}
+
+bool parse_number(const char* begin, const char* end, double* out) {
+  return parse_float(begin, end, strtod_adapter, out);
+}
+
+bool parse_number(const char* begin, const char* end, bool* out) {
+  size_t size = static_cast<size_t>(end - begin);
+  if ((size == 4 && memcmp(begin, "true", 4) == 0) || (size == 1 && *begin == '1')) {
+    *out = true;
+  } else if ((size == 5 && memcmp(begin, "false", 5) == 0) || (size == 1 && *begin == '0')) {
+    *out = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+template <typename T>
+static char* format_unsigned(T val, char* out) {
+  char digits[20];
+  char* p = digits + sizeof(digits);
+  do {
+    *--p = static_cast<char>('0' + val % 10);
+    val /= 10;
+  } while (val != 0);
+  size_t size = static_cast<size_t>(digits + sizeof(digits) - p);
+  memcpy(out, p, size);
+  return out + size;
+}
+
+template <typename T>
+static char* format_signed(T val, char* out) {
+  using Unsigned = typename std::make_unsigned<T>::type;
+  Unsigned magnitude = static_cast<Unsigned>(val);
+  if (val < 0) {
+    *out++ = '-';
+    magnitude = static_cast<Unsigned>(0 - magnitude);
+  }
+  return format_unsigned(magnitude, out);
+}
+
+// Shortest round-trip formatting with Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and
+// Accurately with Integers"). The digits always read back to the same value, and are the shortest such
+// digits for all but a tiny fraction of inputs, where one more digit is printed.
+// f * 2^e
+struct DiyFp {
+  uint64_t f;
+  int e;
+};
+
+static DiyFp diy_sub(DiyFp x, DiyFp y) { return {x.f - y.f, x.e}; }
+
+// upper 64 bits of the 128 bit product, rounded
+static DiyFp diy_mul(DiyFp x, DiyFp y) {
+  const uint64_t kLow = 0xFFFFFFFF;
+  uint64_t x_lo = x.f & kLow;
+  uint64_t x_hi = x.f >> 32;
+  uint64_t y_lo = y.f & kLow;
+  uint64_t y_hi = y.f >> 32;
+  uint64_t p0 = x_lo * y_lo;
+  uint64_t p1 = x_lo * y_hi;
+  uint64_t p2 = x_hi * y_lo;
+  uint64_t p3 = x_hi * y_hi;
+  uint64_t mid = (p0 >> 32) + (p1 & kLow) + (p2 & kLow) + (uint64_t(1) << 31);
+  return {p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32), x.e + y.e + 64};
+}
+
+static DiyFp diy_normalize(DiyFp x) {
+  while ((x.f >> 63) == 0) {
+    x.f <<= 1;
+    --x.e;
+  }
+  return x;
+}
+
+// the value and the midpoints to its neighbours, normalized to a common exponent
+struct Boundaries {
+  DiyFp w;
+  DiyFp minus;
+  DiyFp plus;
+};
+
+template <typename T, typename Bits>
+static Boundaries compute_boundaries(T val) {
+  const int kPrecision = std::numeric_limits<T>::digits;  // including the hidden bit
+  const int kBias = std::numeric_limits<T>::max_exponent - 1 + (kPrecision - 1);
+  const Bits kHiddenBit = Bits(1) << (kPrecision - 1);
+  Bits bits;
+  memcpy(&bits, &val, sizeof(bits));
+  Bits fraction = bits & (kHiddenBit - 1);
+  int biased_exponent = static_cast<int>(bits >> (kPrecision - 1));
+  DiyFp v = biased_exponent == 0 ? DiyFp{fraction, 1 - kBias} : DiyFp{fraction + kHiddenBit, biased_exponent - kBias};
+  // at a power of two the gap to the lower neighbour is half the upper one
+  bool lower_is_closer = fraction == 0 && biased_exponent > 1;
+  DiyFp plus = diy_normalize({2 * v.f + 1, v.e - 1});
+  DiyFp minus = lower_is_closer ? DiyFp{4 * v.f - 1, v.e - 2} : DiyFp{2 * v.f - 1, v.e - 1};
+  minus = {minus.f << (minus.e - plus.e), plus.e};
+  return {diy_normalize(v), minus, plus};
+}
+
+// normalized 10^k for every 8th k, so that some power brings any exponent into [kAlpha, kGamma]
+struct CachedPower {
+  uint64_t f;
+  int e;
+  int k;
+};
+
+static const int kAlpha = -60;
+static const int kGamma = -32;
+
+static CachedPower cached_power_for(int e) {
+  static const CachedPower kPowers[] = {
+    {0xAB70FE17C79AC6CA, -1060, -300},
+    {0xFF77B1FCBEBCDC4F, -1034, -292},
+    {0xBE5691EF416BD60C, -1007, -284},
+    {0x8DD01FAD907FFC3C, -980, -276},
+    {0xD3515C2831559A83, -954, -268},
+    {0x9D71AC8FADA6C9B5, -927, -260},
+    {0xEA9C227723EE8BCB, -901, -252},
+    {0xAECC49914078536D, -874, -244},
+    {0x823C12795DB6CE57, -847, -236},
+    {0xC21094364DFB5637, -821, -228},
+    {0x9096EA6F3848984F, -794, -220},
+    {0xD77485CB25823AC7, -768, -212},
+    {0xA086CFCD97BF97F4, -741, -204},
+    {0xEF340A98172AACE5, -715, -196},
+    {0xB23867FB2A35B28E, -688, -188},
+    {0x84C8D4DFD2C63F3B, -661, -180},
+    {0xC5DD44271AD3CDBA, -635, -172},
+    {0x936B9FCEBB25C996, -608, -164},
+    {0xDBAC6C247D62A584, -582, -156},
+    {0xA3AB66580D5FDAF6, -555, -148},
+    {0xF3E2F893DEC3F126, -529, -140},
+    {0xB5B5ADA8AAFF80B8, -502, -132},
+    {0x87625F056C7C4A8B, -475, -124},
+    {0xC9BCFF6034C13053, -449, -116},
+    {0x964E858C91BA2655, -422, -108},
+    {0xDFF9772470297EBD, -396, -100},
+    {0xA6DFBD9FB8E5B88F, -369, -92},
+    {0xF8A95FCF88747D94, -343, -84},
+    {0xB94470938FA89BCF, -316, -76},
+    {0x8A08F0F8BF0F156B, -289, -68},
+    {0xCDB02555653131B6, -263, -60},
+    {0x993FE2C6D07B7FAC, -236, -52},
+    {0xE45C10C42A2B3B06, -210, -44},
+    {0xAA242499697392D3, -183, -36},
+    {0xFD87B5F28300CA0E, -157, -28},
+    {0xBCE5086492111AEB, -130, -20},
+    {0x8CBCCC096F5088CC, -103, -12},
+    {0xD1B71758E219652C, -77, -4},
+    {0x9C40000000000000, -50, 4},
+    {0xE8D4A51000000000, -24, 12},
+    {0xAD78EBC5AC620000, 3, 20},
+    {0x813F3978F8940984, 30, 28},
+    {0xC097CE7BC90715B3, 56, 36},
+    {0x8F7E32CE7BEA5C70, 83, 44},
+    {0xD5D238A4ABE98068, 109, 52},
+    {0x9F4F2726179A2245, 136, 60},
+    {0xED63A231D4C4FB27, 162, 68},
+    {0xB0DE65388CC8ADA8, 189, 76},
+    {0x83C7088E1AAB65DB, 216, 84},
+    {0xC45D1DF942711D9A, 242, 92},
+    {0x924D692CA61BE758, 269, 100},
+    {0xDA01EE641A708DEA, 295, 108},
+    {0xA26DA3999AEF774A, 322, 116},
+    {0xF209787BB47D6B85, 348, 124},
+    {0xB454E4A179DD1877, 375, 132},
+    {0x865B86925B9BC5C2, 402, 140},
+    {0xC83553C5C8965D3D, 428, 148},
+    {0x952AB45CFA97A0B3, 455, 156},
+    {0xDE469FBD99A05FE3, 481, 164},
+    {0xA59BC234DB398C25, 508, 172},
+    {0xF6C69A72A3989F5C, 534, 180},
+    {0xB7DCBF5354E9BECE, 561, 188},
+    {0x88FCF317F22241E2, 588, 196},
+    {0xCC20CE9BD35C78A5, 614, 204},
+    {0x98165AF37B2153DF, 641, 212},
+    {0xE2A0B5DC971F303A, 667, 220},
+    {0xA8D9D1535CE3B396, 694, 228},
+    {0xFB9B7CD9A4A7443C, 720, 236},
+    {0xBB764C4CA7A44410, 747, 244},
+    {0x8BAB8EEFB6409C1A, 774, 252},
+    {0xD01FEF10A657842C, 800, 260},
+    {0x9B10A4E5E9913129, 827, 268},
+    {0xE7109BFBA19C0C9D, 853, 276},
+    {0xAC2820D9623BF429, 880, 284},
+    {0x80444B5E7AA7CF85, 907, 292},
+    {0xBF21E44003ACDD2D, 933, 300},
+    {0x8E679C2F5E44FF8F, 960, 308},
+    {0xD433179D9C8CB841, 986, 316},
+    {0x9E19DB92B4E31BA9, 1013, 324},
+  };
+  const int kMinDecimalExponent = -300;
+  const int kDecimalStep = 8;
+  // k = ceil((kAlpha - e - 1) * log10(2))
+  int f = kAlpha - e - 1;
+  int k = (f * 78913) / (1 << 18) + (f > 0 ? 1 : 0);
+  int index = (-kMinDecimalExponent + k + (kDecimalStep - 1)) / kDecimalStep;
+  return kPowers[index];
+}
+
+static int largest_power_of_ten(uint32_t n, uint32_t* power) {
+  static const uint32_t kPowers[] = {1,      10,      100,      1000,      10000,
+                                     100000, 1000000, 10000000, 100000000, 1000000000};
+  int digits = 10;
+  while (digits > 1 && n < kPowers[digits - 1]) {
+    --digits;
+  }
+  *power = kPowers[digits - 1];
+  return digits;
+}
+
+// moves the last digit towards w while that stays inside the interval
+static void grisu_round(char* buffer, int length, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t ten_k) {
+  while (rest < dist && delta - rest >= ten_k && (rest + ten_k < dist || dist - rest > rest + ten_k - dist)) {
+    --buffer[length - 1];
+    rest += ten_k;
+  }
+}
+
+// Writes the digits of the shortest number in (minus, plus) that is closest to w. The value is
+// buffer * 10^decimal_exponent.
+static void grisu_digits(DiyFp minus, DiyFp w, DiyFp plus, char* buffer, int* length, int* decimal_exponent) {
+  static_assert(kAlpha >= -60 && kGamma <= -32, "the integral part must fit 32 bits");
+  uint64_t delta = diy_sub(plus, minus).f;
+  uint64_t dist = diy_sub(plus, w).f;
+  const DiyFp one = {uint64_t(1) << -plus.e, plus.e};
+  uint32_t integral = static_cast<uint32_t>(plus.f >> -one.e);
+  uint64_t fractional = plus.f & (one.f - 1);
+
+  uint32_t power;
+  int n = largest_power_of_ten(integral, &power);
+  while (n > 0) {
+    buffer[(*length)++] = static_cast<char>('0' + integral / power);
+    integral %= power;
+    --n;
+    uint64_t rest = (uint64_t(integral) << -one.e) + fractional;
+    if (rest <= delta) {
+      *decimal_exponent += n;
+      grisu_round(buffer, *length, dist, delta, rest, uint64_t(power) << -one.e);
+      return;
+    }
+    power /= 10;
+  }
+  int m = 0;
+  for (;;) {
+    fractional *= 10;
+    buffer[(*length)++] = static_cast<char>('0' + (fractional >> -one.e));
+    fractional &= one.f - 1;
+    ++m;
+    delta *= 10;
+    dist *= 10;
+    if (fractional <= delta) {
+      break;
+    }
+  }
+  *decimal_exponent -= m;
+  grisu_round(buffer, *length, dist, delta, fractional, one.f);
+}
+
+template <typename T, typename Bits>
+static void grisu2(T val, char* buffer, int* length, int* decimal_exponent) {
+  Boundaries b = compute_boundaries<T, Bits>(val);
+  CachedPower cached = cached_power_for(b.plus.e);
+  DiyFp c = {cached.f, cached.e};
+  DiyFp w = diy_mul(b.w, c);
+  DiyFp minus = diy_mul(b.minus, c);
+  DiyFp plus = diy_mul(b.plus, c);
+  // shrink the interval by the error of the multiplications so every digit string inside reads back right
+  minus.f += 1;
+  plus.f -= 1;
+  *length = 0;
+  *decimal_exponent = -cached.k;
+  grisu_digits(minus, w, plus, buffer, length, decimal_exponent);
+}
+
+// Lays out digits * 10^decimal_exponent like JavaScript's Number.prototype.toString: plain notation for
+// magnitudes in [1e-6, 1e21), scientific otherwise.
+static char* write_decimal(const char* digits, int length, int decimal_exponent, char* out) {
+  int point = length + decimal_exponent;  // position of the decimal point relative to the digits
+  if (length <= point && point <= 21) {
+    memcpy(out, digits, static_cast<size_t>(length));
+    memset(out + length, '0', static_cast<size_t>(point - length));
+    return out + point;
+  }
+  if (0 < point && point <= 21) {
+    memcpy(out, digits, static_cast<size_t>(point));
+    out[point] = '.';
+    memcpy(out + point + 1, digits + point, static_cast<size_t>(length - point));
+    return out + length + 1;
+  }
+  if (-6 < point && point <= 0) {
+    out[0] = '0';
+    out[1] = '.';
+    memset(out + 2, '0', static_cast<size_t>(-point));
+    memcpy(out + 2 - point, digits, static_cast<size_t>(length));
+    return out + 2 - point + length;
+  }
+  *out++ = digits[0];
+  if (length > 1) {
+    *out++ = '.';
+    memcpy(out, digits + 1, static_cast<size_t>(length - 1));
+    out += length - 1;
+  }
+  *out++ = 'e';
+  int exponent = point - 1;
+  *out++ = exponent < 0 ? '-' : '+';
+  return format_unsigned(static_cast<uint32_t>(exponent < 0 ? -exponent : exponent), out);
+}
+
+template <typename T, typename Bits>
+static char* format_float(T val, char* out) {
+  if (std::isnan(val)) {
+    memcpy(out, "nan", 3);
+    return out + 3;
+  }
+  if (std::signbit(val)) {
+    *out++ = '-';
+    val = -val;
+  }
+  if (std::isinf(val)) {
+    memcpy(out, "inf", 3);
+    return out + 3;
+  }
+  Bits bits;
+  memcpy(&bits, &val, sizeof(bits));
+  if (bits == 0) {
+    *out = '0';
+    return out + 1;
+  }
+  char digits[20];
+  int length;
+  int decimal_exponent;
+  grisu2<T, Bits>(val, digits, &length, &decimal_exponent);
+  return write_decimal(digits, length, decimal_exponent, out);
+}
+
+char* format_number(int32_t val, char* out) { return format_signed(val, out); }
+
+char* format_number(int64_t val, char* out) { return format_signed(val, out); }
+
+char* format_number(uint32_t val, char* out) { return format_unsigned(val, out); }
+
+char* format_number(uint64_t val, char* out) { return format_unsigned(val, out); }
+
+char* format_number(float val, char* out) { return format_float<float, uint32_t>(val, out); }
+
+char* format_number(double val, char* out) { return format_float<double, uint64_t>(val, out); }
+
+char* format_number(bool val, char* out) {
+  if (val) {
+    memcpy(out, "true", 4);
+    return out + 4;
+  }
+  memcpy(out, "false", 5);
+  return out + 5;
+}
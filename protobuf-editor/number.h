@@ -0,0 +1,69 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef NUMBER_H_
+#define NUMBER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// Parse the whole of [begin, end) as a value of the type. They never throw: anything else than a number in the
+// range of the type, including surrounding spaces, gives false.
+// Integers are parsed digit by digit with overflow checks. Decimal floats whose digits fit the mantissa
+// and whose exponent is small take an exact fast path, the rest go to strtod / strtof. Nothing is allocated,
+// except a copy of a float of 128 characters or more, which strtod needs NUL-terminated.
+bool parse_number(const char* begin, const char* end, int32_t* out);
+bool parse_number(const char* begin, const char* end, int64_t* out);
+bool parse_number(const char* begin, const char* end, uint32_t* out);
+bool parse_number(const char* begin, const char* end, uint64_t* out);
+bool parse_number(const char* begin, const char* end, float* out);
+bool parse_number(const char* begin, const char* end, double* out);
+// "true", "false", "1" or "0"
+bool parse_number(const char* begin, const char* end, bool* out);
+
+template <typename T>
+bool parse_number(const std::string& str, T* out) {
+  return parse_number(str.data(), str.data() + str.size(), out);
+}
+
+// Longest output of format_number: a sign, 17 significant digits, a point and a three digit exponent for
+// doubles, or 20 digits and a sign for integers.
+const size_t kMaxNumberLength = 32;
+
+// Write the value to |out|, which has room for kMaxNumberLength chars, and return the end. No terminating
+// NUL is written. Floats and doubles get the shortest digits that parse back to the same value.
+char* format_number(int32_t val, char* out);
+char* format_number(int64_t val, char* out);
+char* format_number(uint32_t val, char* out);
+char* format_number(uint64_t val, char* out);
+char* format_number(float val, char* out);
+char* format_number(double val, char* out);
+char* format_number(bool val, char* out);
+
+template <typename T>
+std::string format_number(T val) {
+  char buf[kMaxNumberLength];
+  return std::string(buf, format_number(val, buf));
+}
+
+#endif  // NUMBER_H_
@@ -0,0 +1,58 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "parallel.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+size_t worker_count() {
+  static const size_t count = std::max(1u, std::thread::hardware_concurrency());
+  return count;
+}
+
+void parallel_for(size_t count, const std::function<void(size_t chunk, size_t begin, size_t end)>& fn,
+                  size_t min_chunk_size) {
+  if (0 == count) {
+    return;
+  }
+  size_t chunks = std::min(worker_count(), (count + min_chunk_size - 1) / std::max<size_t>(min_chunk_size, 1));
+  if (chunks <= 1) {
+    fn(0, 0, count);
+    return;
+  }
+
+  size_t chunk_size = (count + chunks - 1) / chunks;
+  std::vector<std::thread> threads;
+  threads.reserve(chunks - 1);
+  for (size_t chunk = 1; chunk < chunks; ++chunk) {
+    size_t begin = chunk * chunk_size;
+    size_t end = std::min(count, begin + chunk_size);
+    if (begin >= end) {
+      break;
+    }
+    threads.emplace_back(fn, chunk, begin, end);
+  }
+  fn(0, 0, std::min(count, chunk_size));
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
@@ -0,0 +1,270 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "preview.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <memory>
+
+#include "file.h"
+#include "wire.h"
+
+typedef ::google::protobuf::internal::WireFormatLite WireFormatLite;
+
+// message elements up to this size are parsed for the RAM they take, larger ones are previewed instead
+static const uint64_t kMaxSampleSize = 1 << 20;
+// all elements of a repeated message field are sampled up to this many, then one in kSampleStride, a prime so
+// that it doesn't fall in step with a pattern in the elements
+static const uint64_t kFirstSamples = 32;
+static const uint64_t kSampleStride = 1021;
+// deepest submessage that gets previewed rather than counted by its size
+static const int kMaxDepth = 64;
+
+// A field of a message being scanned.
+struct Tally {
+  FieldPreview field;
+  // for message fields, and the RAM of an empty element
+  const ::google::protobuf::Message* element_prototype = nullptr;
+  uint64_t element_ram = 0;
+  // elements parsed to measure their RAM, and those that weren't
+  uint64_t sampled_items = 0;
+  uint64_t sampled_wire = 0;
+  uint64_t sampled_ram = 0;
+  uint64_t unsampled_items = 0;
+  uint64_t unsampled_wire = 0;
+};
+
+// the values of a packed varint payload are its bytes without a continuation bit
+static uint64_t count_varints(const uint8_t* data, uint64_t begin, uint64_t end) {
+  uint64_t count = 0;
+  uint64_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    count += static_cast<uint64_t>(__builtin_popcountll(~word & 0x8080808080808080ULL));
+  }
+  for (; i < end; ++i) {
+    count += data[i] < 0x80 ? 1 : 0;
+  }
+  return count;
+}
+
+static uint64_t value_size(const ::google::protobuf::FieldDescriptor* field_desc) {
+  switch (field_desc->cpp_type()) {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+      return sizeof(bool);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+      return 8;
+    default:
+      return 4;
+  }
+}
+
+static uint64_t packed_values(const uint8_t* data, const WireField& wire,
+                              const ::google::protobuf::FieldDescriptor* field_desc) {
+  uint64_t length = wire.payload_end - wire.payload_begin;
+  switch (field_desc->type()) {
+    case ::google::protobuf::FieldDescriptor::TYPE_FIXED32:
+    case ::google::protobuf::FieldDescriptor::TYPE_SFIXED32:
+    case ::google::protobuf::FieldDescriptor::TYPE_FLOAT:
+      return length / 4;
+    case ::google::protobuf::FieldDescriptor::TYPE_FIXED64:
+    case ::google::protobuf::FieldDescriptor::TYPE_SFIXED64:
+    case ::google::protobuf::FieldDescriptor::TYPE_DOUBLE:
+      return length / 8;
+    default:
+      return count_varints(data, wire.payload_begin, wire.payload_end);
+  }
+}
+
+static uint64_t preview_ram(const uint8_t* data, uint64_t begin, uint64_t end,
+                            const ::google::protobuf::Message& prototype, int depth);
+
+static void tally_field(const uint8_t* data, const WireField& wire, const ::google::protobuf::Message& prototype,
+                        int depth, Tally* tally) {
+  FieldPreview* field = &tally->field;
+  field->wire += wire.end - wire.offset;
+  const auto* field_desc = field->field_desc;
+  if (nullptr == field_desc) {
+    // kept as it is, in the unknown fields
+    ++field->items;
+    field->ram += wire.end - wire.offset;
+    return;
+  }
+  bool repeated = field_desc->is_repeated();
+  uint64_t length = wire.payload_end - wire.payload_begin;
+
+  switch (field_desc->cpp_type()) {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE: {
+      ++field->items;
+      if (repeated) {
+        field->ram += sizeof(void*);
+      }
+      if (nullptr == tally->element_prototype) {
+        tally->element_prototype =
+            prototype.GetReflection()->GetMessageFactory()->GetPrototype(field_desc->message_type());
+        tally->element_ram = tally->element_prototype->SpaceUsedLong();
+      }
+      const auto* element_prototype = tally->element_prototype;
+      if (length > kMaxSampleSize && depth < kMaxDepth) {
+        field->ram += preview_ram(data, wire.payload_begin, wire.payload_end, *element_prototype, depth + 1);
+      } else if (field->items <= kFirstSamples || field->items % kSampleStride == 0) {
+        std::unique_ptr<::google::protobuf::Message> element(element_prototype->New());
+        element->ParsePartialFromArray(data + wire.payload_begin, static_cast<int>(length));
+        uint64_t ram = element->SpaceUsedLong();
+        field->ram += ram;
+        ++tally->sampled_items;
+        tally->sampled_wire += length;
+        tally->sampled_ram += ram;
+      } else {
+        ++tally->unsampled_items;
+        tally->unsampled_wire += length;
+      }
+      break;
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+      ++field->items;
+      // short strings fit in the std::string itself
+      field->ram += sizeof(std::string) + (length > 15 ? length : 0) + (repeated ? sizeof(void*) : 0);
+      break;
+    default: {
+      uint64_t values = wire.wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED
+                            ? packed_values(data, wire, field_desc)
+                            : 1;
+      field->items += values;
+      // singular values are part of the message itself
+      if (repeated) {
+        field->ram += values * value_size(field_desc);
+      }
+      break;
+    }
+  }
+}
+
+// Extrapolates the RAM of the elements that weren't sampled: each costs an empty element and the RAM the
+// sampled ones took per wire byte beyond that.
+static void finish_tally(Tally* tally) {
+  if (0 == tally->unsampled_items) {
+    return;
+  }
+  uint64_t ram = tally->unsampled_items * tally->element_ram;
+  uint64_t sampled_base = tally->sampled_items * tally->element_ram;
+  if (tally->sampled_wire > 0 && tally->sampled_ram > sampled_base) {
+    double per_byte =
+        static_cast<double>(tally->sampled_ram - sampled_base) / static_cast<double>(tally->sampled_wire);
+    ram += static_cast<uint64_t>(per_byte * static_cast<double>(tally->unsampled_wire));
+  } else {
+    ram += tally->unsampled_wire;
+  }
+  tally->field.ram += ram;
+}
+
+// Tallies the fields in [begin, end). Returns false with |*error_offset| at the first malformed field.
+static bool scan_message(const uint8_t* data, uint64_t begin, uint64_t end, const ::google::protobuf::Message& prototype,
+                         int depth, std::vector<Tally>* tallies, uint64_t* error_offset) {
+  const auto* desc = prototype.GetDescriptor();
+  // into |tallies|, by field number
+  std::map<uint32_t, size_t> index;
+  // the elements of a repeated field usually come one after another
+  size_t last = 0;
+  WireField wire;
+  uint64_t offset = begin;
+  while (offset < end) {
+    if (!decode_field(data, offset, end, &wire)) {
+      *error_offset = offset;
+      return false;
+    }
+    if (tallies->empty() || (*tallies)[last].field.field_number != wire.field_number) {
+      auto it = index.find(wire.field_number);
+      if (it == index.end()) {
+        Tally tally;
+        tally.field.field_number = wire.field_number;
+        tally.field.field_desc = desc->FindFieldByNumber(static_cast<int>(wire.field_number));
+        it = index.emplace(wire.field_number, tallies->size()).first;
+        tallies->push_back(tally);
+      }
+      last = it->second;
+    }
+    tally_field(data, wire, prototype, depth, &(*tallies)[last]);
+    offset = wire.end;
+  }
+  return true;
+}
+
+static uint64_t preview_ram(const uint8_t* data, uint64_t begin, uint64_t end,
+                            const ::google::protobuf::Message& prototype, int depth) {
+  std::vector<Tally> tallies;
+  uint64_t error_offset = 0;
+  scan_message(data, begin, end, prototype, depth, &tallies, &error_offset);
+  // |prototype| is a default instance
+  uint64_t ram = prototype.SpaceUsedLong();
+  for (auto& tally : tallies) {
+    finish_tally(&tally);
+    ram += tally.field.ram;
+  }
+  return ram;
+}
+
+bool preview_file(const std::string& path, const ::google::protobuf::Message& prototype, FilePreview* out) {
+  *out = FilePreview();
+  MappedFile file;
+  if (!file.Open(path)) {
+    return false;
+  }
+  out->size = file.size();
+  std::vector<Tally> tallies;
+  if (!scan_message(file.data(), 0, file.size(), prototype, 0, &tallies, &out->damage_offset)) {
+    out->damaged = true;
+  }
+  // |prototype| may hold a document
+  out->ram = std::unique_ptr<::google::protobuf::Message>(prototype.New())->SpaceUsedLong();
+  for (auto& tally : tallies) {
+    finish_tally(&tally);
+    out->ram += tally.field.ram;
+    out->fields.push_back(tally.field);
+  }
+  return true;
+}
+
+uint64_t available_memory() {
+  FILE* meminfo = fopen("/proc/meminfo", "r");
+  if (nullptr != meminfo) {
+    char line[256];
+    unsigned long long kb = 0;
+    bool found = false;
+    while (!found && nullptr != fgets(line, sizeof(line), meminfo)) {
+      found = sscanf(line, "MemAvailable: %llu kB", &kb) == 1;
+    }
+    fclose(meminfo);
+    if (found) {
+      return kb * 1024;
+    }
+  }
+  // older kernels: free memory only, which leaves out the page cache
+  long pages = sysconf(_SC_AVPHYS_PAGES);
+  long page_size = sysconf(_SC_PAGESIZE);
+  return pages > 0 && page_size > 0 ? static_cast<uint64_t>(pages) * static_cast<uint64_t>(page_size) : 0;
+}
@@ -0,0 +1,62 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PREVIEW_H_
+#define PREVIEW_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "protobuf_include.h"
+
+// One top-level field of a previewed file.
+struct FieldPreview {
+  uint32_t field_number = 0;
+  // nullptr for a field the schema doesn't know
+  const ::google::protobuf::FieldDescriptor* field_desc = nullptr;
+  uint64_t items = 0;  // occurrences, or values for packed fields
+  uint64_t wire = 0;   // including tags and length prefixes
+  uint64_t ram = 0;    // estimated, like SpaceUsedLong() would count once parsed
+};
+
+struct FilePreview {
+  uint64_t size = 0;
+  // in the order of their first occurrence
+  std::vector<FieldPreview> fields;
+  // estimate for the whole message
+  uint64_t ram = 0;
+  bool damaged = false;
+  uint64_t damage_offset = 0;
+};
+
+// Tallies the top-level fields of the message in |path|, of the type of |prototype|, by reading only their
+// tags over a mapping of the file. Packed fields are counted without decoding their values. The RAM of message
+// fields is extrapolated from a sample of parsed elements, and submessages too large to sample are previewed
+// the same way. Returns false if the file can't be opened; a malformed tail only sets |damaged|.
+bool preview_file(const std::string& path, const ::google::protobuf::Message& prototype, FilePreview* out);
+
+// Memory the kernel says can be allocated without swapping, 0 if unknown.
+uint64_t available_memory();
+
+#endif  // PREVIEW_H_
@@ -0,0 +1,233 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "projection.h"
+
+#include <limits.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include "field_path.h"
+#include "log.h"
+#include "proto.h"
+#include "wire.h"
+
+typedef ::google::protobuf::internal::WireFormatLite WireFormatLite;
+
+// followed by the offset and the size in 16 hex digits each, valid UTF-8 so that proto3 strings still parse
+static const char kSkippedMagic[] = "\x01pbe-skipped:";
+static const size_t kSkippedMagicLength = sizeof(kSkippedMagic) - 1;
+static const size_t kSkippedLength = kSkippedMagicLength + 16 + 1 + 16;
+
+static void append_hex64(uint64_t val, std::string* out) {
+  static const char kHex[] = "0123456789abcdef";
+  for (int shift = 60; shift >= 0; shift -= 4) {
+    *out += kHex[(val >> shift) & 0xf];
+  }
+}
+
+static bool parse_hex64(const char* text, uint64_t* out) {
+  *out = 0;
+  for (int i = 0; i < 16; ++i) {
+    char c = text[i];
+    int digit = c >= '0' && c <= '9' ? c - '0' : (c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1);
+    if (digit < 0) {
+      return false;
+    }
+    *out = (*out << 4) | static_cast<uint64_t>(digit);
+  }
+  return true;
+}
+
+bool skipped_range(const std::string& val, uint64_t* offset, uint64_t* size) {
+  return val.size() == kSkippedLength && 0 == memcmp(val.data(), kSkippedMagic, kSkippedMagicLength) &&
+         parse_hex64(val.data() + kSkippedMagicLength, offset) && val[kSkippedMagicLength + 16] == ':' &&
+         parse_hex64(val.data() + kSkippedMagicLength + 17, size);
+}
+
+bool parse_load_mask(const ::google::protobuf::Descriptor* root_desc, const std::string& text, bool include,
+                     LoadMask* out) {
+  *out = LoadMask();
+  out->include = include;
+  size_t begin = 0;
+  while (begin <= text.size()) {
+    size_t end = std::min(text.find(',', begin), text.size());
+    std::string dotted = text.substr(begin, end - begin);
+    begin = end + 1;
+    dotted.erase(0, dotted.find_first_not_of(' '));
+    dotted.erase(dotted.find_last_not_of(' ') + 1);
+    if (dotted.empty()) {
+      continue;
+    }
+    std::vector<const ::google::protobuf::FieldDescriptor*> fields;
+    if (!parse_field_names(root_desc, dotted, &fields)) {
+      return false;
+    }
+    MaskNode* node = &out->root;
+    for (const auto* field_desc : fields) {
+      node = &node->children[field_desc->number()];
+    }
+    node->selected = true;
+  }
+  return true;
+}
+
+static void append_length_delimited(int field_number, const char* payload, size_t size, std::string* out) {
+  // a tag and a 64-bit length
+  uint8_t header[15];
+  uint8_t* end = ::google::protobuf::io::CodedOutputStream::WriteTagToArray(
+      WireFormatLite::MakeTag(field_number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED), header);
+  end = ::google::protobuf::io::CodedOutputStream::WriteVarint64ToArray(size, end);
+  out->append(reinterpret_cast<const char*>(header), static_cast<size_t>(end - header));
+  out->append(payload, size);
+}
+
+// What happens to the string and bytes fields of a message. |node| is where the walk is in the mask, nullptr
+// below its leaves, and |covered| tells if a selected field is on the way.
+struct Rewrite {
+  // whether a message field may hold fields to replace
+  std::function<bool(const MaskNode* node, bool covered)> descend;
+  // false keeps the payload [begin, end), true replaces it with |*replacement|
+  std::function<bool(const MaskNode* node, bool covered, uint64_t begin, uint64_t end, std::string* replacement)>
+      replace;
+};
+
+// Appends the fields of [begin, end) of |data|, a |desc| message, to |out| with the replacements of |rewrite|,
+// and the lengths of the submessages that changed size fixed up.
+static bool rewrite_message(const uint8_t* data, uint64_t begin, uint64_t end,
+                            const ::google::protobuf::Descriptor* desc, const MaskNode* node, bool covered,
+                            const Rewrite& rewrite, int depth, std::string* out) {
+  if (depth > kMaxParseDepth) {
+    return false;
+  }
+  WireField wire;
+  std::string replacement;
+  for (uint64_t offset = begin; offset < end; offset = wire.end) {
+    if (!decode_field(data, offset, end, &wire)) {
+      return false;
+    }
+    const auto* field_desc = desc->FindFieldByNumber(static_cast<int>(wire.field_number));
+    if (nullptr == field_desc || wire.wire_type != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      out->append(reinterpret_cast<const char*>(data + wire.offset), wire.end - wire.offset);
+      continue;
+    }
+    const MaskNode* child = nullptr;
+    if (nullptr != node) {
+      auto found = node->children.find(field_desc->number());
+      child = found == node->children.end() ? nullptr : &found->second;
+    }
+    bool child_covered = covered || (nullptr != child && child->selected);
+    if (field_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_STRING &&
+        rewrite.replace(child, child_covered, wire.payload_begin, wire.payload_end, &replacement)) {
+      append_length_delimited(field_desc->number(), replacement.data(), replacement.size(), out);
+      continue;
+    }
+    if (field_desc->type() == ::google::protobuf::FieldDescriptor::TYPE_MESSAGE &&
+        rewrite.descend(child, child_covered)) {
+      std::string sub;
+      if (!rewrite_message(data, wire.payload_begin, wire.payload_end, field_desc->message_type(), child,
+                           child_covered, rewrite, depth + 1, &sub)) {
+        return false;
+      }
+      append_length_delimited(field_desc->number(), sub.data(), sub.size(), out);
+      continue;
+    }
+    out->append(reinterpret_cast<const char*>(data + wire.offset), wire.end - wire.offset);
+  }
+  return true;
+}
+
+bool read_file_projected(const std::string& path, const LoadMask& mask, protobuf::editor::MyRecord* record,
+                         MappedFile* file, size_t* skipped_count, uint64_t* skipped_bytes) {
+  *skipped_count = 0;
+  *skipped_bytes = 0;
+  record->Clear();
+  if (!file->Open(path)) {
+    return false;
+  }
+  Rewrite rewrite;
+  // everything outside the mask is skippable when it lists what to include
+  rewrite.descend = [&](const MaskNode* node, bool covered) {
+    return mask.include ? !covered || nullptr != node : covered || nullptr != node;
+  };
+  rewrite.replace = [&](const MaskNode*, bool covered, uint64_t begin, uint64_t end, std::string* replacement) {
+    if (covered == mask.include || end - begin < kMinSkippedBytes) {
+      return false;
+    }
+    *replacement = kSkippedMagic;
+    append_hex64(begin, replacement);
+    *replacement += ':';
+    append_hex64(end - begin, replacement);
+    ++*skipped_count;
+    *skipped_bytes += end - begin;
+    return true;
+  };
+
+  std::string projected;
+  const auto* desc = record->GetDescriptor();
+  bool ok = rewrite_message(file->data(), 0, file->size(), desc, &mask.root, mask.root.selected, rewrite, 0,
+                            &projected) &&
+            projected.size() <= INT_MAX;
+  if (ok) {
+    ::google::protobuf::io::CodedInputStream input(reinterpret_cast<const uint8_t*>(projected.data()),
+                                                   static_cast<int>(projected.size()));
+    input.SetRecursionLimit(kMaxParseDepth);
+    ok = record->ParseFromCodedStream(&input) && input.ConsumedEntireMessage();
+  }
+  if (!ok) {
+    PBE_LOG_ERROR("can't parse %s as %s\n", path.c_str(), desc->full_name().c_str());
+    // what did parse may hold placeholders into the file closed here
+    record->Clear();
+    file->Close();
+    return false;
+  }
+  if (0 == *skipped_count) {
+    file->Close();
+  }
+  return true;
+}
+
+bool serialize_unskipped(const ::google::protobuf::Message& msg, const MappedFile& file, std::string* out) {
+  std::string serialized = msg.SerializePartialAsString();
+  bool outside = false;
+  Rewrite rewrite;
+  rewrite.descend = [](const MaskNode*, bool) { return true; };
+  rewrite.replace = [&](const MaskNode*, bool, uint64_t begin, uint64_t end, std::string* replacement) {
+    uint64_t offset;
+    uint64_t size;
+    if (end - begin != kSkippedLength ||
+        !skipped_range(std::string(serialized.data() + begin, kSkippedLength), &offset, &size)) {
+      return false;
+    }
+    if (offset > file.size() || size > file.size() - offset) {
+      outside = true;
+      return false;
+    }
+    replacement->assign(reinterpret_cast<const char*>(file.data() + offset), size);
+    return true;
+  };
+  out->clear();
+  return rewrite_message(reinterpret_cast<const uint8_t*>(serialized.data()), 0, serialized.size(),
+                         msg.GetDescriptor(), nullptr, false, rewrite, 0, out) &&
+         !outside;
+}
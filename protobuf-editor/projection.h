@@ -0,0 +1,66 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PROJECTION_H_
+#define PROJECTION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include "file.h"
+#include "protobuf_include.h"
+
+// String and bytes payloads shorter than this are always parsed, leaving them in the file saves nothing.
+static const size_t kMinSkippedBytes = 1024;
+
+// Fields named by a load mask, as a tree of field numbers from the root message.
+struct MaskNode {
+  bool selected = false;
+  std::map<int, MaskNode> children;
+};
+
+// Which string and bytes fields a projected load leaves in the file: those at or under the fields of |root|, or
+// with |include|, all but those.
+struct LoadMask {
+  bool include = false;
+  MaskNode root;
+};
+
+// |text| is a comma separated list of dotted paths like "people.phones.number,me". Logs and returns false if a
+// name doesn't exist.
+bool parse_load_mask(const ::google::protobuf::Descriptor* root_desc, const std::string& text, bool include,
+                     LoadMask* out);
+
+// Like read_file(), but the string and bytes payloads |mask| skips are parsed as short placeholders that refer to
+// their bytes in |file|, mapped from |path|, so neither the parse nor memory pays for them.
+bool read_file_projected(const std::string& path, const LoadMask& mask, protobuf::editor::MyRecord* record,
+                         MappedFile* file, size_t* skipped_count, uint64_t* skipped_bytes);
+
+// Whether |val| is a placeholder of read_file_projected(), and which bytes of the file it stands for.
+bool skipped_range(const std::string& val, uint64_t* offset, uint64_t* size);
+
+// Serializes |msg| with its placeholders replaced by their bytes in |file|. Returns false if one lies outside it.
+bool serialize_unskipped(const ::google::protobuf::Message& msg, const MappedFile& file, std::string* out);
+
+#endif  // PROJECTION_H_
@@ -3,7 +3,9 @@
 #include <sstream>
 
 #include "file.h"
+#include "lazy.h"
 #include "log.h"
+#include "parallel.h"
 #include "protobuf_include.h"
 
 bool read_file(const std::string &file_path, protobuf::editor::MyRecord *record) {
@@ -17,10 +19,94 @@ bool read_file(const std::string &file_path, protobuf::editor::MyRecord *record)
     return false;
   }
 
-  std::ifstream input(file_path, std::ios::in | std::ios::binary);
-  bool ret = record->ParseFromIstream(&input);
+  // the large top-level repeated fields are split at their element boundaries by a tag scan, and their
+  // elements parsed on the worker threads
+  MappedFile file;
+  std::map<int, std::unique_ptr<LazyElements>> lazy;
+  if (!read_file_lazy(file_path, record, &file, &lazy)) {
+    return false;
+  }
+  bool ret = true;
+  for (const auto& field : lazy) {
+    bool initialized = false;
+    if (!field.second->Materialize(record, &initialized) || !initialized) {
+      ret = false;
+      break;
+    }
+  }
+
+  if (!ret) {
+    PBE_LOG_ERROR("can't parse %s as %s\r\n", file_path_c, record->GetDescriptor()->full_name().c_str());
+  }
+
+  return ret;
+}
 
-  input.close();
+// fewest elements a worker thread is given to encode
+static const size_t kMinEncodeChunk = 256;
 
-  return true;
+static void encode_elements(const ::google::protobuf::Message &msg, const ::google::protobuf::FieldDescriptor *field_desc,
+                            std::deque<std::string> *encoded, std::vector<WriteBuffer> *out) {
+  typedef ::google::protobuf::internal::WireFormatLite WireFormatLite;
+  typedef ::google::protobuf::io::CodedOutputStream CodedOutputStream;
+  const auto *reflection = msg.GetReflection();
+  size_t count = static_cast<size_t>(reflection->FieldSize(msg, field_desc));
+  uint32_t tag = WireFormatLite::MakeTag(field_desc->number(), WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+  size_t tag_size = CodedOutputStream::VarintSize32(tag);
+
+  // a repeated field is encoded as its elements one after the other, so each chunk of them is encoded into its
+  // own buffer, sized exactly up front
+  std::vector<std::string> chunks(worker_count());
+  parallel_for(
+      count,
+      [&](size_t chunk, size_t begin, size_t end) {
+        std::vector<size_t> sizes(end - begin);
+        size_t total = 0;
+        for (size_t i = begin; i < end; ++i) {
+          const auto &element = reflection->GetRepeatedMessage(msg, field_desc, static_cast<int>(i));
+          size_t size = element.ByteSizeLong();
+          sizes[i - begin] = size;
+          total += tag_size + CodedOutputStream::VarintSize64(size) + size;
+        }
+        std::string *buffer = &chunks[chunk];
+        buffer->resize(total);
+        auto *target = reinterpret_cast<uint8_t *>(&(*buffer)[0]);
+        for (size_t i = begin; i < end; ++i) {
+          const auto &element = reflection->GetRepeatedMessage(msg, field_desc, static_cast<int>(i));
+          target = CodedOutputStream::WriteVarint32ToArray(tag, target);
+          target = CodedOutputStream::WriteVarint64ToArray(sizes[i - begin], target);
+          target = element.SerializeWithCachedSizesToArray(target);
+        }
+      },
+      kMinEncodeChunk);
+  for (auto &chunk : chunks) {
+    if (!chunk.empty()) {
+      encoded->push_back(std::move(chunk));
+      out->push_back({encoded->back().data(), encoded->back().size()});
+    }
+  }
+}
+
+void serialize_parallel(::google::protobuf::Message *msg, std::deque<std::string> *encoded,
+                        std::vector<WriteBuffer> *out) {
+  const auto *desc = msg->GetDescriptor();
+  const auto *reflection = msg->GetReflection();
+  std::vector<const ::google::protobuf::FieldDescriptor *> large;
+  for (int i = 0; i < desc->field_count(); ++i) {
+    const auto *field_desc = desc->field(i);
+    if (field_desc->is_repeated() && field_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE &&
+        reflection->FieldSize(*msg, field_desc) >= kMinParallelEncodeElements) {
+      large.push_back(field_desc);
+    }
+  }
+
+  // the large fields are swapped out, which only swaps their element arrays, while the rest is encoded as usual
+  std::unique_ptr<::google::protobuf::Message> held(msg->New());
+  reflection->SwapFields(msg, held.get(), large);
+  encoded->push_back(msg->SerializePartialAsString());
+  reflection->SwapFields(msg, held.get(), large);
+  out->push_back({encoded->back().data(), encoded->back().size()});
+  for (const auto *field_desc : large) {
+    encode_elements(*msg, field_desc, encoded, out);
+  }
 }
@@ -22,10 +22,27 @@
 #ifndef PROTO_H_
 #define PROTO_H_
 
+#include <deque>
 #include <string>
+#include <vector>
 
+#include "file.h"
 #include "protobuf_include.h"
 
+// Deepest nesting of submessages read_file() accepts. protobuf's default of 100 turns away documents of recursive
+// schemas that are deep but fine; this still leaves the parser plenty of the main thread's stack.
+static const int kMaxParseDepth = 20000;
+
+// Top-level repeated message fields with at least this many elements are encoded by serialize_parallel() on the
+// worker threads.
+static const int kMinParallelEncodeElements = 1024;
+
 bool read_file(const std::string &model_path, protobuf::editor::MyRecord *record);
 
+// Appends the encoding of |msg|, with or without its required fields, to |out| in buffers held by |encoded|. The
+// elements of its repeated message fields with at least kMinParallelEncodeElements are sized and encoded in
+// chunks on the worker threads, and come after its other fields. |msg| is left as it was.
+void serialize_parallel(::google::protobuf::Message *msg, std::deque<std::string> *encoded,
+                        std::vector<WriteBuffer> *out);
+
 #endif /* PROTO_H_ */
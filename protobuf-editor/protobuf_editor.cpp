@@ -21,19 +21,37 @@
 
 #include "protobuf_editor.h"
 
+#include <limits.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
 #include <fstream>
+#include <utility>
 
+#include "array_io.h"
 #include "clip/clip.h"
+#include "codec.h"
+#include "diff.h"
+#include "field_traits.h"
 #include "file.h"
+#include "number.h"
 #include "proto.h"
+#include "recover.h"
 #include "string.h"
-#include "system.h"
+#include "treemap.h"
+#include "undo.h"
 
 static bool is_not_set(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc) {
   return !field_desc->is_required() && !msg->GetReflection()->HasField(*msg, field_desc);
 }
 
 int ProtobufEditor::Init() {
+  undo_.set_resolver(
+      [this](::google::protobuf::Message* root, const FieldPath& path) { return ResolvePath(root, path); });
+  required_.set_resolver(
+      [this](::google::protobuf::Message* root, const FieldPath& path) { return ResolvePath(root, path); });
+
   // Setup window
   // glfwSetErrorCallback(glfw_error_callback);
   if (!glfwInit()) {
@@ -101,60 +119,78 @@ bool ProtobufEditor::NewMessageField(::google::protobuf::Message* msg,
   } else {
     field_msg = msg->GetReflection()->MutableMessage(msg, field_desc);
   }
-  auto* desc = field_msg->GetDescriptor();
-  for (int i = 0; i < desc->field_count(); ++i) {
-    auto* field_desc2 = desc->field(i);
-    if (field_desc2->is_required()) {
-      if (!IsSet(*field_msg, field_desc2)) {
+  return AddRequiredFields(field_msg);
+}
+
+// A required message field can lead back to its own type, and then there is no valid message to create.
+static const int kMaxRequiredDepth = 100;
+
+bool ProtobufEditor::AddRequiredFields(::google::protobuf::Message* msg) {
+  // messages still to fill, with how far below |msg| they are
+  std::vector<std::pair<::google::protobuf::Message*, int>> pending = {{msg, 0}};
+  while (!pending.empty()) {
+    auto* field_msg = pending.back().first;
+    int depth = pending.back().second;
+    pending.pop_back();
+    auto* desc = field_msg->GetDescriptor();
+    for (int i = 0; i < desc->field_count(); ++i) {
+      auto* field_desc2 = desc->field(i);
+      if (!field_desc2->is_required() || IsSet(*field_msg, field_desc2)) {
+        continue;
+      }
+      if (field_desc2->cpp_type() != ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
         if (!NewField(field_msg, field_desc2)) {
           return false;
         }
+        continue;
+      }
+      if (depth == kMaxRequiredDepth) {
+        PBE_LOG_ERROR("required fields of %s nest deeper than %d levels\n", desc->full_name().c_str(),
+                      kMaxRequiredDepth);
+        return false;
       }
+      auto* reflection = field_msg->GetReflection();
+      auto* sub = field_desc2->is_repeated() ? reflection->AddMessage(field_msg, field_desc2)
+                                             : reflection->MutableMessage(field_msg, field_desc2);
+      pending.push_back({sub, depth + 1});
     }
   }
-
   return true;
 }
 
+template <typename T>
+static void new_scalar(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc) {
+  if (field_desc->is_repeated()) {
+    FieldTraits<T>::Add(msg, field_desc, T());
+  } else {
+    FieldTraits<T>::Set(msg, field_desc, T());
+  }
+}
+
 bool ProtobufEditor::NewField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc) {
-  switch (field_desc->type()) {
-    case ::google::protobuf::FieldDescriptor::TYPE_SINT32:
-      /* FALLTHROUGH */
-    case ::google::protobuf::FieldDescriptor::TYPE_INT32: {
-      if (field_desc->is_repeated()) {
-        msg->GetReflection()->AddInt32(msg, field_desc, 0);
-      } else {
-        msg->GetReflection()->SetInt32(msg, field_desc, 0);
-      }
+  switch (field_desc->cpp_type()) {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+      new_scalar<int32_t>(msg, field_desc);
       break;
-    }
-    case ::google::protobuf::FieldDescriptor::TYPE_UINT32: {
-      if (field_desc->is_repeated()) {
-        msg->GetReflection()->AddUInt32(msg, field_desc, 0);
-      } else {
-        msg->GetReflection()->SetUInt32(msg, field_desc, 0);
-      }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+      new_scalar<int64_t>(msg, field_desc);
       break;
-    }
-    case ::google::protobuf::FieldDescriptor::TYPE_FLOAT: {
-      if (field_desc->is_repeated()) {
-        msg->GetReflection()->AddFloat(msg, field_desc, 0);
-      } else {
-        msg->GetReflection()->SetFloat(msg, field_desc, 0);
-      }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+      new_scalar<uint32_t>(msg, field_desc);
       break;
-    }
-    case ::google::protobuf::FieldDescriptor::TYPE_DOUBLE: {
-      if (field_desc->is_repeated()) {
-        msg->GetReflection()->AddDouble(msg, field_desc, 0);
-      } else {
-        msg->GetReflection()->SetDouble(msg, field_desc, 0);
-      }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+      new_scalar<uint64_t>(msg, field_desc);
       break;
-    }
-    case ::google::protobuf::FieldDescriptor::TYPE_BYTES:
-      /* FALLTHROUGH */
-    case ::google::protobuf::FieldDescriptor::TYPE_STRING: {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+      new_scalar<float>(msg, field_desc);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+      new_scalar<double>(msg, field_desc);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+      new_scalar<bool>(msg, field_desc);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_STRING: {
       if (field_desc->is_repeated()) {
         msg->GetReflection()->AddString(msg, field_desc, "");
       } else {
@@ -162,15 +198,7 @@ bool ProtobufEditor::NewField(::google::protobuf::Message* msg, const ::google::
       }
       break;
     }
-    case ::google::protobuf::FieldDescriptor::TYPE_BOOL: {
-      if (field_desc->is_repeated()) {
-        msg->GetReflection()->AddBool(msg, field_desc, false);
-      } else {
-        msg->GetReflection()->SetBool(msg, field_desc, false);
-      }
-      break;
-    }
-    case ::google::protobuf::FieldDescriptor::TYPE_ENUM: {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_ENUM: {
       if (field_desc->is_repeated()) {
         msg->GetReflection()->AddEnumValue(msg, field_desc, 0);
       } else {
@@ -178,7 +206,7 @@ bool ProtobufEditor::NewField(::google::protobuf::Message* msg, const ::google::
       }
       break;
     }
-    case ::google::protobuf::FieldDescriptor::TYPE_MESSAGE: {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE: {
       if (!NewMessageField(msg, field_desc)) {
         return false;
       }
@@ -212,7 +240,7 @@ bool ProtobufEditor::SelectRepeatedField(::google::protobuf::Message* msg,
 }
 
 bool ProtobufEditor::AddRemoveRepeatedField(::google::protobuf::Message* msg,
-                                            const ::google::protobuf::FieldDescriptor* field_desc, int ind, int size,
+                                            const ::google::protobuf::FieldDescriptor* field_desc, int ind,
                                             const std::string& name) {
   if (field_desc->type() == ::google::protobuf::FieldDescriptor::TYPE_MESSAGE) {
     auto& msg2 = msg->GetReflection()->GetRepeatedMessage(*msg, field_desc, ind);
@@ -225,11 +253,7 @@ bool ProtobufEditor::AddRemoveRepeatedField(::google::protobuf::Message* msg,
 
   ImGui::SameLine();
   if (ImGui::Button(("X " + name).c_str())) {
-    for (int m = ind; m < size - 1; ++m) {
-      msg->GetReflection()->SwapElements(msg, field_desc, m, m + 1);
-    }
-    // delete elements from reflection
-    msg->GetReflection()->RemoveLast(msg, field_desc);
+    RemoveElement(msg, field_desc, ind);
     return true;
   }
   return false;
@@ -241,7 +265,7 @@ bool ProtobufEditor::RemoveSimpleField(::google::protobuf::Message* msg,
 
   if (ImGui::Button(("X " + name).c_str())) {
     // delete elements from reflection
-    msg->GetReflection()->ClearField(msg, field_desc);
+    EditField(msg, field_desc, -1, [&]() { msg->GetReflection()->ClearField(msg, field_desc); });
     return true;
   }
   return false;
@@ -272,70 +296,89 @@ bool ProtobufEditor::AddRemoveField(::google::protobuf::Message* msg,
 
   if (ImGui::Button(("X " + name).c_str())) {
     // delete elements from reflection
-    msg->GetReflection()->ClearField(msg, field_desc);
+    EditField(msg, field_desc, -1, [&]() { msg->GetReflection()->ClearField(msg, field_desc); });
     return true;
   }
 
   return false;
 }
 
-void ProtobufEditor::SetRepeatedIntField(::google::protobuf::Message* msg,
-                                         const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (ImGui::Button(("+ " + field_desc->name()).c_str())) {
-    msg->GetReflection()->AddInt32(msg, field_desc, 0);
-    ImGui::SetNextItemOpen(true);
+void ProtobufEditor::EditField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                               int index, const std::function<void()>& edit) {
+  std::string before = encode_field(msg, field_desc, index);
+  edit();
+  std::string after = encode_field(msg, field_desc, index);
+  if (before != after) {
+    undo_.RecordSet(path_, field_desc, index, std::move(before), std::move(after));
+    OnEdit(path_, field_desc->number());
   }
-  bool tree_selected = ImGui::TreeNode(field_desc->name().c_str());
-  ImGui::SameLine();
+}
 
-  if (tree_selected) {
-    int size = msg->GetReflection()->FieldSize(*msg, field_desc);
-    for (int k = 0; k < size; ++k) {
-      int val = msg->GetReflection()->GetRepeatedInt32(*msg, field_desc, k);
+void ProtobufEditor::AddElement(::google::protobuf::Message* msg,
+                                const ::google::protobuf::FieldDescriptor* field_desc,
+                                const std::function<void()>& add) {
+  int size = msg->GetReflection()->FieldSize(*msg, field_desc);
+  add();
+  if (msg->GetReflection()->FieldSize(*msg, field_desc) == size + 1) {
+    undo_.RecordInsert(path_, field_desc, size, encode_field(msg, field_desc, size));
+  }
+  OnEdit(path_, field_desc->number());
+}
 
-      std::string name = field_desc->name() + std::to_string(k);
-      ImGui::InputInt(name.c_str(), &val, 1);
-      ImGui::SameLine();
+void ProtobufEditor::RemoveElement(::google::protobuf::Message* msg,
+                                   const ::google::protobuf::FieldDescriptor* field_desc, int index) {
+  undo_.RecordRemove(path_, field_desc, index, encode_field(msg, field_desc, index));
+  remove_repeated_element(msg, field_desc, index);
+  OnEdit(path_, field_desc->number());
+}
 
-      if (AddRemoveRepeatedField(msg, field_desc, k, size, name)) {
-        break;
+void ProtobufEditor::OnEdit(const FieldPath& path, int field_number) {
+  sizes_.Invalidate(path, field_number);
+  // an embed in progress is into a message below the edited field, which may have moved with it
+  if (embed_read_.running() && embed_path_.size() > path.size() &&
+      embed_path_[path.size()].field_number == field_number &&
+      same_path(FieldPath(embed_path_.begin(), embed_path_.begin() + static_cast<std::ptrdiff_t>(path.size())),
+                path)) {
+    // not noted at embed_path_, where another message may be now
+    PBE_LOG_WARNING("embed cancelled, the message it was for may have moved\n");
+    embed_read_.Cancel();
+  }
+  // an element of lazy_ is kept from now on, and encoded again on save. It wasn't checked on load, so all of
+  // it is checked on its first edit.
+  if (!path.empty()) {
+    auto lazy = lazy_.find(path[0].field_number);
+    if (lazy != lazy_.end()) {
+      auto index = static_cast<size_t>(path[0].index);
+      bool first_edit = !lazy->second->edited(index);
+      lazy->second->MarkEdited(index);
+      if (first_edit) {
+        required_.Update(&the_record_, FieldPath(1, path[0]), RequiredCheck::kWholeMessage);
+        return;
       }
-
-      msg->GetReflection()->SetRepeatedInt32(msg, field_desc, k, val);
     }
-    ImGui::TreePop();
   }
+  required_.Update(&the_record_, path, field_number);
 }
 
-void ProtobufEditor::SetNonRepeatedIntField(::google::protobuf::Message* msg,
-                                            const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (is_not_set(msg, field_desc)) {
-    if (ImGui::Button(("create " + field_desc->name()).c_str())) {
-      msg->GetReflection()->SetInt32(msg, field_desc, 0);
-    } else {
-      return;
-    }
+::google::protobuf::Message* ProtobufEditor::ResolvePath(::google::protobuf::Message* root, const FieldPath& path) {
+  if (root != &the_record_ || path.empty()) {
+    return resolve_path(root, path);
   }
-  int val = msg->GetReflection()->GetInt32(*msg, field_desc);
-  ImGui::InputInt(field_desc->name().c_str(), &val, 1);
-
-  msg->GetReflection()->SetInt32(msg, field_desc, val);
-  RemoveSimpleField(msg, field_desc, field_desc->name());
-}
-
-void ProtobufEditor::SetIntField(::google::protobuf::Message* msg,
-                                 const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (field_desc->is_repeated()) {
-    SetRepeatedIntField(msg, field_desc);
-  } else {
-    SetNonRepeatedIntField(msg, field_desc);
+  auto lazy = lazy_.find(path[0].field_number);
+  if (lazy == lazy_.end()) {
+    return resolve_path(root, path);
   }
+  if (path[0].index < 0 || static_cast<size_t>(path[0].index) >= lazy->second->size()) {
+    return nullptr;
+  }
+  auto* element = lazy->second->Get(static_cast<size_t>(path[0].index));
+  return nullptr == element ? nullptr : resolve_path(element, FieldPath(path.begin() + 1, path.end()));
 }
 
 void ProtobufEditor::SetRepeatedEnumField(::google::protobuf::Message* msg,
                                           const ::google::protobuf::FieldDescriptor* field_desc) {
   if (ImGui::Button(("+ " + field_desc->name()).c_str())) {
-    msg->GetReflection()->AddEnumValue(msg, field_desc, 0);
+    AddElement(msg, field_desc, [&]() { msg->GetReflection()->AddEnumValue(msg, field_desc, 0); });
     ImGui::SetNextItemOpen(true);
   }
   ImGui::SameLine();
@@ -353,13 +396,16 @@ void ProtobufEditor::SetRepeatedEnumField(::google::protobuf::Message* msg,
       }
       int selected = enum_desc->index();
       std::string name = field_desc->name() + std::to_string(k);
-      ImGui::Combo(name.c_str(), &selected, const_cast<const char **>(names), num_values);
+      bool changed = ImGui::Combo(name.c_str(), &selected, const_cast<const char **>(names), num_values);
       auto selected_val = enum_desc->type()->FindValueByName(names[selected]);
       for (int i = 0; i < num_values; ++i) {
         delete names[i];
       }
       delete[] names;
-      msg->GetReflection()->SetRepeatedEnum(msg, field_desc, k, selected_val);
+      if (changed) {
+        EditField(msg, field_desc, k,
+                  [&]() { msg->GetReflection()->SetRepeatedEnum(msg, field_desc, k, selected_val); });
+      }
     }
     ImGui::TreePop();
   }
@@ -377,20 +423,22 @@ void ProtobufEditor::SetNonRepeatedEnumField(::google::protobuf::Message* msg,
   if (is_not_set(msg, field_desc)) {
     if (ImGui::Button(("create " + field_desc->name()).c_str())) {
       auto selected_val = enum_desc->type()->FindValueByName(names[0]);
-      msg->GetReflection()->SetEnum(msg, field_desc, selected_val);
+      EditField(msg, field_desc, -1, [&]() { msg->GetReflection()->SetEnum(msg, field_desc, selected_val); });
     } else {
       return;
     }
   }
 
   int selected = enum_desc->index();
-  ImGui::Combo(field_desc->name().c_str(), &selected, const_cast<const char **>(names), num_values);
+  bool changed = ImGui::Combo(field_desc->name().c_str(), &selected, const_cast<const char **>(names), num_values);
   auto selected_val = enum_desc->type()->FindValueByName(names[selected]);
   for (int i = 0; i < num_values; ++i) {
     delete names[i];
   }
   delete[] names;
-  msg->GetReflection()->SetEnum(msg, field_desc, selected_val);
+  if (changed) {
+    EditField(msg, field_desc, -1, [&]() { msg->GetReflection()->SetEnum(msg, field_desc, selected_val); });
+  }
   RemoveSimpleField(msg, field_desc, field_desc->name());
 }
 
@@ -403,244 +451,397 @@ void ProtobufEditor::SetEnumField(::google::protobuf::Message* msg,
   }
 }
 
-void ProtobufEditor::InputText(const std::string& name, std::string* str) {
-  ImGui::InputText(name.c_str(), str);
+bool ProtobufEditor::InputText(const std::string& name, std::string* str) {
+  bool changed = ImGui::InputText(name.c_str(), str);
   ImGui::SameLine();
   if (ImGui::Button(("Copy " + name).c_str())) {
     clip::set_text(*str);
   }
   ImGui::SameLine();
   if (ImGui::Button(("Paste " + name).c_str())) {
-    clip::get_text(*str);
+    changed = clip::get_text(*str) || changed;
   }
+  return changed;
 }
 
-static bool validate_uint(const std::string& str, uint32_t* val) {
-  if (str.empty() || str.size() > 10) {
-    return false;
+// Strings are drawn from at most this many of their bytes until their input is clicked.
+static const size_t kStringPreviewLength = 256;
+
+static std::string string_preview(const std::string& val) {
+  if (val.size() <= kStringPreviewLength) {
+    return val;
   }
-  for (const auto& c : str) {
-    if (!isdigit(c)) {
-      return false;
-    }
+  // don't cut a UTF-8 sequence in the middle
+  size_t len = kStringPreviewLength;
+  while (len > 0 && (static_cast<unsigned char>(val[len]) & 0xC0) == 0x80) {
+    --len;
   }
-  uint64_t temp = static_cast<uint64_t>(stoll(str));
-  if (temp > UINT32_MAX) {
+  return val.substr(0, len) + "... (" + human_bytes(val.size()) + ")";
+}
+
+bool ProtobufEditor::SkippedPayload(::google::protobuf::Message* msg,
+                                    const ::google::protobuf::FieldDescriptor* field_desc, int index,
+                                    const std::string& val) {
+  uint64_t offset;
+  uint64_t size;
+  if (!projected_ || !skipped_range(val, &offset, &size)) {
     return false;
   }
-  *val = static_cast<uint32_t>(temp);
+  std::string name = index < 0 ? field_desc->name() : field_desc->name() + std::to_string(index);
+  ImGui::Text("%s: %s left in the file", name.c_str(), human_bytes(size).c_str());
+  ImGui::SameLine();
+  if (ImGui::Button(("Load " + name).c_str()) && offset <= document_file_.size() &&
+      size <= document_file_.size() - offset) {
+    std::string bytes(reinterpret_cast<const char*>(document_file_.data() + offset), size);
+    // the value doesn't change, so there is nothing to undo
+    if (index < 0) {
+      msg->GetReflection()->SetString(msg, field_desc, std::move(bytes));
+    } else {
+      msg->GetReflection()->SetRepeatedString(msg, field_desc, index, std::move(bytes));
+    }
+    sizes_.Invalidate(path_, field_desc->number());
+  }
   return true;
 }
 
-static bool validate_double(const std::string& str, double* val) {
-  try {
-    *val = std::stod(str);
-    return true;
-  } catch (std::invalid_argument e) {
-    return false;
-  } catch (std::out_of_range e2) {
-    return false;
+bool ProtobufEditor::InputString(const std::string& name, const ::google::protobuf::FieldDescriptor* field_desc,
+                                 int index, const std::string& val, std::string* committed) {
+  bool editing = string_edit_.field_number == field_desc->number() && string_edit_.index == index &&
+                 same_path(string_edit_.path, path_);
+  bool changed = false;
+  if (editing) {
+    if (string_edit_.focus_frames > 0) {
+      ImGui::SetKeyboardFocusHere();
+    }
+    string_edit_.changed = ImGui::InputText(name.c_str(), &string_edit_.buffer) || string_edit_.changed;
+    if (ImGui::IsItemActive()) {
+      string_edit_.focus_frames = 0;
+    } else if (string_edit_.focus_frames > 0) {
+      --string_edit_.focus_frames;
+    } else {
+      changed = string_edit_.changed;
+      if (changed) {
+        *committed = std::move(string_edit_.buffer);
+      }
+      string_edit_ = StringEdit();
+      editing = false;
+    }
+  } else {
+    // a different id than the editable input, so that one starts out with the whole string once it gets focus
+    std::string preview = string_preview(val);
+    ImGui::InputText((name + "##preview").c_str(), &preview, ImGuiInputTextFlags_ReadOnly);
+    if (ImGui::IsItemActivated()) {
+      string_edit_.path = path_;
+      string_edit_.field_number = field_desc->number();
+      string_edit_.index = index;
+      string_edit_.buffer = val;
+      string_edit_.changed = false;
+      string_edit_.focus_frames = 2;
+    }
   }
-}
 
-static bool validate_float(const std::string& str, float* val) {
-  try {
-    *val = std::stof(str);
-    return true;
-  } catch (std::invalid_argument e) {
-    return false;
-  } catch (std::out_of_range e2) {
-    return false;
+  ImGui::SameLine();
+  if (ImGui::Button(("Copy " + name).c_str())) {
+    clip::set_text(editing ? string_edit_.buffer : val);
+  }
+  ImGui::SameLine();
+  if (ImGui::Button(("Paste " + name).c_str()) && clip::get_text(*committed)) {
+    if (editing) {
+      string_edit_ = StringEdit();
+    }
+    changed = true;
   }
+  return changed;
 }
 
-void ProtobufEditor::SetRepeatedUintFieldInner(::google::protobuf::Message* msg,
-                                               const ::google::protobuf::FieldDescriptor* field_desc,
-                                               const std::string& name, int k, int size, uint32_t val,
-                                               const std::string& val_str, bool* should_break) {
-  if (validate_uint(val_str, &val)) {
-    ImGui::SameLine();
-
-    if (AddRemoveRepeatedField(msg, field_desc, k, size, name)) {
-      *should_break = true;
-      return;
+void ProtobufEditor::AllValsAddRemove(::google::protobuf::Message* msg,
+                                      const ::google::protobuf::FieldDescriptor* field_desc,
+                                      const std::string& all_vals, std::vector<std::string>* all_vals_vec, int size) {
+  split_by_multiple_delimiters(",", all_vals, all_vals_vec);
+  int diff = static_cast<int>(all_vals_vec->size()) - size;
+  if (diff > 0) {
+    for (int m = 0; m < diff; ++m) {
+      NewField(msg, field_desc);
+    }
+  } else if (diff < 0) {
+    for (int m = 0; m < -diff; ++m) {
+      msg->GetReflection()->RemoveLast(msg, field_desc);
     }
+  }
+}
 
-    msg->GetReflection()->SetRepeatedUInt32(msg, field_desc, k, val);
-  } else {
-    ImGui::Text("%s is not a valid uint32_t", val_str.c_str());
+template <typename T>
+bool ProtobufEditor::InputScalar(const std::string& name, const ::google::protobuf::FieldDescriptor* field_desc,
+                                 T* val) {
+  std::string val_str = format_number(*val);
+  if (!InputText(name, &val_str)) {
+    return false;
+  }
+  if (!parse_number(val_str, val)) {
+    ImGui::Text("%s is not a valid %s", val_str.c_str(), field_type_info(field_desc).name);
+    return false;
   }
+  return true;
 }
 
-void ProtobufEditor::SetRepeatedUintField(::google::protobuf::Message* msg,
-                                          const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (ImGui::Button(("+ " + field_desc->name()).c_str())) {
-    msg->GetReflection()->AddUInt32(msg, field_desc, 0);
-    ImGui::SetNextItemOpen(true);
+template <>
+bool ProtobufEditor::InputScalar(const std::string& name, const ::google::protobuf::FieldDescriptor*, bool* val) {
+  return ImGui::Checkbox(name.c_str(), val);
+}
+
+void ProtobufEditor::Browse(const std::string& owner, std::string* out) {
+  if (ImGui::Button("Browse")) {
+    file_browser_.Open(owner, "Select a file", *out, false);
   }
+  file_browser_.Take(owner, out);
+}
 
-  ImGui::SameLine();
-  bool tree_selected = ImGui::TreeNode(field_desc->name().c_str());
+std::string ProtobufEditor::FieldOwner(const std::string& action,
+                                       const ::google::protobuf::FieldDescriptor* field_desc) {
+  return action + " " + path_to_string(the_record_.GetDescriptor(), path_) + "." + field_desc->name();
+}
 
-  if (tree_selected) {
-    int size = msg->GetReflection()->FieldSize(*msg, field_desc);
-    for (int k = 0; k < size; ++k) {
-      uint32_t val = msg->GetReflection()->GetRepeatedUInt32(*msg, field_desc, k);
+// Longer repeated fields don't get their "-all" text built every frame, only when copied.
+static const int kMaxInlineValues = 10000;
 
-      std::string name = field_desc->name() + std::to_string(k);
-      std::string val_str = std::to_string(val);
-      InputText(name, &val_str);
-      bool removed = RemoveSimpleField(msg, field_desc, field_desc->name());
-      if (!removed) {
-        bool should_break = false;
-        SetRepeatedUintFieldInner(msg, field_desc, name, k, size, val, val_str, &should_break);
-        if (should_break) {
-          break;
-        }
-      }
+template <typename T>
+static std::string join_values(const ::google::protobuf::RepeatedField<T>& field) {
+  std::string joined;
+  char buf[kMaxNumberLength];
+  for (int k = 0; k < field.size(); ++k) {
+    if (k > 0) {
+      joined += ',';
     }
-    ImGui::TreePop();
+    joined.append(buf, format_number(field.Get(k), buf));
   }
+  return joined;
 }
 
-void ProtobufEditor::SetNonRepeatedUintField(::google::protobuf::Message* msg,
-                                             const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (is_not_set(msg, field_desc)) {
-    if (ImGui::Button(("create " + field_desc->name()).c_str())) {
-      msg->GetReflection()->SetUInt32(msg, field_desc, 0);
+template <typename T>
+void ProtobufEditor::AllRepeatedScalarVals(::google::protobuf::Message* msg,
+                                           const ::google::protobuf::FieldDescriptor* field_desc) {
+  const auto& field = repeated_field<T>(*msg, field_desc);
+  std::string name = field_desc->name() + "-all";
+  std::string all_vals;
+  bool changed = false;
+  if (field.size() <= kMaxInlineValues) {
+    all_vals = join_values(field);
+    changed = InputText(name, &all_vals);
+  } else {
+    ImGui::Text("%s values", human_count(static_cast<uint64_t>(field.size())).c_str());
+    ImGui::SameLine();
+    if (ImGui::Button(("Copy " + name).c_str())) {
+      clip::set_text(join_values(field));
+    }
+    ImGui::SameLine();
+    changed = ImGui::Button(("Paste " + name).c_str()) && clip::get_text(all_vals);
+  }
+
+  if (changed) {
+    ::google::protobuf::RepeatedField<T> parsed;
+    ArrayImportReport report;
+    if (parse_array(all_vals.data(), all_vals.data() + all_vals.size(), ArrayFormat::kText, -1, &parsed, &report)) {
+      EditField(msg, field_desc, -1, [&]() { mutable_repeated_field<T>(msg, field_desc)->Swap(&parsed); });
     } else {
-      return;
+      ImGui::Text("not a valid %s at offset %zu", field_type_info(field_desc).name, report.error_offset);
     }
   }
 
-  uint32_t val = msg->GetReflection()->GetUInt32(*msg, field_desc);
+  ImportArray<T>(msg, field_desc);
+  ExportArray<T>(msg, field_desc);
+}
 
-  std::string val_str = std::to_string(val);
-  InputText(field_desc->name(), &val_str);
-  bool removed = RemoveSimpleField(msg, field_desc, field_desc->name());
-  if (!removed) {
-    if (validate_uint(val_str, &val)) {
-      msg->GetReflection()->SetUInt32(msg, field_desc, val);
+template <typename T>
+void ProtobufEditor::ImportArray(::google::protobuf::Message* msg,
+                                 const ::google::protobuf::FieldDescriptor* field_desc) {
+  if (!ImGui::TreeNode((field_desc->name() + "-import").c_str())) {
+    return;
+  }
+  // in the order of ArrayFormat
+  static const char* kFormats[] = {"text, CSV or TSV", "raw little-endian", "NumPy .npy"};
+  std::string owner = FieldOwner("import", field_desc);
+  ArrayImport* state = &array_imports_[owner];
+  Browse(owner, &state->path);
+  ImGui::SameLine();
+  ImGui::Text("%s", state->path.c_str());
+  ImGui::Combo("format", &state->format, kFormats, sizeof(kFormats) / sizeof(kFormats[0]));
+  if (state->format == 0) {
+    ImGui::InputInt("column, -1 for every number", &state->column);
+  }
+  if (ImGui::Button("Import")) {
+    ::google::protobuf::RepeatedField<T> parsed;
+    ArrayImportReport report;
+    if (!regular_file_exists(state->path)) {
+      state->note = "no such file";
+    } else if (!load_array_file(state->path, static_cast<ArrayFormat>(state->format), state->column, &parsed,
+                                &report)) {
+      state->note = std::string("not a valid ") + field_type_info(field_desc).name + " at offset " +
+                    std::to_string(report.error_offset);
     } else {
-      ImGui::Text("%s is not a valid uint32_t", val_str.c_str());
+      EditField(msg, field_desc, -1, [&]() { mutable_repeated_field<T>(msg, field_desc)->Swap(&parsed); });
+      state->note = "imported " + human_count(report.values) + " values";
+      if (report.skipped_header) {
+        state->note += ", skipped the header line";
+      }
     }
   }
+  ImGui::Text("%s", state->note.c_str());
+  ImGui::TreePop();
 }
 
-void ProtobufEditor::SetUintField(::google::protobuf::Message* msg,
-                                  const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (field_desc->is_repeated()) {
-    SetRepeatedUintField(msg, field_desc);
-  } else {
-    SetNonRepeatedUintField(msg, field_desc);
+template <typename T>
+void ProtobufEditor::ExportArray(::google::protobuf::Message* msg,
+                                 const ::google::protobuf::FieldDescriptor* field_desc) {
+  std::string owner = FieldOwner("export", field_desc);
+  if (ImGui::Button(("Export " + field_desc->name()).c_str())) {
+    file_browser_.Open(owner, "Export as .npy, or raw for any other name", field_desc->name() + ".npy", true);
+  }
+  std::string path;
+  if (file_browser_.Take(owner, &path)) {
+    const auto& field = repeated_field<T>(*msg, field_desc);
+    ArrayFormat format = ends_with(path, ".npy") ? ArrayFormat::kNpy : ArrayFormat::kRaw;
+    bool written = write_array_file(path, format, field_desc, field.data(), static_cast<size_t>(field.size()));
+    export_notes_[owner] = (written ? "exported to " : "can't export to ") + path;
+  }
+  auto note = export_notes_.find(owner);
+  if (note != export_notes_.end()) {
+    ImGui::SameLine();
+    ImGui::Text("%s", note->second.c_str());
   }
 }
 
-void ProtobufEditor::SetRepeatedBoolField(::google::protobuf::Message* msg,
-                                          const ::google::protobuf::FieldDescriptor* field_desc) {
+template <typename T>
+void ProtobufEditor::SetRepeatedScalarField(::google::protobuf::Message* msg,
+                                            const ::google::protobuf::FieldDescriptor* field_desc) {
   if (ImGui::Button(("+ " + field_desc->name()).c_str())) {
-    msg->GetReflection()->AddBool(msg, field_desc, 0);
+    AddElement(msg, field_desc, [&]() { FieldTraits<T>::Add(msg, field_desc, T()); });
     ImGui::SetNextItemOpen(true);
   }
   ImGui::SameLine();
-  bool tree_selected = ImGui::TreeNode(field_desc->name().c_str());
 
+  bool tree_selected = ImGui::TreeNode(field_desc->name().c_str());
   if (tree_selected) {
     int size = msg->GetReflection()->FieldSize(*msg, field_desc);
     for (int k = 0; k < size; ++k) {
-      bool val = msg->GetReflection()->GetRepeatedBool(*msg, field_desc, k);
-
+      T val = FieldTraits<T>::GetRepeated(*msg, field_desc, k);
       std::string name = field_desc->name() + std::to_string(k);
-      ImGui::Checkbox(name.c_str(), &val);
-      ImGui::SameLine();
 
-      if (AddRemoveRepeatedField(msg, field_desc, k, size, name)) {
+      bool changed = InputScalar(name, field_desc, &val);
+      ImGui::SameLine();
+      if (AddRemoveRepeatedField(msg, field_desc, k, name)) {
         break;
       }
 
-      msg->GetReflection()->SetRepeatedBool(msg, field_desc, k, val);
+      if (changed) {
+        EditField(msg, field_desc, k, [&]() { FieldTraits<T>::SetRepeated(msg, field_desc, k, val); });
+      }
     }
+
+    AllRepeatedScalarVals<T>(msg, field_desc);
+
     ImGui::TreePop();
   }
 }
 
-void ProtobufEditor::SetNonRepeatedBoolField(::google::protobuf::Message* msg,
-                                             const ::google::protobuf::FieldDescriptor* field_desc) {
+template <typename T>
+void ProtobufEditor::SetNonRepeatedScalarField(::google::protobuf::Message* msg,
+                                               const ::google::protobuf::FieldDescriptor* field_desc) {
   if (is_not_set(msg, field_desc)) {
     if (ImGui::Button(("create " + field_desc->name()).c_str())) {
-      msg->GetReflection()->SetBool(msg, field_desc, false);
+      EditField(msg, field_desc, -1, [&]() { FieldTraits<T>::Set(msg, field_desc, T()); });
     } else {
       return;
     }
   }
 
-  bool val = msg->GetReflection()->GetBool(*msg, field_desc);
-  ImGui::Checkbox(field_desc->name().c_str(), &val);
-
-  msg->GetReflection()->SetBool(msg, field_desc, val);
-  RemoveSimpleField(msg, field_desc, field_desc->name());
+  T val = FieldTraits<T>::Get(*msg, field_desc);
+  bool changed = InputScalar(field_desc->name(), field_desc, &val);
+  bool removed = RemoveSimpleField(msg, field_desc, field_desc->name());
+  if (!removed && changed) {
+    EditField(msg, field_desc, -1, [&]() { FieldTraits<T>::Set(msg, field_desc, val); });
+  }
 }
 
-void ProtobufEditor::SetBoolField(::google::protobuf::Message* msg,
-                                  const ::google::protobuf::FieldDescriptor* field_desc) {
+template <typename T>
+void ProtobufEditor::SetScalarField(::google::protobuf::Message* msg,
+                                    const ::google::protobuf::FieldDescriptor* field_desc) {
   if (field_desc->is_repeated()) {
-    SetRepeatedBoolField(msg, field_desc);
+    SetRepeatedScalarField<T>(msg, field_desc);
   } else {
-    SetNonRepeatedBoolField(msg, field_desc);
+    SetNonRepeatedScalarField<T>(msg, field_desc);
   }
 }
 
-void ProtobufEditor::AllValsAddRemove(::google::protobuf::Message* msg,
-                                      const ::google::protobuf::FieldDescriptor* field_desc, std::string* all_vals,
-                                      std::vector<std::string>* all_vals_vec, int size) {
-  InputText((field_desc->name() + "-all").c_str(), all_vals);
-  split_by_multiple_delimiters(",", *all_vals, all_vals_vec);
-  int diff = static_cast<int>(all_vals_vec->size()) - size;
-  if (diff > 0) {
-    for (int m = 0; m < diff; ++m) {
-      NewField(msg, field_desc);
-    }
-  } else if (diff < 0) {
-    for (int m = 0; m < -diff; ++m) {
-      msg->GetReflection()->RemoveLast(msg, field_desc);
+// Longer repeated string fields don't get their "-all" text built every frame, only when copied.
+static const size_t kMaxInlineStringBytes = 1 << 16;
+
+static std::string join_strings(const ::google::protobuf::Message& msg,
+                                const ::google::protobuf::FieldDescriptor* field_desc) {
+  int size = msg.GetReflection()->FieldSize(msg, field_desc);
+  std::string joined;
+  std::string scratch;
+  for (int k = 0; k < size; ++k) {
+    if (k > 0) {
+      joined += ',';
     }
+    joined += msg.GetReflection()->GetRepeatedStringReference(msg, field_desc, k, &scratch);
   }
+  return joined;
 }
 
-void ProtobufEditor::AllRepeatedFloatVals(::google::protobuf::Message* msg,
-                                          const ::google::protobuf::FieldDescriptor* field_desc) {
-  std::string all_vals;
-  int size = msg->GetReflection()->FieldSize(*msg, field_desc);
-  for (int k = 0; k < size; ++k) {
-    float val = msg->GetReflection()->GetRepeatedFloat(*msg, field_desc, k);
-    std::string name = field_desc->name() + std::to_string(k);
+void ProtobufEditor::AllRepeatedStringVals(::google::protobuf::Message* msg,
+                                           const ::google::protobuf::FieldDescriptor* field_desc) {
+  const auto* reflection = msg->GetReflection();
+  int size = reflection->FieldSize(*msg, field_desc);
+  size_t total = 0;
+  std::string scratch;
+  uint64_t offset;
+  uint64_t skipped_size;
+  for (int k = 0; k < size && projected_; ++k) {
+    if (skipped_range(reflection->GetRepeatedStringReference(*msg, field_desc, k, &scratch), &offset, &skipped_size)) {
+      ImGui::TextDisabled("load the strings left in the file to edit them together");
+      return;
+    }
+  }
+  for (int k = 0; k < size && total <= kMaxInlineStringBytes; ++k) {
+    total += reflection->GetRepeatedStringReference(*msg, field_desc, k, &scratch).size() + 1;
+  }
 
-    std::string val_str = std::to_string(val);
-    all_vals += val_str;
-    if (k < size - 1) {
-      all_vals += ",";
+  std::string name = field_desc->name() + "-all";
+  std::string all_vals;
+  bool changed = false;
+  if (total <= kMaxInlineStringBytes) {
+    all_vals = join_strings(*msg, field_desc);
+    changed = InputText(name, &all_vals);
+  } else {
+    ImGui::Text("%s strings", human_count(static_cast<uint64_t>(size)).c_str());
+    ImGui::SameLine();
+    if (ImGui::Button(("Copy " + name).c_str())) {
+      clip::set_text(join_strings(*msg, field_desc));
     }
+    ImGui::SameLine();
+    changed = ImGui::Button(("Paste " + name).c_str()) && clip::get_text(all_vals);
+  }
+  if (!changed) {
+    return;
   }
 
-  std::vector<std::string> all_vals_vec;
-  AllValsAddRemove(msg, field_desc, &all_vals, &all_vals_vec, size);
+  EditField(msg, field_desc, -1, [&]() {
+    std::vector<std::string> all_vals_vec;
+    AllValsAddRemove(msg, field_desc, all_vals, &all_vals_vec, size);
 
-  int m = 0;
-  for (const auto& val_s : all_vals_vec) {
-    float flt;
-    if (!validate_float(val_s, &flt)) {
-      ImGui::Text("%s is not a valid float", val_s.c_str());
-      continue;
+    int m = 0;
+    for (auto& val_s : all_vals_vec) {
+      msg->GetReflection()->SetRepeatedString(msg, field_desc, m, std::move(val_s));
+      ++m;
     }
-    msg->GetReflection()->SetRepeatedFloat(msg, field_desc, m, flt);
-    ++m;
-  }
+  });
 }
 
-void ProtobufEditor::SetRepeatedFloatField(::google::protobuf::Message* msg,
-                                           const ::google::protobuf::FieldDescriptor* field_desc) {
+void ProtobufEditor::SetRepeatedStringField(::google::protobuf::Message* msg,
+                                            const ::google::protobuf::FieldDescriptor* field_desc) {
   if (ImGui::Button(("+ " + field_desc->name()).c_str())) {
-    msg->GetReflection()->AddFloat(msg, field_desc, 0);
+    AddElement(msg, field_desc, [&]() { msg->GetReflection()->AddString(msg, field_desc, ""); });
     ImGui::SetNextItemOpen(true);
   }
   ImGui::SameLine();
@@ -648,269 +849,181 @@ void ProtobufEditor::SetRepeatedFloatField(::google::protobuf::Message* msg,
   bool tree_selected = ImGui::TreeNode(field_desc->name().c_str());
   if (tree_selected) {
     int size = msg->GetReflection()->FieldSize(*msg, field_desc);
+    std::string scratch;
     for (int k = 0; k < size; ++k) {
-      float val = msg->GetReflection()->GetRepeatedFloat(*msg, field_desc, k);
+      const std::string& val = msg->GetReflection()->GetRepeatedStringReference(*msg, field_desc, k, &scratch);
       std::string name = field_desc->name() + std::to_string(k);
+      std::string committed;
+      bool changed = !SkippedPayload(msg, field_desc, k, val) && InputString(name, field_desc, k, val, &committed);
 
-      std::string val_str = std::to_string(val);
-      InputText(name, &val_str);
-      if (validate_float(val_str, &val)) {
-        ImGui::SameLine();
-        if (AddRemoveRepeatedField(msg, field_desc, k, size, name)) {
-          break;
-        }
+      ImGui::SameLine();
 
-        msg->GetReflection()->SetRepeatedFloat(msg, field_desc, k, val);
-      } else {
-        ImGui::Text("%s is not a valid float", val_str.c_str());
+      if (AddRemoveRepeatedField(msg, field_desc, k, name)) {
+        break;
+      }
+
+      if (changed) {
+        EditField(msg, field_desc, k,
+                  [&]() { msg->GetReflection()->SetRepeatedString(msg, field_desc, k, std::move(committed)); });
       }
     }
 
-    AllRepeatedFloatVals(msg, field_desc);
+    AllRepeatedStringVals(msg, field_desc);
 
     ImGui::TreePop();
   }
 }
 
-void ProtobufEditor::SetNonRepeatedFloatField(::google::protobuf::Message* msg,
-                                              const ::google::protobuf::FieldDescriptor* field_desc) {
+void ProtobufEditor::SetNonRepeatedStringField(::google::protobuf::Message* msg,
+                                               const ::google::protobuf::FieldDescriptor* field_desc) {
   if (is_not_set(msg, field_desc)) {
     if (ImGui::Button(("create " + field_desc->name()).c_str())) {
-      msg->GetReflection()->SetFloat(msg, field_desc, 0);
+      EditField(msg, field_desc, -1, [&]() { msg->GetReflection()->SetString(msg, field_desc, ""); });
     } else {
       return;
     }
   }
 
-  float val = msg->GetReflection()->GetFloat(*msg, field_desc);
-
-  std::string val_str = std::to_string(val);
-  InputText(field_desc->name(), &val_str);
-  bool removed = RemoveSimpleField(msg, field_desc, field_desc->name());
-  if (!removed) {
-    if (validate_float(val_str, &val)) {
-      msg->GetReflection()->SetFloat(msg, field_desc, val);
-    } else {
-      ImGui::Text("%s is not a valid float", val_str.c_str());
-    }
+  std::string scratch;
+  const std::string& val = msg->GetReflection()->GetStringReference(*msg, field_desc, &scratch);
+  std::string committed;
+  if (!SkippedPayload(msg, field_desc, -1, val) && InputString(field_desc->name(), field_desc, -1, val, &committed)) {
+    EditField(msg, field_desc, -1,
+              [&]() { msg->GetReflection()->SetString(msg, field_desc, std::move(committed)); });
   }
+  RemoveSimpleField(msg, field_desc, field_desc->name());
 }
 
-void ProtobufEditor::SetFloatField(::google::protobuf::Message* msg,
-                                   const ::google::protobuf::FieldDescriptor* field_desc) {
+void ProtobufEditor::SetStringField(::google::protobuf::Message* msg,
+                                    const ::google::protobuf::FieldDescriptor* field_desc) {
   if (field_desc->is_repeated()) {
-    SetRepeatedFloatField(msg, field_desc);
+    SetRepeatedStringField(msg, field_desc);
   } else {
-    SetNonRepeatedFloatField(msg, field_desc);
+    SetNonRepeatedStringField(msg, field_desc);
   }
 }
 
-void ProtobufEditor::SetRepeatedDoubleField(::google::protobuf::Message* msg,
-                                            const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (ImGui::Button(("+ " + field_desc->name()).c_str())) {
-    msg->GetReflection()->AddDouble(msg, field_desc, 0);
-    ImGui::SetNextItemOpen(true);
+void ProtobufEditor::SetNonRepeatedBytesField(::google::protobuf::Message* msg,
+                                              const ::google::protobuf::FieldDescriptor* field_desc) {
+  if (is_not_set(msg, field_desc)) {
+    if (ImGui::Button(("create " + field_desc->name()).c_str())) {
+      EditField(msg, field_desc, -1, [&]() { msg->GetReflection()->SetString(msg, field_desc, ""); });
+    } else {
+      return;
+    }
   }
-  ImGui::SameLine();
-
-  bool tree_selected = ImGui::TreeNode(field_desc->name().c_str());
-  if (tree_selected) {
-    int size = msg->GetReflection()->FieldSize(*msg, field_desc);
-    for (int k = 0; k < size; ++k) {
-      double val = msg->GetReflection()->GetRepeatedDouble(*msg, field_desc, k);
-      std::string name = field_desc->name() + std::to_string(k);
-
-      std::string val_str = std::to_string(val);
-      InputText(name, &val_str);
-      if (validate_double(val_str, &val)) {
-        ImGui::SameLine();
-
-        if (AddRemoveRepeatedField(msg, field_desc, k, size, name)) {
-          break;
-        }
-
-        msg->GetReflection()->SetRepeatedDouble(msg, field_desc, k, val);
-      } else {
-        ImGui::Text("%s is not a valid double", val_str.c_str());
-      }
-    }
-    ImGui::TreePop();
+  std::string scratch;
+  const std::string& bytes = msg->GetReflection()->GetStringReference(*msg, field_desc, &scratch);
+  if (SkippedPayload(msg, field_desc, -1, bytes)) {
+    RemoveSimpleField(msg, field_desc, field_desc->name());
+    return;
   }
-}
-
-void ProtobufEditor::SetNonRepeatedDoubleField(::google::protobuf::Message* msg,
-                                               const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (is_not_set(msg, field_desc)) {
-    if (ImGui::Button(("create " + field_desc->name()).c_str())) {
-      msg->GetReflection()->SetDouble(msg, field_desc, 0);
-    } else {
-      return;
-    }
+  std::vector<int> view_key;
+  for (const auto& step : path_) {
+    view_key.push_back(step.field_number);
+    view_key.push_back(step.index);
   }
-
-  double val = msg->GetReflection()->GetDouble(*msg, field_desc);
-  std::string val_str = std::to_string(val);
-  InputText(field_desc->name(), &val_str);
+  view_key.push_back(field_desc->number());
+  hex_views_[view_key].Draw(field_desc->name().c_str(), bytes);
   bool removed = RemoveSimpleField(msg, field_desc, field_desc->name());
   if (!removed) {
-    if (validate_double(val_str, &val)) {
-      msg->GetReflection()->SetDouble(msg, field_desc, val);
-    } else {
-      ImGui::Text("%s is not a valid double", val_str.c_str());
+    std::string& binary_file_path = embed_files_[FieldOwner("embed", field_desc)];
+    Browse(FieldOwner("embed", field_desc), &binary_file_path);
+    ImGui::SameLine();
+    bool embedding_here = embed_read_.running() && embed_field_ == field_desc->number() && same_path(embed_path_, path_);
+    if (embedding_here) {
+      ImGui::ProgressBar(embed_read_.progress(), ImVec2(200.0f, 0.0f));
+      ImGui::SameLine();
+      if (ImGui::Button("Cancel")) {
+        embed_read_.Cancel();
+      }
+    } else if (ImGui::Button("Embed")) {
+      embed_path_ = path_;
+      embed_field_ = field_desc->number();
+      bool started = regular_file_exists(binary_file_path) && embed_read_.Start(binary_file_path);
+      SetBytesNote(field_desc, started ? "" : "can't embed");
     }
-  }
-}
-
-void ProtobufEditor::SetDoubleField(::google::protobuf::Message* msg,
-                                    const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (field_desc->is_repeated()) {
-    SetRepeatedDoubleField(msg, field_desc);
-  } else {
-    SetNonRepeatedDoubleField(msg, field_desc);
-  }
-}
-
-void ProtobufEditor::AllRepeatedStringVals(::google::protobuf::Message* msg,
-                                           const ::google::protobuf::FieldDescriptor* field_desc) {
-  std::string all_vals;
-  int size = msg->GetReflection()->FieldSize(*msg, field_desc);
-  for (int k = 0; k < size; ++k) {
-    std::string val_str = msg->GetReflection()->GetRepeatedString(*msg, field_desc, k);
-    std::string name = field_desc->name() + std::to_string(k);
-
-    all_vals += val_str;
-    if (k < size - 1) {
-      all_vals += ",";
+    ImGui::SameLine();
+    std::string extract_owner = FieldOwner("extract", field_desc);
+    if (ImGui::Button("Extract to file")) {
+      file_browser_.Open(extract_owner, "Extract " + field_desc->name() + " to", field_desc->name(), true);
     }
-  }
-
-  std::vector<std::string> all_vals_vec;
-  AllValsAddRemove(msg, field_desc, &all_vals, &all_vals_vec, size);
-
-  int m = 0;
-  for (const auto& val_s : all_vals_vec) {
-    msg->GetReflection()->SetRepeatedString(msg, field_desc, m, val_s);
-    ++m;
-  }
-}
-
-void ProtobufEditor::SetRepeatedStringField(::google::protobuf::Message* msg,
-                                            const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (ImGui::Button(("+ " + field_desc->name()).c_str())) {
-    msg->GetReflection()->AddString(msg, field_desc, "");
-    ImGui::SetNextItemOpen(true);
-  }
-  ImGui::SameLine();
-
-  bool tree_selected = ImGui::TreeNode(field_desc->name().c_str());
-  if (tree_selected) {
-    int size = msg->GetReflection()->FieldSize(*msg, field_desc);
-    for (int k = 0; k < size; ++k) {
-      std::string val = msg->GetReflection()->GetRepeatedString(*msg, field_desc, k);
-      std::string name = field_desc->name() + std::to_string(k);
-      InputText(name, &val);
-
-      ImGui::SameLine();
-
-      if (AddRemoveRepeatedField(msg, field_desc, k, size, name)) {
-        break;
+    std::string extract_path;
+    if (file_browser_.Take(extract_owner, &extract_path)) {
+      bool written = write_file(extract_path, {{bytes.data(), bytes.size()}});
+      SetBytesNote(field_desc, (written ? "extracted to " : "can't write ") + extract_path);
+    }
+    ImGui::SameLine();
+    static const char* kEncodings[] = {"base64", "hex"};
+    static int encoding = 0;
+    ImGui::SetNextItemWidth(120.0f);
+    ImGui::Combo("##encoding", &encoding, kEncodings, sizeof(kEncodings) / sizeof(kEncodings[0]));
+    ImGui::SameLine();
+    if (ImGui::Button(("Copy " + field_desc->name()).c_str())) {
+      clip::set_text(encoding == 0 ? base64_encode(bytes) : hex_encode(bytes));
+    }
+    ImGui::SameLine();
+    std::string text;
+    if (ImGui::Button(("Paste " + field_desc->name()).c_str()) && clip::get_text(text)) {
+      std::string decoded;
+      if (encoding == 0 ? base64_decode(text.data(), text.data() + text.size(), &decoded)
+                        : hex_decode(text.data(), text.data() + text.size(), &decoded)) {
+        SetBytesNote(field_desc, "");
+        SetLargeBytes(msg, field_desc, std::move(decoded));
+      } else {
+        SetBytesNote(field_desc, std::string("the clipboard doesn't hold ") + kEncodings[encoding]);
       }
-
-      msg->GetReflection()->SetRepeatedString(msg, field_desc, k, val);
     }
-
-    AllRepeatedStringVals(msg, field_desc);
-
-    ImGui::TreePop();
-  }
-}
-
-void ProtobufEditor::SetNonRepeatedStringField(::google::protobuf::Message* msg,
-                                               const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (is_not_set(msg, field_desc)) {
-    if (ImGui::Button(("create " + field_desc->name()).c_str())) {
-      msg->GetReflection()->SetString(msg, field_desc, "");
-    } else {
-      return;
+    if (!bytes_note_.empty() && bytes_note_field_ == field_desc->number() && same_path(bytes_note_path_, path_)) {
+      ImGui::Text("%s", bytes_note_.c_str());
     }
   }
-
-  std::string val = msg->GetReflection()->GetString(*msg, field_desc);
-  InputText(field_desc->name(), &val);
-
-  msg->GetReflection()->SetString(msg, field_desc, val);
-  RemoveSimpleField(msg, field_desc, field_desc->name());
-}
-
-void ProtobufEditor::SetStringField(::google::protobuf::Message* msg,
-                                    const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (field_desc->is_repeated()) {
-    SetRepeatedStringField(msg, field_desc);
-  } else {
-    SetNonRepeatedStringField(msg, field_desc);
-  }
 }
 
-static void browse(std::string* out) {
-  if (ImGui::Button("Browse")) {
-    std::string path = exec("zenity --file-selection --title=\"Select a file\"");
-    if (!path.empty()) {
-      *out = path.substr(0, path.size() - 1);
-    }
-  }
+void ProtobufEditor::SetBytesNote(const ::google::protobuf::FieldDescriptor* field_desc, const std::string& note) {
+  bytes_note_ = note;
+  bytes_note_path_ = path_;
+  bytes_note_field_ = field_desc->number();
 }
 
-static std::string hex_str(const std::string& in) {
-  std::string hexstr;
-  int i = 0;
-  for (const auto& c : in) {
-    char temp[3] = {0};
-    snprintf(temp, sizeof(temp), "%02x", static_cast<uint8_t>(c));
-    hexstr += std::string(temp);
-    ++i;
-    if (i % 64 == 0) {
-      hexstr += std::string("\n");
-    }
-  }
-
-  return hexstr;
+void ProtobufEditor::FinishEmbed() {
+  if (!embed_read_.done()) {
+    return;
+  }
+  std::string data;
+  if (!embed_read_.Take(&data)) {
+    bytes_note_ = "can't embed";
+    bytes_note_path_ = embed_path_;
+    bytes_note_field_ = embed_field_;
+    return;
+  }
+  auto* msg = ResolvePath(&the_record_, embed_path_);
+  const auto* field_desc = nullptr == msg ? nullptr : msg->GetDescriptor()->FindFieldByNumber(embed_field_);
+  if (nullptr == field_desc) {
+    // the message was removed while the file was read
+    return;
+  }
+  // SetLargeBytes records the undo entry under path_
+  FieldPath current = path_;
+  path_ = embed_path_;
+  SetLargeBytes(msg, field_desc, std::move(data));
+  path_ = current;
 }
 
-void ProtobufEditor::SetNonRepeatedBytesField(::google::protobuf::Message* msg,
-                                              const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (is_not_set(msg, field_desc)) {
-    if (ImGui::Button(("create " + field_desc->name()).c_str())) {
-      msg->GetReflection()->SetString(msg, field_desc, "");
-    } else {
-      return;
-    }
-  }
-  std::string s = msg->GetReflection()->GetString(*msg, field_desc);
-
-  std::string hex = hex_str(s);
-
-  ImGui::InputTextMultiline(field_desc->name().c_str(), const_cast<char*>(hex.c_str()), ImGuiInputTextFlags_ReadOnly);
-  bool removed = RemoveSimpleField(msg, field_desc, field_desc->name());
-  if (!removed) {
-    static std::string binary_file_path;
-    browse(&binary_file_path);
-    static bool cant_embed = false;
-    if (ImGui::Button("Embed")) {
-      if (!regular_file_exists(binary_file_path)) {
-        cant_embed = true;
-      } else {
-        std::ifstream fin(binary_file_path, std::ios::binary);
-        std::ostringstream ostrm;
-        ostrm << fin.rdbuf();
-        std::string data(ostrm.str());
-        msg->GetReflection()->SetString(msg, field_desc, data);
-        cant_embed = false;
-      }
-    }
-    if (cant_embed) {
-      ImGui::Text("can't embed");
-    }
-  }
+void ProtobufEditor::SetLargeBytes(::google::protobuf::Message* msg,
+                                   const ::google::protobuf::FieldDescriptor* field_desc, std::string data) {
+  auto* reflection = msg->GetReflection();
+  std::string scratch;
+  size_t before =
+      reflection->HasField(*msg, field_desc) ? reflection->GetStringReference(*msg, field_desc, &scratch).size() : 0;
+  if (before + data.size() <= undo_.memory_cap()) {
+    EditField(msg, field_desc, -1, [&]() { reflection->SetString(msg, field_desc, std::move(data)); });
+    return;
+  }
+  reflection->SetString(msg, field_desc, std::move(data));
+  undo_.RecordUntracked();
+  OnEdit(path_, field_desc->number());
+  SetBytesNote(field_desc, "too large to undo, the edits before it still can be");
 }
 
 void ProtobufEditor::SetBytesField(::google::protobuf::Message* msg,
@@ -923,18 +1036,18 @@ void ProtobufEditor::SetBytesField(::google::protobuf::Message* msg,
   }
 }
 
-bool ProtobufEditor::SetNonRepeatedMessage(::google::protobuf::Message* msg,
-                                           const ::google::protobuf::FieldDescriptor* field_desc) {
+::google::protobuf::Message* ProtobufEditor::SetNonRepeatedMessage(
+    ::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc) {
   bool tree_selected = false;
   if (is_not_set(msg, field_desc)) {
     if (ImGui::Button(("create " + field_desc->name()).c_str())) {
+      EditField(msg, field_desc, -1, [&]() { msg->GetReflection()->MutableMessage(msg, field_desc); });
       tree_selected = true;
     } else {
-      return true;
+      return nullptr;
     }
   }
   auto* field_msg = msg->GetReflection()->MutableMessage(msg, field_desc);
-  auto* field_desc2 = field_msg->GetDescriptor();
 
   std::string name = field_desc->name();
   if (tree_selected) {
@@ -944,22 +1057,18 @@ bool ProtobufEditor::SetNonRepeatedMessage(::google::protobuf::Message* msg,
   if (!tree_selected) {
     tree_selected = temp_tree_selected;
   }
+  SizeAnnotation(field_desc->number());
   ImGui::SameLine();
 
-  if (tree_selected) {
-    if (AddRemoveField(msg, field_desc, name)) {
-      ImGui::TreePop();
-    } else {
-      if (!Tree(field_msg)) {
-        return false;
-      }
-      ImGui::TreePop();
-    }
-  } else {
+  if (!tree_selected) {
     AddRemoveField(msg, field_desc, name);
+    return nullptr;
   }
-
-  return true;
+  if (AddRemoveField(msg, field_desc, name)) {
+    ImGui::TreePop();
+    return nullptr;
+  }
+  return field_msg;
 }
 
 bool ProtobufEditor::IsSet(const ::google::protobuf::Message& msg,
@@ -991,99 +1100,157 @@ bool ProtobufEditor::SelectRepeatedMessage(::google::protobuf::Message* msg,
 }
 
 bool ProtobufEditor::SetRepeatedMessage(::google::protobuf::Message* msg,
-                                        const ::google::protobuf::FieldDescriptor* field_desc) {
+                                        const ::google::protobuf::FieldDescriptor* field_desc, bool* open) {
   if (ImGui::Button(("+ " + field_desc->name()).c_str())) {
-    if (!SelectRepeatedMessage(msg, field_desc)) {
+    bool ok = true;
+    AddElement(msg, field_desc, [&]() { ok = SelectRepeatedMessage(msg, field_desc); });
+    if (!ok) {
       return false;
     }
     ImGui::SetNextItemOpen(true);
   }
   ImGui::SameLine();
 
-  bool tree_selected = ImGui::TreeNode(field_desc->name().c_str());
-  if (tree_selected) {
-    int size = msg->GetReflection()->FieldSize(*msg, field_desc);
-    for (int k = 0; k < size; ++k) {
-      auto* field_msg = msg->GetReflection()->MutableRepeatedMessage(msg, field_desc, k);
-      std::string name = field_desc->name() + std::to_string(k);
-      bool tree_selected2 = ImGui::TreeNode(name.c_str());
-      ImGui::SameLine();
-      if (tree_selected2) {
-        if (AddRemoveRepeatedField(msg, field_desc, k, size, name)) {
-          ImGui::TreePop();
-          break;
-        }
+  *open = ImGui::TreeNode(field_desc->name().c_str());
+  SizeAnnotation(field_desc->number());
+  return true;
+}
 
-        if (!Tree(field_msg)) {
-          return false;
-        }
-        ImGui::TreePop();
-      } else {
-        if (AddRemoveRepeatedField(msg, field_desc, k, size, name)) {
-          break;
-        }
+bool ProtobufEditor::LazyRepeatedMessage(int field_number) {
+  static const float kListHeight = 300.0f;
+  LazyElements* lazy = lazy_[field_number].get();
+  const auto* field_desc = lazy->field_desc();
+  bool open = ImGui::TreeNode(field_desc->name().c_str());
+  ImGui::SameLine();
+  ImGui::TextDisabled("(%s items, %s wire, parsed as shown, %zu edited)", human_count(lazy->size()).c_str(),
+                      human_bytes(lazy->wire_size()).c_str(), lazy->edited_count());
+  if (!open) {
+    return true;
+  }
+  if (ImGui::Button("Load all to edit")) {
+    // nothing is added if an element doesn't parse, so the field stays indexed and is still saved from the file
+    if (!lazy->Materialize(&the_record_)) {
+      PBE_LOG_ERROR("can't parse the elements of %s\n", field_desc->name().c_str());
+      lazy_error_ = "can't parse all the elements of " + field_desc->name() + ", they stay in the file";
+    } else {
+      lazy_error_.clear();
+      lazy_.erase(field_number);
+      lazy_selected_.erase(field_number);
+      if (lazy_.empty() && !projected_) {
+        document_file_.Close();
       }
+      sizes_.Invalidate(FieldPath(), field_number);
+      required_.Update(&the_record_, FieldPath(), field_number);
+      ImGui::TreePop();
+      return true;
     }
-    ImGui::TreePop();
   }
-  return true;
-}
+  if (!lazy_error_.empty()) {
+    ImGui::TextWrapped("%s", lazy_error_.c_str());
+  }
 
-bool ProtobufEditor::SetMessageField(::google::protobuf::Message* msg,
-                                     const ::google::protobuf::FieldDescriptor* field_desc) {
-  if (field_desc->is_repeated()) {
-    if (!SetRepeatedMessage(msg, field_desc)) {
-      return false;
+  auto selected = lazy_selected_.find(field_number);
+  int size = static_cast<int>(lazy->size());
+  ImGui::BeginChild("elements", ImVec2(0.0f, kListHeight), true);
+  ImGuiListClipper clipper;
+  clipper.Begin(size);
+  while (clipper.Step()) {
+    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+      const auto* element = lazy->Get(static_cast<size_t>(row));
+      std::string label = field_desc->name() + std::to_string(row) + "  " +
+                          (nullptr == element ? "(doesn't parse)" : string_preview(element->ShortDebugString()));
+      bool is_selected = selected != lazy_selected_.end() && selected->second == row;
+      if (ImGui::Selectable(label.c_str(), is_selected)) {
+        lazy_selected_[field_number] = row;
+      }
     }
-  } else {
-    if (!SetNonRepeatedMessage(msg, field_desc)) {
-      return false;
+  }
+  ImGui::EndChild();
+  bool ok = true;
+  if (selected != lazy_selected_.end()) {
+    // edited in place like a parsed element, OnEdit() keeps it
+    int ind = selected->second;
+    auto* element = lazy->Get(static_cast<size_t>(ind));
+    if (nullptr != element) {
+      std::string name = field_desc->name() + std::to_string(ind);
+      path_.push_back({field_number, ind});
+      ImGui::SetNextItemOpen(true, ImGuiCond_Once);
+      if (ImGui::TreeNode(name.c_str())) {
+        ok = Tree(element);
+        ImGui::TreePop();
+      }
+      path_.pop_back();
+    } else {
+      ImGui::TextDisabled("%s%d doesn't parse", field_desc->name().c_str(), ind);
     }
   }
-  return true;
+  ImGui::TreePop();
+  return ok;
+}
+
+::google::protobuf::Message* ProtobufEditor::SetRepeatedMessageElement(
+    ::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc, int ind,
+    bool* removed) {
+  auto* field_msg = msg->GetReflection()->MutableRepeatedMessage(msg, field_desc, ind);
+  std::string name = field_desc->name() + std::to_string(ind);
+  bool tree_selected = ImGui::TreeNode(name.c_str());
+  ImGui::SameLine();
+  *removed = AddRemoveRepeatedField(msg, field_desc, ind, name);
+  if (!tree_selected) {
+    return nullptr;
+  }
+  if (*removed) {
+    ImGui::TreePop();
+    return nullptr;
+  }
+  return field_msg;
 }
 
 bool ProtobufEditor::SetFields(::google::protobuf::Message* msg,
                                const ::google::protobuf::FieldDescriptor* field_desc) {
-  switch (field_desc->type()) {
-    case ::google::protobuf::FieldDescriptor::TYPE_UINT32: {
-      SetUintField(msg, field_desc);
+  switch (field_desc->cpp_type()) {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT32: {
+      SetScalarField<int32_t>(msg, field_desc);
       break;
     }
-    case ::google::protobuf::FieldDescriptor::TYPE_SINT32:
-      /* FALLTHROUGH */
-    case ::google::protobuf::FieldDescriptor::TYPE_INT32: {
-      SetIntField(msg, field_desc);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT64: {
+      SetScalarField<int64_t>(msg, field_desc);
       break;
     }
-    case ::google::protobuf::FieldDescriptor::TYPE_FLOAT: {
-      SetFloatField(msg, field_desc);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32: {
+      SetScalarField<uint32_t>(msg, field_desc);
       break;
     }
-    case ::google::protobuf::FieldDescriptor::TYPE_DOUBLE: {
-      SetDoubleField(msg, field_desc);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64: {
+      SetScalarField<uint64_t>(msg, field_desc);
       break;
     }
-    case ::google::protobuf::FieldDescriptor::TYPE_BOOL: {
-      SetBoolField(msg, field_desc);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_FLOAT: {
+      SetScalarField<float>(msg, field_desc);
       break;
     }
-    case ::google::protobuf::FieldDescriptor::TYPE_ENUM: {
-      SetEnumField(msg, field_desc);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE: {
+      SetScalarField<double>(msg, field_desc);
       break;
     }
-    case ::google::protobuf::FieldDescriptor::TYPE_STRING: {
-      SetStringField(msg, field_desc);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL: {
+      SetScalarField<bool>(msg, field_desc);
       break;
     }
-    case ::google::protobuf::FieldDescriptor::TYPE_MESSAGE: {
-      if (!SetMessageField(msg, field_desc)) {
-        return false;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_ENUM: {
+      SetEnumField(msg, field_desc);
+      break;
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_STRING: {
+      if (field_desc->type() == ::google::protobuf::FieldDescriptor::TYPE_BYTES) {
+        SetBytesField(msg, field_desc);
+      } else {
+        SetStringField(msg, field_desc);
       }
       break;
     }
-    case ::google::protobuf::FieldDescriptor::TYPE_BYTES: {
-      SetBytesField(msg, field_desc);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE: {
+      // drawn by Tree(), which keeps the open messages on its own stack
       break;
     }
     default: {
@@ -1095,16 +1262,99 @@ bool ProtobufEditor::SetFields(::google::protobuf::Message* msg,
   return true;
 }
 
+// Message levels drawn below the top of the tree. Deeper messages get a button that moves tree_root_ to them, so
+// the indentation and the ImGui tree stack stay bounded however deep the document is.
+static const size_t kMaxTreeDepth = 12;
+
+// A message whose fields Tree() is in the middle of drawing, or a repeated message field whose elements it is.
+struct TreeVisit {
+  ::google::protobuf::Message* msg;
+  // nullptr while drawing the fields of |msg|
+  const ::google::protobuf::FieldDescriptor* field_desc;
+  // the next field or element to draw
+  int next;
+};
+
 bool ProtobufEditor::Tree(::google::protobuf::Message* msg) {
-  auto* desc = msg->GetDescriptor();
+  size_t top_depth = path_.size();
+  std::vector<TreeVisit> visits = {{msg, nullptr, 0}};
+  bool ok = true;
+  while (ok && !visits.empty()) {
+    TreeVisit& visit = visits.back();
+    ::google::protobuf::Message* field_msg = nullptr;
+    PathStep step = {0, -1};
+    if (nullptr == visit.field_desc) {
+      auto* desc = visit.msg->GetDescriptor();
+      if (visit.next == desc->field_count()) {
+        visits.pop_back();
+        // the node of |msg| itself belongs to the caller
+        if (!visits.empty()) {
+          path_.pop_back();
+          ImGui::TreePop();
+        }
+        continue;
+      }
+      auto* field_desc = desc->field(visit.next++);
+      if (field_desc->cpp_type() != ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+        ok = SetFields(visit.msg, field_desc);
+        continue;
+      }
+      if (visit.msg == &the_record_ && lazy_.count(field_desc->number()) > 0) {
+        ok = LazyRepeatedMessage(field_desc->number());
+        continue;
+      }
+      if (field_desc->is_repeated()) {
+        bool open = false;
+        ok = SetRepeatedMessage(visit.msg, field_desc, &open);
+        if (open) {
+          visits.push_back({visit.msg, field_desc, 0});
+        }
+        continue;
+      }
+      field_msg = SetNonRepeatedMessage(visit.msg, field_desc);
+      step.field_number = field_desc->number();
+    } else {
+      int ind = visit.next++;
+      if (ind >= visit.msg->GetReflection()->FieldSize(*visit.msg, visit.field_desc)) {
+        ImGui::TreePop();
+        visits.pop_back();
+        continue;
+      }
+      bool removed = false;
+      field_msg = SetRepeatedMessageElement(visit.msg, visit.field_desc, ind, &removed);
+      if (removed) {
+        // the elements after it moved, draw them from the next frame on
+        visit.next = visit.msg->GetReflection()->FieldSize(*visit.msg, visit.field_desc);
+      }
+      step = {visit.field_desc->number(), ind};
+    }
+    if (nullptr == field_msg) {
+      continue;
+    }
 
-  for (int i = 0; i < desc->field_count(); ++i) {
-    auto* field_desc = desc->field(i);
-    if (!SetFields(msg, field_desc)) {
-      return false;
+    path_.push_back(step);
+    if (path_.size() - top_depth > kMaxTreeDepth) {
+      ImGui::TextDisabled("%zu levels deep", path_.size() - top_depth);
+      ImGui::SameLine();
+      if (ImGui::Button("Show from here")) {
+        tree_root_ = path_;
+      }
+      path_.pop_back();
+      ImGui::TreePop();
+      continue;
     }
+    visits.push_back({field_msg, nullptr, 0});
   }
-  return true;
+
+  // on an error, close what is still open
+  while (visits.size() > 1) {
+    if (nullptr == visits.back().field_desc) {
+      path_.pop_back();
+    }
+    ImGui::TreePop();
+    visits.pop_back();
+  }
+  return ok;
 }
 
 void ProtobufEditor::WantToClose(bool* tried_to_load) {
@@ -1121,6 +1371,19 @@ void ProtobufEditor::WantToClose(bool* tried_to_load) {
 
       *tried_to_load = false;
       want_to_close = false;
+      undo_.Clear();
+      sizes_.Clear();
+      tree_root_.clear();
+      // the record of a lazy or projected load is incomplete without its mapping, so it goes with it
+      if (projected_ || !lazy_.empty()) {
+        the_record_.Clear();
+      }
+      lazy_.clear();
+      lazy_selected_.clear();
+      lazy_error_.clear();
+      projected_ = false;
+      document_file_.Close();
+      required_.Clear();
     }
     ImGui::SameLine();
     if (ImGui::Button("No")) {
@@ -1130,15 +1393,52 @@ void ProtobufEditor::WantToClose(bool* tried_to_load) {
 }
 
 void ProtobufEditor::Save(bool* cant_save, std::string* error_str, const std::string& path) {
+  // required_ is kept up to date by every edit, so refusing doesn't walk the document
+  if (required_.missing() > 0) {
+    *error_str = human_count(required_.missing()) + " required fields are unset, see Problems";
+    *cant_save = true;
+    return;
+  }
+  if (!lazy_.empty() || projected_) {
+    // only the edited elements of lazy_ are encoded, the others and the skipped payloads are copied from the
+    // mapping of document_file_, so it is replaced only once all is written
+    std::deque<std::string> encoded;
+    std::vector<WriteBuffer> buffers;
+    if (!projected_) {
+      serialize_parallel(&the_record_, &encoded, &buffers);
+    } else {
+      encoded.emplace_back();
+      if (!serialize_unskipped(the_record_, document_file_, &encoded.back())) {
+        *error_str = "can't put the skipped payloads back";
+        *cant_save = true;
+        return;
+      }
+      buffers.push_back({encoded.back().data(), encoded.back().size()});
+    }
+    for (const auto& field : lazy_) {
+      field.second->AppendWire(&buffers, &encoded);
+    }
+    std::string temp_path = path + ".saving";
+    if (!write_file(temp_path, buffers) || rename(temp_path.c_str(), path.c_str()) != 0) {
+      unlink(temp_path.c_str());
+      *error_str = "can't write " + path;
+      *cant_save = true;
+      return;
+    }
+    *cant_save = false;
+    error_str->clear();
+    return;
+  }
   try {
-    size_t size = the_record_.ByteSizeLong();
-    char* arr = new char[size];
-    the_record_.SerializeToArray(arr, size);
-
-    std::ofstream output(path, std::ios::out | std::ios::trunc | std::ios::binary);
-    output.write(arr, static_cast<std::streamsize>(size));
-    delete[] arr;
-    output.close();
+    // the large repeated fields are encoded in chunks on the worker threads, and the chunks written in one writev
+    std::deque<std::string> encoded;
+    std::vector<WriteBuffer> buffers;
+    serialize_parallel(&the_record_, &encoded, &buffers);
+    if (!write_file(path, buffers)) {
+      *error_str = "can't write " + path;
+      *cant_save = true;
+      return;
+    }
 
     *cant_save = false;
     error_str->clear();
@@ -1148,19 +1448,56 @@ void ProtobufEditor::Save(bool* cant_save, std::string* error_str, const std::st
   }
 }
 
+void ProtobufEditor::UndoRedo() {
+  auto* msg = static_cast<::google::protobuf::Message*>(&the_record_);
+  const ImGuiIO& io = ImGui::GetIO();
+  bool shortcuts = io.KeyCtrl && !io.WantTextInput;
+
+  ImGui::BeginDisabled(!undo_.CanUndo());
+  FieldPath path;
+  int field_number = 0;
+  if (ImGui::Button("Undo") || (shortcuts && ImGui::IsKeyPressed(ImGuiKey_Z))) {
+    if (undo_.Undo(msg, &path, &field_number)) {
+      OnEdit(path, field_number);
+    } else {
+      sizes_.Clear();
+      required_.Build(the_record_);
+    }
+  }
+  ImGui::EndDisabled();
+  ImGui::SameLine();
+  ImGui::BeginDisabled(!undo_.CanRedo());
+  if (ImGui::Button("Redo") || (shortcuts && ImGui::IsKeyPressed(ImGuiKey_Y))) {
+    if (undo_.Redo(msg, &path, &field_number)) {
+      OnEdit(path, field_number);
+    } else {
+      sizes_.Clear();
+      required_.Build(the_record_);
+    }
+  }
+  ImGui::EndDisabled();
+
+  ImGui::SameLine();
+  int cap_mb = static_cast<int>(undo_.memory_cap() >> 20);
+  ImGui::SetNextItemWidth(200);
+  if (ImGui::InputInt("undo memory (MB)", &cap_mb) && cap_mb >= 0) {
+    undo_.set_memory_cap(static_cast<size_t>(cap_mb) << 20);
+  }
+  ImGui::SameLine();
+  ImGui::Text("%.1f MB used", static_cast<double>(undo_.memory_used()) / (1 << 20));
+}
+
 void ProtobufEditor::SaveFile(bool* cant_save, std::string* error_str) {
   if (ImGui::Button("Save")) {
     Save(cant_save, error_str, file_path_);
   }
   if (ImGui::Button("Save As")) {
-    std::string cmd =
-        "zenity --file-selection --save --title=\"Select a path to save the file\" --filename=" + file_path_;
-    std::string path = exec(cmd.c_str());
-    if (!path.empty()) {
-      path = path.substr(0, path.size() - 1);
-      Save(cant_save, error_str, path);
-      file_path_ = path;
-    }
+    file_browser_.Open("save as", "Select a path to save the file", file_path_, true);
+  }
+  std::string path;
+  if (file_browser_.Take("save as", &path)) {
+    Save(cant_save, error_str, path);
+    file_path_ = path;
   }
 }
 
@@ -1181,52 +1518,783 @@ bool ProtobufEditor::SelectFieldsToAdd(::google::protobuf::Message* msg) {
   return true;
 }
 
+void ProtobufEditor::RebuildDiffRows() {
+  diff_rows_.clear();
+  int hidden_below = INT32_MAX;
+  for (size_t i = 0; i < diff_.entries.size(); ++i) {
+    const auto& entry = diff_.entries[i];
+    if (entry.depth > hidden_below) {
+      continue;
+    }
+    hidden_below = INT32_MAX;
+    diff_rows_.push_back(i);
+    if (entry.is_message && diff_collapsed_[i]) {
+      hidden_below = entry.depth;
+    }
+  }
+}
+
+void ProtobufEditor::DiffWindow() {
+  static bool cant_compare = false;
+
+  ImGui::Begin("diff", &show_diff_);
+  Browse("diff", &diff_path_);
+  ImGui::SameLine();
+  InputText("compare with", &diff_path_);
+  ImGui::SetNextItemWidth(300);
+  ImGui::InputText("key field", &diff_options_.key_field);
+  ImGui::SameLine();
+  // the elements of lazy_ are not in the_record_, which would be compared as if it lacked them, and skipped
+  // payloads would be compared by their placeholders
+  ImGui::BeginDisabled(!lazy_.empty() || projected_);
+  if (ImGui::Button("Compare")) {
+    diff_record_.Clear();
+    cant_compare = !read_file(diff_path_, &diff_record_);
+    if (!cant_compare) {
+      diff_messages(the_record_, diff_record_, diff_options_, &diff_);
+      diff_collapsed_.assign(diff_.entries.size(), false);
+      RebuildDiffRows();
+    }
+  }
+  ImGui::EndDisabled();
+  if (!lazy_.empty()) {
+    ImGui::TextWrapped("large fields are left in the file, \"Load all to edit\" them to compare");
+  }
+  if (projected_) {
+    ImGui::TextWrapped("payloads are left in the file as placeholders, load it without a mask to compare");
+  }
+  if (cant_compare) {
+    ImGui::Text("can't load %s", diff_path_.c_str());
+  }
+  ImGui::Text("%zu differences%s, %zu identical subtrees skipped", diff_.entries.size(),
+              diff_.truncated ? " (truncated)" : "", diff_.skipped_subtrees);
+
+  if (ImGui::BeginTable("diff table", 3,
+                        ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY |
+                            ImGuiTableFlags_Resizable)) {
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("field");
+    ImGui::TableSetupColumn("current");
+    ImGui::TableSetupColumn(diff_path_.c_str());
+    ImGui::TableHeadersRow();
+
+    // only the rows on screen are drawn
+    bool rebuild = false;
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(diff_rows_.size()));
+    while (clipper.Step()) {
+      for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+        size_t i = diff_rows_[static_cast<size_t>(row)];
+        const auto& entry = diff_.entries[i];
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::PushID(static_cast<int>(i));
+        float indent = static_cast<float>(entry.depth) * 20.0f;
+        if (entry.depth > 0) {
+          ImGui::Indent(indent);
+        }
+        ImVec4 color = entry.kind == DiffEntry::Kind::kAdded     ? ImVec4(0.4f, 1.0f, 0.4f, 1.0f)
+                       : entry.kind == DiffEntry::Kind::kRemoved ? ImVec4(1.0f, 0.4f, 0.4f, 1.0f)
+                                                                 : ImVec4(1.0f, 0.9f, 0.4f, 1.0f);
+        ImGui::PushStyleColor(ImGuiCol_Text, color);
+        if (entry.is_message) {
+          ImGui::SetNextItemOpen(!diff_collapsed_[i]);
+          bool open = ImGui::TreeNodeEx(entry.name.c_str(), ImGuiTreeNodeFlags_NoTreePushOnOpen);
+          if (open == diff_collapsed_[i]) {
+            diff_collapsed_[i] = !open;
+            rebuild = true;
+          }
+        } else {
+          ImGui::TreeNodeEx(entry.name.c_str(), ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen);
+        }
+        ImGui::PopStyleColor();
+        if (entry.depth > 0) {
+          ImGui::Unindent(indent);
+        }
+        ImGui::PopID();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(entry.left.c_str());
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(entry.right.c_str());
+      }
+    }
+    ImGui::EndTable();
+    if (rebuild) {
+      RebuildDiffRows();
+    }
+  }
+  ImGui::End();
+}
+
+void ProtobufEditor::SizeAnnotation(int field_number) {
+  // sizes_ measures the_record_, which the elements of lazy_ are not in
+  if (!annotate_sizes_ || (!path_.empty() && lazy_.count(path_[0].field_number) > 0)) {
+    return;
+  }
+  SubtreeSize size;
+  bool stale = false;
+  ImGui::SameLine();
+  if (sizes_.Lookup(path_, field_number, &size, &stale)) {
+    ImGui::TextDisabled("(%s items, %s wire, %s RAM%s)", human_count(size.items).c_str(),
+                        human_bytes(size.wire).c_str(), human_bytes(size.ram).c_str(), stale ? ", updating" : "");
+  } else {
+    ImGui::TextDisabled("(measuring)");
+  }
+}
+
+void ProtobufEditor::PreviewWindow() {
+  ImGui::Begin("preview", &show_preview_);
+  if (preview_future_.valid()) {
+    if (preview_future_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      ImGui::Text("scanning %s", preview_path_.c_str());
+      ImGui::End();
+      return;
+    }
+    preview_ = preview_future_.get();
+  }
+  if (!preview_ok_) {
+    ImGui::Text("can't open %s", preview_path_.c_str());
+    ImGui::End();
+    return;
+  }
+
+  ImGui::Text("%s: %s on disk, about %s in memory, %s available", preview_path_.c_str(),
+              human_bytes(preview_.size).c_str(), human_bytes(preview_.ram).c_str(),
+              human_bytes(available_memory()).c_str());
+  if (preview_.damaged) {
+    ImGui::Text("malformed from offset %s on", std::to_string(preview_.damage_offset).c_str());
+  }
+  if (ImGui::BeginTable("fields", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable)) {
+    ImGui::TableSetupColumn("field");
+    ImGui::TableSetupColumn("items");
+    ImGui::TableSetupColumn("wire");
+    ImGui::TableSetupColumn("RAM");
+    ImGui::TableHeadersRow();
+    for (const auto& field : preview_.fields) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      if (nullptr != field.field_desc) {
+        ImGui::Text("%s", field.field_desc->name().c_str());
+      } else {
+        ImGui::TextDisabled("unknown %u", field.field_number);
+      }
+      ImGui::TableNextColumn();
+      ImGui::Text("%s", human_count(field.items).c_str());
+      ImGui::TableNextColumn();
+      ImGui::Text("%s", human_bytes(field.wire).c_str());
+      ImGui::TableNextColumn();
+      ImGui::Text("%s", human_bytes(field.ram).c_str());
+    }
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+
+void ProtobufEditor::AggregateWindow() {
+  ImGui::Begin("aggregate", &show_aggregate_);
+  InputText("messages", &aggregate_selection_);
+  InputText("value", &aggregate_value_);
+  InputText("group by", &aggregate_key_);
+  // the elements of lazy_ are not in the_record_, so nothing in them would be counted, and skipped payloads
+  // would be counted by their placeholders
+  ImGui::BeginDisabled(!lazy_.empty() || projected_);
+  bool run = ImGui::Button("Run");
+  ImGui::EndDisabled();
+  if (!lazy_.empty()) {
+    ImGui::TextWrapped("large fields are left in the file, \"Load all to edit\" them to aggregate");
+  }
+  if (projected_) {
+    ImGui::TextWrapped("payloads are left in the file as placeholders, load it without a mask to aggregate");
+  }
+  if (run) {
+    aggregate_result_.clear();
+    aggregate_error_.clear();
+    if (parse_aggregate(the_record_.GetDescriptor(), aggregate_selection_, aggregate_value_, aggregate_key_,
+                        &aggregate_)) {
+      aggregate_message(aggregate_, the_record_, &aggregate_result_);
+    } else {
+      aggregate_error_ = "can't aggregate, see the log";
+    }
+  }
+  if (!aggregate_error_.empty()) {
+    ImGui::Text("%s", aggregate_error_.c_str());
+  }
+
+  bool numeric = aggregate_is_numeric(aggregate_);
+  bool has_value = !aggregate_.value_fields.empty();
+  int columns = has_value ? (numeric ? 7 : 4) : 2;
+  if (!aggregate_result_.empty() &&
+      ImGui::BeginTable("groups", columns, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable)) {
+    ImGui::TableSetupColumn("group");
+    ImGui::TableSetupColumn("count");
+    if (has_value) {
+      ImGui::TableSetupColumn("values");
+      if (numeric) {
+        ImGui::TableSetupColumn("sum");
+        ImGui::TableSetupColumn("min");
+        ImGui::TableSetupColumn("max");
+      }
+      ImGui::TableSetupColumn("distinct");
+    }
+    ImGui::TableHeadersRow();
+    char buf[kMaxNumberLength + 1];
+    for (const auto& group : aggregate_result_) {
+      const AggregateStats& stats = group.second;
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(group.first.c_str());
+      ImGui::TableNextColumn();
+      ImGui::Text("%s", std::to_string(stats.count).c_str());
+      if (!has_value) {
+        continue;
+      }
+      ImGui::TableNextColumn();
+      ImGui::Text("%s", std::to_string(stats.values).c_str());
+      if (numeric) {
+        for (double val : {stats.sum, stats.min, stats.max}) {
+          ImGui::TableNextColumn();
+          if (stats.values > 0) {
+            *format_number(val, buf) = '\0';
+            ImGui::TextUnformatted(buf);
+          }
+        }
+      }
+      ImGui::TableNextColumn();
+      ImGui::Text("%s", std::to_string(stats.distinct.size()).c_str());
+    }
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+
+void ProtobufEditor::ProblemsWindow() {
+  static const size_t kMaxProblemsShown = 1000;
+
+  ImGui::Begin("problems", &show_problems_);
+  if (required_.missing() == 0) {
+    ImGui::Text("all required fields are set");
+  } else {
+    ImGui::Text("%s required fields are unset, save is refused until they are set",
+                human_count(required_.missing()).c_str());
+  }
+  if (!lazy_.empty()) {
+    ImGui::TextDisabled("elements left in the file are checked once edited");
+  }
+  std::vector<RequiredCheck::Problem> problems;
+  required_.List(kMaxProblemsShown, &problems);
+  for (size_t i = 0; i < problems.size(); ++i) {
+    const auto& problem = problems[i];
+    std::string label = path_to_string(the_record_.GetDescriptor(), problem.path);
+    label += (label.empty() ? "" : ".") + problem.field_desc->name();
+    ImGui::PushID(static_cast<int>(i));
+    // shows the message with the unset field at the top of the tree
+    if (ImGui::Selectable(label.c_str())) {
+      tree_root_ = problem.path;
+    }
+    ImGui::PopID();
+  }
+  if (problems.size() < required_.missing()) {
+    ImGui::TextDisabled("and %s more", human_count(required_.missing() - problems.size()).c_str());
+  }
+  ImGui::End();
+}
+
+void ProtobufEditor::SizesWindow() {
+  static const int kMaxTreemapElements = 512;
+  static const ImU32 kColors[] = {IM_COL32(141, 211, 199, 255), IM_COL32(255, 255, 179, 255),
+                                  IM_COL32(190, 186, 218, 255), IM_COL32(251, 128, 114, 255),
+                                  IM_COL32(128, 177, 211, 255), IM_COL32(253, 180, 98, 255),
+                                  IM_COL32(179, 222, 105, 255), IM_COL32(252, 205, 229, 255)};
+
+  struct Item {
+    std::string label;
+    FieldPath path;
+    int field_number;
+    const ::google::protobuf::FieldDescriptor* field_desc;  // nullptr for an element of a repeated field
+    SubtreeSize size;
+    bool known;
+  };
+
+  ImGui::Begin("sizes", &show_sizes_);
+  ImGui::RadioButton("wire", &sizes_metric_, 0);
+  ImGui::SameLine();
+  ImGui::RadioButton("RAM", &sizes_metric_, 1);
+  ImGui::SameLine();
+  ImGui::Checkbox("annotate tree", &annotate_sizes_);
+
+  // breadcrumbs
+  auto* root = static_cast<::google::protobuf::Message*>(&the_record_);
+  const auto* desc = root->GetDescriptor();
+  if (ImGui::Button(desc->name().c_str())) {
+    sizes_focus_.clear();
+    sizes_focus_field_ = 0;
+  }
+  for (size_t i = 0; i < sizes_focus_.size() && nullptr != desc; ++i) {
+    const auto* field_desc = desc->FindFieldByNumber(sizes_focus_[i].field_number);
+    if (nullptr == field_desc) {
+      break;
+    }
+    std::string label = field_desc->name();
+    if (sizes_focus_[i].index >= 0) {
+      label += "[" + std::to_string(sizes_focus_[i].index) + "]";
+    }
+    ImGui::SameLine();
+    ImGui::Text(">");
+    ImGui::SameLine();
+    ImGui::PushID(static_cast<int>(i));
+    bool clicked = ImGui::Button(label.c_str());
+    ImGui::PopID();
+    if (clicked) {
+      sizes_focus_.resize(i + 1);
+      sizes_focus_field_ = 0;
+      break;
+    }
+    desc = field_desc->message_type();
+  }
+
+  auto* msg = resolve_path(root, sizes_focus_);
+  const ::google::protobuf::FieldDescriptor* focus_field_desc =
+      nullptr == msg ? nullptr : msg->GetDescriptor()->FindFieldByNumber(sizes_focus_field_);
+  if (nullptr == msg || (sizes_focus_field_ != 0 && nullptr == focus_field_desc)) {
+    // the focused subtree was removed
+    sizes_focus_.clear();
+    sizes_focus_field_ = 0;
+    ImGui::End();
+    return;
+  }
+
+  std::vector<Item> items;
+  if (nullptr == focus_field_desc) {
+    for (int i = 0; i < msg->GetDescriptor()->field_count(); ++i) {
+      const auto* field_desc = msg->GetDescriptor()->field(i);
+      items.push_back({field_desc->name(), sizes_focus_, field_desc->number(), field_desc, SubtreeSize(), false});
+    }
+  } else {
+    ImGui::SameLine();
+    ImGui::Text("> %s", focus_field_desc->name().c_str());
+    int size = msg->GetReflection()->FieldSize(*msg, focus_field_desc);
+    if (size > kMaxTreemapElements) {
+      ImGui::Text("showing the first %d of %d elements", kMaxTreemapElements, size);
+    }
+    for (int k = 0; k < std::min(size, kMaxTreemapElements); ++k) {
+      FieldPath path = sizes_focus_;
+      path.push_back({sizes_focus_field_, k});
+      items.push_back({focus_field_desc->name() + "[" + std::to_string(k) + "]", path, SizeCache::kWholeMessage,
+                       nullptr, SubtreeSize(), false});
+    }
+  }
+
+  size_t computing = 0;
+  std::vector<double> values(items.size());
+  for (size_t i = 0; i < items.size(); ++i) {
+    items[i].known = sizes_.Lookup(items[i].path, items[i].field_number, &items[i].size);
+    if (!items[i].known) {
+      ++computing;
+    }
+    values[i] = static_cast<double>(sizes_metric_ == 0 ? items[i].size.wire : items[i].size.ram);
+  }
+  if (computing > 0) {
+    ImGui::Text("measuring %zu of %zu...", computing, items.size());
+  }
+
+  ImVec2 origin = ImGui::GetCursorScreenPos();
+  ImVec2 avail = ImGui::GetContentRegionAvail();
+  avail.x = std::max(avail.x, 100.0f);
+  avail.y = std::max(avail.y, 100.0f);
+  ImGui::InvisibleButton("treemap", avail);
+  bool hovered = ImGui::IsItemHovered();
+  bool clicked = ImGui::IsItemClicked();
+
+  std::vector<TreemapRect> rects;
+  squarify(values, origin.x, origin.y, avail.x, avail.y, &rects);
+  ImDrawList* draw_list = ImGui::GetWindowDrawList();
+  const ImVec2 mouse = ImGui::GetIO().MousePos;
+  const Item* drill = nullptr;
+  for (const auto& rect : rects) {
+    const Item& item = items[rect.index];
+    ImVec2 top_left(rect.x, rect.y);
+    ImVec2 bottom_right(rect.x + rect.w, rect.y + rect.h);
+    draw_list->AddRectFilled(top_left, bottom_right, kColors[rect.index % (sizeof(kColors) / sizeof(kColors[0]))]);
+    draw_list->AddRect(top_left, bottom_right, IM_COL32(0, 0, 0, 255));
+    ImVec2 text_size = ImGui::CalcTextSize(item.label.c_str());
+    if (text_size.x + 4 < rect.w && text_size.y + 4 < rect.h) {
+      draw_list->AddText(ImVec2(rect.x + 2, rect.y + 2), IM_COL32(0, 0, 0, 255), item.label.c_str());
+    }
+    if (hovered && mouse.x >= top_left.x && mouse.x < bottom_right.x && mouse.y >= top_left.y &&
+        mouse.y < bottom_right.y) {
+      ImGui::SetTooltip("%s\n%s items\n%s wire\n%s RAM", item.label.c_str(), human_count(item.size.items).c_str(),
+                        human_bytes(item.size.wire).c_str(), human_bytes(item.size.ram).c_str());
+      if (clicked) {
+        drill = &item;
+      }
+    }
+  }
+
+  if (nullptr != drill) {
+    if (nullptr == drill->field_desc) {
+      sizes_focus_ = drill->path;
+      sizes_focus_field_ = 0;
+    } else if (drill->field_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+      if (drill->field_desc->is_repeated()) {
+        sizes_focus_field_ = drill->field_number;
+      } else {
+        sizes_focus_.push_back({drill->field_number, -1});
+      }
+    }
+  }
+  ImGui::End();
+}
+
+void ProtobufEditor::OpenRaw(const std::string& path) {
+  raw_root_.reset();
+  raw_path_ = path;
+  show_raw_ = true;
+  if (raw_file_.Open(path)) {
+    raw_root_.reset(new RawNode(raw_file_.data(), 0, raw_file_.size()));
+  }
+}
+
+void ProtobufEditor::RawWindow() {
+  // fields indexed per frame, enough to go through a GB in a few seconds
+  static const size_t kIndexPerFrame = 1 << 18;
+
+  ImGui::Begin("raw", &show_raw_);
+  if (!raw_root_) {
+    ImGui::Text("can't open %s", raw_path_.c_str());
+    ImGui::End();
+    if (!show_raw_) {
+      raw_file_.Close();
+    }
+    return;
+  }
+  raw_root_->Index(kIndexPerFrame);
+
+  ImGui::Text("%s, %s", raw_path_.c_str(), human_bytes(raw_file_.size()).c_str());
+  if (!raw_root_->indexed()) {
+    ImGui::SameLine();
+    ImGui::Text("indexing %.0f%%", 100.0 * static_cast<double>(raw_root_->indexed_to()) /
+                                       static_cast<double>(raw_file_.size()));
+  }
+  if (raw_root_->has_error()) {
+    ImGui::SameLine();
+    ImGui::Text("top level breaks at offset %llu", static_cast<unsigned long long>(raw_root_->error_offset()));
+  }
+
+  const uint8_t* data = raw_file_.data();
+  RawNode* expand_node = nullptr;
+  RawNode* collapse_node = nullptr;
+  size_t toggled = 0;
+  size_t rows = raw_root_->RowCount();
+  ImGuiListClipper clipper;
+  clipper.Begin(static_cast<int>(std::min<size_t>(rows, INT_MAX)));
+  while (clipper.Step()) {
+    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+      RawNode* node;
+      size_t i;
+      int depth;
+      raw_root_->Locate(static_cast<size_t>(row), &node, &i, &depth);
+      ImGui::PushID(row);
+      float indent = static_cast<float>(depth) * 20.0f;
+      if (depth > 0) {
+        ImGui::Indent(indent);
+      }
+      WireField field;
+      if (i == node->field_count()) {
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "@%llu: %llu bytes that don't parse",
+                           static_cast<unsigned long long>(node->error_offset()),
+                           static_cast<unsigned long long>(node->end() - node->error_offset()));
+      } else if (node->Field(i, &field)) {
+        char label[96];
+        snprintf(label, sizeof(label), "@%llu #%u %s", static_cast<unsigned long long>(field.offset),
+                 field.field_number, wire_type_name(field.wire_type));
+        bool expandable =
+            field.wire_type == ::google::protobuf::internal::WireFormatLite::WIRETYPE_START_GROUP ||
+            (field.wire_type == ::google::protobuf::internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED &&
+             looks_like_message(data, field.payload_begin, field.payload_end));
+        if (expandable) {
+          bool expanded = nullptr != node->Child(i);
+          ImGui::SetNextItemOpen(expanded);
+          if (ImGui::TreeNodeEx(label, ImGuiTreeNodeFlags_NoTreePushOnOpen) != expanded) {
+            if (expanded) {
+              collapse_node = node;
+            } else {
+              expand_node = node;
+            }
+            toggled = i;
+          }
+        } else {
+          ImGui::TreeNodeEx(label, ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen);
+        }
+        ImGui::SameLine();
+        ImGui::TextUnformatted(wire_value_string(data, field).c_str());
+      }
+      if (depth > 0) {
+        ImGui::Unindent(indent);
+      }
+      ImGui::PopID();
+    }
+  }
+  clipper.End();
+
+  // rows move when a node opens or closes, so that waits until they are all drawn
+  if (nullptr != expand_node) {
+    expand_node->Expand(toggled);
+  }
+  if (nullptr != collapse_node) {
+    collapse_node->Collapse(toggled);
+  }
+  ImGui::End();
+
+  if (!show_raw_) {
+    raw_root_.reset();
+    raw_file_.Close();
+  }
+}
+
 void ProtobufEditor::MainScreen() {
   static bool cant_save = false;
   static bool cant_load = false;
   static bool tried_to_load = false;
   static std::string error_str;
+  static std::string salvage_note;
+  static std::string load_warning;
+
+  std::lock_guard<std::mutex> lock(document_mutex_);
 
   ImGui::Begin("main");
   ImGui::SetWindowFontScale(1.8f);
 
-  browse(&file_path_);
+  Browse("open", &file_path_);
 
   ImGui::SameLine();
   InputText("file path", &file_path_);
 
+  bool load = false;
   if (ImGui::Button("Load")) {
-    if (!read_file(file_path_, &the_record_)) {
+    // the tag scan takes a fraction of the time of the parse it may save from running out of memory
+    FilePreview preview;
+    uint64_t available = available_memory();
+    load_warning.clear();
+    if (preview_file(file_path_, protobuf::editor::MyRecord::default_instance(), &preview) && available > 0 &&
+        preview.ram > available) {
+      load_warning = "loading needs about " + human_bytes(preview.ram) + " of memory, " + human_bytes(available) +
+                     " is available";
+    } else {
+      load = true;
+    }
+  }
+  ImGui::SameLine();
+  // the scan in progress reads preview_path_
+  bool scanning =
+      preview_future_.valid() && preview_future_.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+  ImGui::BeginDisabled(scanning);
+  if (ImGui::Button("Preview")) {
+    preview_path_ = file_path_;
+    preview_future_ = std::async(std::launch::async, [this]() {
+      FilePreview preview;
+      preview_ok_ = preview_file(preview_path_, protobuf::editor::MyRecord::default_instance(), &preview);
+      return preview;
+    });
+    show_preview_ = true;
+  }
+  ImGui::EndDisabled();
+  if (!load_warning.empty()) {
+    ImGui::TextWrapped("%s", load_warning.c_str());
+    ImGui::SameLine();
+    if (ImGui::Button("Load anyway")) {
+      load = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Don't load")) {
+      load_warning.clear();
+    }
+  }
+  if (load) {
+    load_warning.clear();
+    salvage_note.clear();
+    LoadMask mask;
+    size_t skipped_count = 0;
+    uint64_t skipped_bytes = 0;
+    bool loaded = false;
+    lazy_.clear();
+    if (load_mask_.empty()) {
+      loaded = read_file_lazy(file_path_, &the_record_, &document_file_, &lazy_);
+    } else if (parse_load_mask(the_record_.GetDescriptor(), load_mask_, load_mask_include_, &mask)) {
+      loaded = read_file_projected(file_path_, mask, &the_record_, &document_file_, &skipped_count, &skipped_bytes);
+    } else {
+      // nothing is loaded, and the previous record must not outlive the mapping it may depend on
+      the_record_.Clear();
+      document_file_.Close();
+    }
+    if (!loaded) {
       error_str = "can't load file";
       cant_load = true;
     } else {
       cant_load = false;
+      if (skipped_count > 0) {
+        salvage_note = human_count(skipped_count) + " payloads, " + human_bytes(skipped_bytes) + ", left in the file";
+      }
     }
     tried_to_load = true;
     cant_save = false;
-  }
+    undo_.Clear();
+    sizes_.Clear();
+    embed_read_.Cancel();
+    string_edit_ = StringEdit();
+    hex_views_.clear();
+    array_imports_.clear();
+    export_notes_.clear();
+    embed_files_.clear();
+    tree_root_.clear();
+    aggregate_result_.clear();
+    lazy_selected_.clear();
+    lazy_error_.clear();
+    projected_ = !load_mask_.empty() && document_file_.is_open();
+    required_.Build(the_record_);
+  }
+  InputText("leave in the file", &load_mask_);
+  ImGui::SameLine();
+  ImGui::Checkbox("all string and bytes fields but these", &load_mask_include_);
   if (ImGui::Button("Create")) {
+    salvage_note.clear();
+    undo_.Clear();
+    sizes_.Clear();
     tried_to_load = true;
     cant_load = false;
     cant_save = false;
+    embed_read_.Cancel();
+    string_edit_ = StringEdit();
+    hex_views_.clear();
+    array_imports_.clear();
+    export_notes_.clear();
+    embed_files_.clear();
+    tree_root_.clear();
+    aggregate_result_.clear();
+    // the record of a lazy or projected load is incomplete without its mapping, so it goes with it
+    if (projected_ || !lazy_.empty()) {
+      the_record_.Clear();
+    }
+    lazy_.clear();
+    lazy_selected_.clear();
+    lazy_error_.clear();
+    projected_ = false;
+    document_file_.Close();
+    required_.Build(the_record_);
   }
   if (cant_save || cant_load) {
     ImGui::TextWrapped("%s", error_str.c_str());
   }
+  if (!salvage_note.empty()) {
+    ImGui::TextWrapped("%s", salvage_note.c_str());
+  }
+  if (cant_load) {
+    ImGui::SameLine();
+    if (ImGui::Button("Inspect raw")) {
+      OpenRaw(file_path_);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Salvage")) {
+      SalvageReport report;
+      if (salvage_file(file_path_, &the_record_, &report)) {
+        cant_load = false;
+        if (report.damaged) {
+          salvage_note = "recovered what precedes the damage at offset " + std::to_string(report.damage_offset);
+        }
+      }
+      undo_.Clear();
+      sizes_.Clear();
+      embed_read_.Cancel();
+      string_edit_ = StringEdit();
+      hex_views_.clear();
+      array_imports_.clear();
+      export_notes_.clear();
+      embed_files_.clear();
+      tree_root_.clear();
+      aggregate_result_.clear();
+      lazy_.clear();
+      lazy_selected_.clear();
+      lazy_error_.clear();
+      projected_ = false;
+      document_file_.Close();
+      required_.Build(the_record_);
+    }
+  }
 
   if (tried_to_load && !cant_load) {
     WantToClose(&tried_to_load);
     SaveFile(&cant_save, &error_str);
+    UndoRedo();
+    ImGui::SameLine();
+    if (ImGui::Button("Diff")) {
+      show_diff_ = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Sizes")) {
+      show_sizes_ = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Aggregate")) {
+      show_aggregate_ = true;
+    }
+    ImGui::SameLine();
+    std::string problems = "Problems";
+    if (required_.missing() > 0) {
+      problems += " (" + human_count(required_.missing()) + ")";
+    }
+    if (ImGui::Button((problems + "###problems").c_str())) {
+      show_problems_ = true;
+    }
 
-    bool tree_selected = ImGui::TreeNode(the_record_.GetDescriptor()->name().c_str());
-    auto* msg = (::google::protobuf::Message*)&the_record_;
+    FinishEmbed();
+    std::string root_name = the_record_.GetDescriptor()->name();
+    if (!tree_root_.empty()) {
+      if (ImGui::Button("Top")) {
+        tree_root_.clear();
+      }
+      ImGui::SameLine();
+      if (ImGui::Button("Up")) {
+        tree_root_.pop_back();
+      }
+      ImGui::SameLine();
+      root_name = path_to_string(the_record_.GetDescriptor(), tree_root_);
+    }
+    auto* msg = ResolvePath(&the_record_, tree_root_);
+    if (nullptr == msg) {
+      // an edit or undo removed it
+      tree_root_.clear();
+      msg = &the_record_;
+    }
+    path_ = tree_root_;
+    bool tree_selected = ImGui::TreeNode(root_name.c_str());
+    SizeAnnotation(SizeCache::kWholeMessage);
     if (tree_selected) {
       Tree(msg);
 
       ImGui::TreePop();
     }
+    path_.clear();
   }
   ImGui::End();
+
+  if (show_diff_ && tried_to_load && !cant_load) {
+    DiffWindow();
+  }
+  if (show_sizes_ && tried_to_load && !cant_load) {
+    SizesWindow();
+  }
+  if (show_aggregate_ && tried_to_load && !cant_load) {
+    AggregateWindow();
+  }
+  if (show_problems_ && tried_to_load && !cant_load) {
+    ProblemsWindow();
+  }
+  if (show_raw_) {
+    RawWindow();
+  }
+  if (show_preview_) {
+    PreviewWindow();
+  }
+  file_browser_.Draw();
 }
 
 void ProtobufEditor::OneIteration() {
@@ -28,14 +28,30 @@
 #endif                   // IMGUI_IMPL_OPENGL_ES2
 #include <GLFW/glfw3.h>  // Will drag system OpenGL headers
 
+#include <functional>
+#include <future>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "imgui_includes.h"
 #include "log.h"
+#include "aggregate.h"
+#include "diff.h"
+#include "field_path.h"
+#include "file.h"
+#include "file_browser.h"
+#include "hex_view.h"
+#include "lazy.h"
+#include "preview.h"
+#include "projection.h"
 #include "protobuf_include.h"
+#include "sizes.h"
+#include "undo.h"
+#include "validate.h"
+#include "wire.h"
 
 class ProtobufEditor {
  public:
@@ -48,70 +64,121 @@ class ProtobufEditor {
   void OneIteration();
   void MainScreen();
 
-  void SetBoolField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-  void SetRepeatedBoolField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
+  // one instantiation per C++ type of the numeric and bool fields, see FieldTraits
+  template <typename T>
+  void SetScalarField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
+  template <typename T>
+  void SetRepeatedScalarField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
+  template <typename T>
+  void SetNonRepeatedScalarField(::google::protobuf::Message* msg,
+                                 const ::google::protobuf::FieldDescriptor* field_desc);
+  template <typename T>
+  void AllRepeatedScalarVals(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
+  // replaces the elements with the contents of a text, raw or .npy file
+  template <typename T>
+  void ImportArray(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
+  // writes the elements to a raw or .npy file straight from the field's storage
+  template <typename T>
+  void ExportArray(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
+  template <typename T>
+  bool InputScalar(const std::string& name, const ::google::protobuf::FieldDescriptor* field_desc, T* val);
   void SetEnumField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
   void SetRepeatedEnumField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-  void SetFloatField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-  void SetRepeatedFloatField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-  void SetDoubleField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-  void SetRepeatedDoubleField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
   void SetBytesField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
   void SetStringField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
   void SetRepeatedStringField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-  void SetIntField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-  void SetRepeatedIntField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-  void SetUintField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-  void SetRepeatedUintField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-  bool SetMessageField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-  bool SetRepeatedMessage(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-  bool SetNonRepeatedMessage(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
+  // The tree nodes of message fields, drawn by Tree(). Each returns the message to descend into if its node is
+  // left open, and nullptr otherwise.
+  ::google::protobuf::Message* SetNonRepeatedMessage(::google::protobuf::Message* msg,
+                                                     const ::google::protobuf::FieldDescriptor* field_desc);
+  bool SetRepeatedMessage(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                          bool* open);
+  // A field of lazy_ in place of SetRepeatedMessage(): a list of its elements that parses only the rows on screen,
+  // and the element selected in it.
+  bool LazyRepeatedMessage(int field_number);
+  ::google::protobuf::Message* SetRepeatedMessageElement(::google::protobuf::Message* msg,
+                                                         const ::google::protobuf::FieldDescriptor* field_desc,
+                                                         int ind, bool* removed);
   bool AddRemoveField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
                       const std::string& name);
   bool AddRemoveRepeatedField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
-                              int ind, int size, const std::string& name);
+                              int ind, const std::string& name);
   bool SetFields(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
   bool IsSet(const ::google::protobuf::Message& msg, const ::google::protobuf::FieldDescriptor* field_desc);
+  // Draws the fields of |msg|, the message at path_, and of its open submessages. Walks with its own stack, so
+  // the depth of the document doesn't matter, and shows at most kMaxTreeDepth levels of it below path_.
   bool Tree(::google::protobuf::Message* msg);
   bool NewField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
   bool RemoveSimpleField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
                          const std::string& name);
 
-  void InputText(const std::string& name, std::string* str);
-  void AllRepeatedFloatVals(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
+  bool InputText(const std::string& name, std::string* str);
+  // "Browse" button that opens file_browser_ on |out|, and sets it to the file chosen for |owner|
+  void Browse(const std::string& owner, std::string* out);
+  // owner of file_browser_ for |action| on |field_desc| of the message at path_
+  std::string FieldOwner(const std::string& action, const ::google::protobuf::FieldDescriptor* field_desc);
+  // Draws a prefix of |val|, element |index| of |field_desc| of the message at path_, and only copies all of it
+  // into string_edit_ once the input is clicked. Returns true with the new value in |committed| when the input
+  // loses focus after an edit, or on a paste.
+  bool InputString(const std::string& name, const ::google::protobuf::FieldDescriptor* field_desc, int index,
+                   const std::string& val, std::string* committed);
+  // Draws a placeholder of a projected load, with a button that reads in its bytes, in place of the input of
+  // |val|. Returns false if |val| is not one.
+  bool SkippedPayload(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                      int index, const std::string& val);
   void AllValsAddRemove(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
-                        std::string* all_vals, std::vector<std::string>* all_vals_vec, int size);
+                        const std::string& all_vals, std::vector<std::string>* all_vals_vec, int size);
   void AllRepeatedStringVals(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
   void WantToClose(bool* tried_to_load);
   void SaveFile(bool* cant_save, std::string* error_str);
   void Save(bool* cant_save, std::string* error_str, const std::string& path);
+  void UndoRedo();
+  void DiffWindow();
+  void RebuildDiffRows();
+  void SizesWindow();
+  void PreviewWindow();
+  void AggregateWindow();
+  void ProblemsWindow();
+  // moves a finished background read of an "Embed" into its field
+  void FinishEmbed();
+  // shown next to |field_desc| of the message at path_
+  void SetBytesNote(const ::google::protobuf::FieldDescriptor* field_desc, const std::string& note);
+  // Sets bytes field |field_desc| of the message at path_ to a pasted or embedded |data|. An edit costing more
+  // than the undo memory cap is not recorded, instead of encoding a copy of |data| only to drop the history.
+  void SetLargeBytes(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                     std::string data);
+  void OpenRaw(const std::string& path);
+  void RawWindow();
+  // "(1.2M items, 340MB wire, 910MB RAM)" after the header of |field_number| of the message at path_
+  void SizeAnnotation(int field_number);
+
+  // All edits of the document go through these, so they can be undone.
+  // |index| selects one element of a repeated field, -1 means the whole field.
+  void EditField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc, int index,
+                 const std::function<void()>& edit);
+  void AddElement(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                  const std::function<void()>& add);
+  void RemoveElement(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                     int index);
+  // Drops whatever was derived from |field_number| of the message at |path|.
+  void OnEdit(const FieldPath& path, int field_number);
+  // resolve_path() that also reaches into the elements of lazy_, with paths from the_record_ as if they were
+  // parsed into it
+  ::google::protobuf::Message* ResolvePath(::google::protobuf::Message* root, const FieldPath& path);
 
   bool SelectFieldToAdd(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
   bool NewMessageField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
+  // Sets the unset required fields of |msg| to defaults, and those of the messages created for them, without
+  // recursing.
+  bool AddRequiredFields(::google::protobuf::Message* msg);
 
   bool SelectRepeatedField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
                            int ind);
 
-  void SetRepeatedUintFieldInner(::google::protobuf::Message* msg,
-                                 const ::google::protobuf::FieldDescriptor* field_desc, const std::string& name, int k,
-                                 int size, uint32_t val, const std::string& val_str, bool* should_break);
-
   bool SelectRepeatedMessage(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
 
   bool SelectFieldsToAdd(::google::protobuf::Message* msg);
 
-  void SetNonRepeatedUintField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-
-  void SetNonRepeatedBoolField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-
-  void SetNonRepeatedFloatField(::google::protobuf::Message* msg,
-                                const ::google::protobuf::FieldDescriptor* field_desc);
-
-  void SetNonRepeatedIntField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
-
-  void SetNonRepeatedDoubleField(::google::protobuf::Message* msg,
-                                 const ::google::protobuf::FieldDescriptor* field_desc);
-
   void SetNonRepeatedEnumField(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
 
   void SetNonRepeatedStringField(::google::protobuf::Message* msg,
@@ -130,7 +197,119 @@ class ProtobufEditor {
 
   ::google::protobuf::Message* field_waiting_to_be_added_ = nullptr;
 
+  // held by the UI thread for a whole frame, and by background workers while they read the_record_
+  std::mutex document_mutex_;
   protobuf::editor::MyRecord the_record_;
+
+  UndoStack undo_;
+
+  // the file the_record_ was loaded from, kept mapped while lazy_ has elements, or the_record_ placeholders,
+  // left in it
+  MappedFile document_file_;
+  // string and bytes fields to leave in the file on load, as a list of paths for parse_load_mask()
+  std::string load_mask_;
+  bool load_mask_include_ = false;
+  // the_record_ was loaded with placeholders for payloads left in document_file_
+  bool projected_ = false;
+  // top-level repeated message fields of the_record_ too large to parse up front, by field number
+  std::map<int, std::unique_ptr<LazyElements>> lazy_;
+  // the element shown below the list of each field of lazy_
+  std::map<int, int> lazy_selected_;
+  // why "Load all to edit" left a field of lazy_ indexed
+  std::string lazy_error_;
+
+  // path from the_record_ to the message currently drawn by Tree()
+  FieldPath path_;
+  // path from the_record_ to the message shown at the top of the tree, moved down to see past kMaxTreeDepth
+  FieldPath tree_root_;
+
+  bool show_diff_ = false;
+  std::string diff_path_;
+  protobuf::editor::MyRecord diff_record_;
+  DiffOptions diff_options_;
+  DiffResult diff_;
+  std::vector<bool> diff_collapsed_;
+  // indexes into diff_.entries of the rows not hidden under a collapsed row
+  std::vector<size_t> diff_rows_;
+
+  SizeCache sizes_{&document_mutex_, &the_record_};
+  bool show_sizes_ = false;
+  bool annotate_sizes_ = true;
+  int sizes_metric_ = 0;  // 0 - wire, 1 - RAM
+  // the treemap shows the fields of the message at sizes_focus_, or the elements of its repeated
+  // field sizes_focus_field_ if that is not 0
+  FieldPath sizes_focus_;
+  int sizes_focus_field_ = 0;
+
+  // tag scan of preview_path_, made on a background thread
+  bool show_preview_ = false;
+  std::string preview_path_;
+  std::future<FilePreview> preview_future_;
+  FilePreview preview_;
+  bool preview_ok_ = false;
+
+  // count, sum, min, max and distinct of aggregate_value_ of the messages aggregate_selection_ selects in
+  // the_record_, grouped by aggregate_key_
+  bool show_aggregate_ = false;
+  std::string aggregate_selection_ = "people[*].phones";
+  std::string aggregate_value_;
+  std::string aggregate_key_;
+  Aggregate aggregate_;
+  AggregateResult aggregate_result_;
+  std::string aggregate_error_;
+
+  // unset required fields of the_record_, checked on load and kept up to date by OnEdit()
+  RequiredCheck required_;
+  bool show_problems_ = false;
+
+  // schema-less view of a file, for when it doesn't parse
+  bool show_raw_ = false;
+  std::string raw_path_;
+  MappedFile raw_file_;
+  std::unique_ptr<RawNode> raw_root_;
+
+  // file being read for the "Embed" of bytes field embed_field_ of the message at embed_path_
+  BackgroundRead embed_read_;
+  FieldPath embed_path_;
+  int embed_field_ = 0;
+  // the file chosen for the "Embed" of each bytes field, by its FieldOwner()
+  std::map<std::string, std::string> embed_files_;
+  // outcome of the last embed, extract or paste, shown by bytes field bytes_note_field_ of the message at
+  // bytes_note_path_
+  std::string bytes_note_;
+  FieldPath bytes_note_path_;
+  int bytes_note_field_ = 0;
+
+  // the string field being typed into, element |index| (-1 if not repeated) of field |field_number| of the
+  // message at |path|
+  struct StringEdit {
+    FieldPath path;
+    int field_number = 0;
+    int index = -1;
+    std::string buffer;
+    bool changed = false;
+    // frames left for the input to take the focus it was given
+    int focus_frames = 0;
+  };
+  StringEdit string_edit_;
+
+  // the one file dialog, for whichever button opened it last
+  FileBrowser file_browser_;
+
+  // what the import of each repeated scalar field was set to, and how it went, by its FieldOwner()
+  struct ArrayImport {
+    std::string path;
+    int format = 0;  // an ArrayFormat
+    int column = -1;
+    std::string note;
+  };
+  std::map<std::string, ArrayImport> array_imports_;
+  // how the last export of each repeated scalar field went, by its FieldOwner()
+  std::map<std::string, std::string> export_notes_;
+
+  // scroll and search state of the viewer of each bytes field, by the field numbers and indexes of path_ and
+  // then the field's number, so that the same field of two messages doesn't share one
+  std::map<std::vector<int>, HexView> hex_views_;
 };
 
 #endif  // PROTOBUF_EDITOR_SRC_PROTOBUF_EDITOR_H_
@@ -16,6 +16,13 @@
 #endif /* __clang__ */
 #pragma GCC diagnostic ignored "-Woverflow"
 
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/text_format.h>
+#include <google/protobuf/wire_format.h>
+#include <google/protobuf/wire_format_lite.h>
+
 #include "schema.pb.h"
 
 #pragma GCC diagnostic pop
@@ -0,0 +1,824 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "query.h"
+
+#include <limits.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+
+#include <google/protobuf/util/json_util.h>
+
+#include "codec.h"
+#include "file.h"
+#include "log.h"
+#include "number.h"
+#include "parallel.h"
+#include "proto.h"
+#include "wire.h"
+
+typedef ::google::protobuf::internal::WireFormatLite WireFormatLite;
+
+// items parsed between two writes of the results, which the batch holds in memory until then
+static const size_t kBatchSize = 1 << 16;
+
+static bool is_name_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static void skip_spaces(const std::string& text, size_t* pos) {
+  while (*pos < text.size() && text[*pos] == ' ') {
+    ++*pos;
+  }
+}
+
+static bool query_error(const std::string& text, size_t pos, const char* what) {
+  PBE_LOG_ERROR("%s: %s at offset %zu\n", text.c_str(), what, pos);
+  return false;
+}
+
+static bool read_name(const std::string& text, size_t* pos, std::string* name) {
+  size_t begin = *pos;
+  while (*pos < text.size() && is_name_char(text[*pos])) {
+    ++*pos;
+  }
+  *name = text.substr(begin, *pos - begin);
+  return !name->empty();
+}
+
+static bool read_op(const std::string& text, size_t* pos, QueryOp* op) {
+  // longest first
+  static const struct {
+    const char* text;
+    QueryOp op;
+  } kOps[] = {{"==", QueryOp::kEqual},  {"!=", QueryOp::kNotEqual}, {"<=", QueryOp::kLessEqual},
+              {">=", QueryOp::kGreaterEqual}, {"=", QueryOp::kEqual}, {"<", QueryOp::kLess},
+              {">", QueryOp::kGreater}};
+  for (const auto& candidate : kOps) {
+    size_t length = strlen(candidate.text);
+    if (text.compare(*pos, length, candidate.text) == 0) {
+      *op = candidate.op;
+      *pos += length;
+      return true;
+    }
+  }
+  return false;
+}
+
+// A "quoted" literal, with \" and \\ escapes, or everything up to the closing bracket.
+static bool read_literal(const std::string& text, size_t* pos, std::string* literal) {
+  literal->clear();
+  if (*pos < text.size() && text[*pos] == '"') {
+    for (++*pos; *pos < text.size() && text[*pos] != '"'; ++*pos) {
+      if (text[*pos] == '\\' && *pos + 1 < text.size()) {
+        ++*pos;
+      }
+      *literal += text[*pos];
+    }
+    if (*pos == text.size()) {
+      return false;
+    }
+    ++*pos;
+    return true;
+  }
+  size_t end = text.find(']', *pos);
+  if (end == std::string::npos) {
+    return false;
+  }
+  *literal = text.substr(*pos, end - *pos);
+  while (!literal->empty() && literal->back() == ' ') {
+    literal->pop_back();
+  }
+  *pos = end;
+  return true;
+}
+
+static bool convert_literal(const ::google::protobuf::FieldDescriptor* field_desc, const std::string& text,
+                            QueryLiteral* out) {
+  switch (field_desc->cpp_type()) {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+      return parse_number(text, &out->int_value);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+      return parse_number(text, &out->uint_value);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+      return parse_number(text, &out->float_value);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+      return parse_number(text, &out->double_value);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+      return parse_number(text, &out->bool_value);
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_ENUM: {
+      const auto* value = field_desc->enum_type()->FindValueByName(text);
+      if (nullptr != value) {
+        out->int_value = value->number();
+        return true;
+      }
+      return parse_number(text, &out->int_value);
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+      out->string_value = text;
+      return true;
+    default:
+      return false;
+  }
+}
+
+// The inside of the brackets after |step|'s field, up to the closing bracket.
+static bool parse_selector(const std::string& text, size_t* pos, QueryStep* step) {
+  const auto* field_desc = step->field_desc;
+  skip_spaces(text, pos);
+  if (*pos < text.size() && text[*pos] == '*') {
+    ++*pos;
+    return true;
+  }
+  if (*pos < text.size() && text[*pos] >= '0' && text[*pos] <= '9') {
+    size_t begin = *pos;
+    while (*pos < text.size() && text[*pos] >= '0' && text[*pos] <= '9') {
+      ++*pos;
+    }
+    if (!field_desc->is_repeated()) {
+      return query_error(text, begin, "an index of a field that isn't repeated");
+    }
+    if (!parse_number(text.data() + begin, text.data() + *pos, &step->index)) {
+      return query_error(text, begin, "an index out of range");
+    }
+    return true;
+  }
+
+  step->has_filter = true;
+  // the field compared, or the value itself for a scalar field
+  const ::google::protobuf::FieldDescriptor* compared = field_desc;
+  if (*pos < text.size() && is_name_char(text[*pos])) {
+    const ::google::protobuf::Descriptor* desc = field_desc->message_type();
+    for (;;) {
+      size_t begin = *pos;
+      std::string name;
+      read_name(text, pos, &name);
+      compared = nullptr == desc ? nullptr : desc->FindFieldByName(name);
+      if (nullptr == compared) {
+        return query_error(text, begin, "a filter on a field that doesn't exist");
+      }
+      if (compared->is_repeated()) {
+        return query_error(text, begin, "a filter on a repeated field");
+      }
+      step->filter_fields.push_back(compared);
+      if (*pos == text.size() || text[*pos] != '.') {
+        break;
+      }
+      ++*pos;
+      desc = compared->message_type();
+    }
+  }
+  if (compared->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+    return query_error(text, *pos, "a filter on a message");
+  }
+  skip_spaces(text, pos);
+  if (!read_op(text, pos, &step->op)) {
+    return query_error(text, *pos, "no comparison");
+  }
+  skip_spaces(text, pos);
+  size_t literal_pos = *pos;
+  std::string literal;
+  if (!read_literal(text, pos, &literal)) {
+    return query_error(text, literal_pos, "an unterminated literal");
+  }
+  if (!convert_literal(compared, literal, &step->literal)) {
+    return query_error(text, literal_pos, "a literal of the wrong type");
+  }
+  return true;
+}
+
+bool parse_query(const ::google::protobuf::Descriptor* root_desc, const std::string& text, Query* out) {
+  *out = Query();
+  const ::google::protobuf::Descriptor* desc = root_desc;
+  size_t pos = 0;
+  for (;;) {
+    if (nullptr == desc) {
+      return query_error(text, pos, "a field inside a field that isn't a message");
+    }
+    if (pos < text.size() && text[pos] == '{') {
+      if (out->steps.empty()) {
+        return query_error(text, pos, "a projection of the root");
+      }
+      do {
+        ++pos;
+        size_t begin = pos;
+        std::string name;
+        const auto* field_desc = read_name(text, &pos, &name) ? desc->FindFieldByName(name) : nullptr;
+        if (nullptr == field_desc) {
+          return query_error(text, begin, "a projection of a field that doesn't exist");
+        }
+        out->projection.push_back(field_desc);
+      } while (pos < text.size() && text[pos] == ',');
+      if (pos == text.size() || text[pos] != '}' || pos + 1 != text.size()) {
+        return query_error(text, pos, "no } at the end");
+      }
+      return true;
+    }
+
+    QueryStep step;
+    size_t begin = pos;
+    std::string name;
+    step.field_desc = read_name(text, &pos, &name) ? desc->FindFieldByName(name) : nullptr;
+    if (nullptr == step.field_desc) {
+      return query_error(text, begin, "a field that doesn't exist");
+    }
+    if (pos < text.size() && text[pos] == '[') {
+      ++pos;
+      if (!parse_selector(text, &pos, &step)) {
+        return false;
+      }
+      skip_spaces(text, &pos);
+      if (pos == text.size() || text[pos] != ']') {
+        return query_error(text, pos, "no ]");
+      }
+      ++pos;
+    }
+    out->steps.push_back(step);
+    desc = step.field_desc->message_type();
+    if (pos == text.size()) {
+      return true;
+    }
+    if (text[pos] == '{') {
+      continue;
+    }
+    if (text[pos] != '.') {
+      return query_error(text, pos, "no . between fields");
+    }
+    ++pos;
+  }
+}
+
+bool query_yields_messages(const Query& query) {
+  return query.steps.back().field_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE;
+}
+
+// Compares with operator< only, so that floats aren't compared with ==.
+template <typename T>
+static bool compare(const T& a, const T& b, QueryOp op) {
+  switch (op) {
+    case QueryOp::kEqual:
+      return !(a < b) && !(b < a);
+    case QueryOp::kNotEqual:
+      return a < b || b < a;
+    case QueryOp::kLess:
+      return a < b;
+    case QueryOp::kLessEqual:
+      return !(b < a);
+    case QueryOp::kGreater:
+      return b < a;
+    case QueryOp::kGreaterEqual:
+      return !(a < b);
+  }
+  return false;
+}
+
+// NaN is unequal to everything
+template <typename T>
+static bool compare_floating(T a, T b, QueryOp op) {
+  if (std::isnan(a) || std::isnan(b)) {
+    return op == QueryOp::kNotEqual;
+  }
+  return compare<int>(a < b ? -1 : (b < a ? 1 : 0), 0, op);
+}
+
+template <>
+bool compare(const float& a, const float& b, QueryOp op) {
+  return compare_floating(a, b, op);
+}
+
+template <>
+bool compare(const double& a, const double& b, QueryOp op) {
+  return compare_floating(a, b, op);
+}
+
+// Compares |field_desc| of |msg|, element |index| if it's repeated, with the literal of |step|.
+static bool compare_field(const ::google::protobuf::Message& msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                          int index, const QueryStep& step) {
+  const auto* reflection = msg.GetReflection();
+  const QueryLiteral& literal = step.literal;
+  bool repeated = index >= 0;
+  switch (field_desc->cpp_type()) {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT32: {
+      int64_t val = repeated ? reflection->GetRepeatedInt32(msg, field_desc, index) : reflection->GetInt32(msg, field_desc);
+      return compare(val, literal.int_value, step.op);
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT64: {
+      int64_t val = repeated ? reflection->GetRepeatedInt64(msg, field_desc, index) : reflection->GetInt64(msg, field_desc);
+      return compare(val, literal.int_value, step.op);
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32: {
+      uint64_t val =
+          repeated ? reflection->GetRepeatedUInt32(msg, field_desc, index) : reflection->GetUInt32(msg, field_desc);
+      return compare(val, literal.uint_value, step.op);
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64: {
+      uint64_t val =
+          repeated ? reflection->GetRepeatedUInt64(msg, field_desc, index) : reflection->GetUInt64(msg, field_desc);
+      return compare(val, literal.uint_value, step.op);
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_FLOAT: {
+      float val = repeated ? reflection->GetRepeatedFloat(msg, field_desc, index) : reflection->GetFloat(msg, field_desc);
+      return compare(val, literal.float_value, step.op);
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE: {
+      double val =
+          repeated ? reflection->GetRepeatedDouble(msg, field_desc, index) : reflection->GetDouble(msg, field_desc);
+      return compare(val, literal.double_value, step.op);
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL: {
+      bool val = repeated ? reflection->GetRepeatedBool(msg, field_desc, index) : reflection->GetBool(msg, field_desc);
+      return compare(val, literal.bool_value, step.op);
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_ENUM: {
+      int64_t val = repeated ? reflection->GetRepeatedEnumValue(msg, field_desc, index)
+                             : reflection->GetEnumValue(msg, field_desc);
+      return compare(val, literal.int_value, step.op);
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_STRING: {
+      std::string scratch;
+      const std::string& val = repeated ? reflection->GetRepeatedStringReference(msg, field_desc, index, &scratch)
+                                        : reflection->GetStringReference(msg, field_desc, &scratch);
+      return compare(val, literal.string_value, step.op);
+    }
+    default:
+      return false;
+  }
+}
+
+// Whether the filter of |step| holds for |element|, a message it led to. An unset field never matches.
+static bool filter_matches(const QueryStep& step, const ::google::protobuf::Message& element) {
+  const ::google::protobuf::Message* msg = &element;
+  for (size_t i = 0; i + 1 < step.filter_fields.size(); ++i) {
+    if (!msg->GetReflection()->HasField(*msg, step.filter_fields[i])) {
+      return false;
+    }
+    msg = &msg->GetReflection()->GetMessage(*msg, step.filter_fields[i]);
+  }
+  const auto* compared = step.filter_fields.back();
+  if (compared->has_presence() && !msg->GetReflection()->HasField(*msg, compared)) {
+    return false;
+  }
+  return compare_field(*msg, compared, -1, step);
+}
+
+static void append_json_string(const std::string& str, std::string* out) {
+  static const char kHex[] = "0123456789abcdef";
+  *out += '"';
+  for (char c : str) {
+    unsigned char byte = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\') {
+      *out += '\\';
+      *out += c;
+    } else if (c == '\n') {
+      *out += "\\n";
+    } else if (byte < 0x20) {
+      *out += "\\u00";
+      *out += kHex[byte >> 4];
+      *out += kHex[byte & 0xf];
+    } else {
+      *out += c;
+    }
+  }
+  *out += '"';
+}
+
+template <typename T>
+static void append_number(T val, QueryOutput output, std::string* out) {
+  char buf[kMaxNumberLength];
+  char* end = format_number(val, buf);
+  // JSON has no literals for these, protobuf's JSON mapping quotes them
+  bool quote = output == QueryOutput::kJson && (buf[0] == 'n' || buf[end - buf - 1] == 'f');
+  if (quote) {
+    *out += std::string("\"") + (buf[0] == 'n' ? "NaN" : (buf[0] == '-' ? "-Infinity" : "Infinity")) + "\"";
+    return;
+  }
+  out->append(buf, end);
+}
+
+// Element |index| of |field_desc| of |msg|, or its only value for -1.
+static void emit_value(const ::google::protobuf::Message& msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                       int index, QueryOutput output, std::string* out) {
+  const auto* reflection = msg.GetReflection();
+  bool repeated = index >= 0;
+  bool json = output == QueryOutput::kJson;
+  switch (field_desc->cpp_type()) {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+      append_number(repeated ? reflection->GetRepeatedInt32(msg, field_desc, index)
+                             : reflection->GetInt32(msg, field_desc),
+                    output, out);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+      append_number(repeated ? reflection->GetRepeatedInt64(msg, field_desc, index)
+                             : reflection->GetInt64(msg, field_desc),
+                    output, out);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+      append_number(repeated ? reflection->GetRepeatedUInt32(msg, field_desc, index)
+                             : reflection->GetUInt32(msg, field_desc),
+                    output, out);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+      append_number(repeated ? reflection->GetRepeatedUInt64(msg, field_desc, index)
+                             : reflection->GetUInt64(msg, field_desc),
+                    output, out);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+      append_number(repeated ? reflection->GetRepeatedFloat(msg, field_desc, index)
+                             : reflection->GetFloat(msg, field_desc),
+                    output, out);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+      append_number(repeated ? reflection->GetRepeatedDouble(msg, field_desc, index)
+                             : reflection->GetDouble(msg, field_desc),
+                    output, out);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+      append_number(repeated ? reflection->GetRepeatedBool(msg, field_desc, index)
+                             : reflection->GetBool(msg, field_desc),
+                    output, out);
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_ENUM: {
+      int number = repeated ? reflection->GetRepeatedEnumValue(msg, field_desc, index)
+                            : reflection->GetEnumValue(msg, field_desc);
+      const auto* value = field_desc->enum_type()->FindValueByNumber(number);
+      if (nullptr == value) {
+        append_number(number, output, out);
+      } else if (json) {
+        append_json_string(value->name(), out);
+      } else {
+        *out += value->name();
+      }
+      break;
+    }
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_STRING: {
+      std::string scratch;
+      const std::string& val = repeated ? reflection->GetRepeatedStringReference(msg, field_desc, index, &scratch)
+                                        : reflection->GetStringReference(msg, field_desc, &scratch);
+      bool bytes = field_desc->type() == ::google::protobuf::FieldDescriptor::TYPE_BYTES;
+      if (json) {
+        append_json_string(bytes ? base64_encode(val) : val, out);
+      } else {
+        *out += bytes ? base64_encode(val) : val;
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  *out += '\n';
+}
+
+static void emit_message(const Query& query, const ::google::protobuf::Message& msg, QueryOutput output,
+                         std::string* out) {
+  std::unique_ptr<::google::protobuf::Message> projected;
+  const ::google::protobuf::Message* result = &msg;
+  if (!query.projection.empty()) {
+    projected.reset(msg.New());
+    projected->CopyFrom(msg);
+    const auto* desc = msg.GetDescriptor();
+    for (int i = 0; i < desc->field_count(); ++i) {
+      if (std::find(query.projection.begin(), query.projection.end(), desc->field(i)) == query.projection.end()) {
+        projected->GetReflection()->ClearField(projected.get(), desc->field(i));
+      }
+    }
+    result = projected.get();
+  }
+
+  switch (output) {
+    case QueryOutput::kText: {
+      ::google::protobuf::TextFormat::Printer printer;
+      printer.SetSingleLineMode(true);
+      std::string text;
+      printer.PrintToString(*result, &text);
+      if (!text.empty() && text.back() == ' ') {
+        text.pop_back();
+      }
+      *out += text;
+      *out += '\n';
+      break;
+    }
+    case QueryOutput::kJson: {
+      ::google::protobuf::util::JsonPrintOptions options;
+      options.preserve_proto_field_names = true;
+      std::string json;
+      if (!::google::protobuf::util::MessageToJsonString(*result, &json, options).ok()) {
+        json = "null";
+      }
+      *out += json;
+      *out += '\n';
+      break;
+    }
+    case QueryOutput::kDelimited: {
+      ::google::protobuf::io::StringOutputStream stream(out);
+      ::google::protobuf::io::CodedOutputStream coded(&stream);
+      coded.WriteVarint64(result->ByteSizeLong());
+      result->SerializeWithCachedSizes(&coded);
+      break;
+    }
+  }
+}
+
+// Writes the results into a string, in the format of |output|.
+class OutputSink : public QuerySink {
+ public:
+  OutputSink(const Query& query, QueryOutput output, std::string* out) : query_(query), output_(output), out_(out) {}
+  void Message(const ::google::protobuf::Message& msg) override { emit_message(query_, msg, output_, out_); }
+  void Value(const ::google::protobuf::Message& msg, const ::google::protobuf::FieldDescriptor* field_desc,
+             int index) override {
+    emit_value(msg, field_desc, index, output_, out_);
+  }
+
+ private:
+  const Query& query_;
+  QueryOutput output_;
+  std::string* out_;
+};
+
+static void run_steps(const Query& query, const ::google::protobuf::Message& msg, size_t i, QuerySink* sink);
+
+// |element| is what step |i| led to.
+static void visit_message(const Query& query, const ::google::protobuf::Message& element, size_t i,
+                          QuerySink* sink) {
+  if (query.steps[i].has_filter && !filter_matches(query.steps[i], element)) {
+    return;
+  }
+  if (i + 1 == query.steps.size()) {
+    sink->Message(element);
+  } else {
+    run_steps(query, element, i + 1, sink);
+  }
+}
+
+static void run_steps(const Query& query, const ::google::protobuf::Message& msg, size_t i, QuerySink* sink) {
+  const QueryStep& step = query.steps[i];
+  const auto* field_desc = step.field_desc;
+  const auto* reflection = msg.GetReflection();
+  bool is_message = field_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE;
+  if (field_desc->is_repeated()) {
+    int size = reflection->FieldSize(msg, field_desc);
+    int begin = step.index < 0 ? 0 : step.index;
+    int end = step.index < 0 ? size : std::min(size, step.index + 1);
+    for (int k = begin; k < end; ++k) {
+      if (is_message) {
+        visit_message(query, reflection->GetRepeatedMessage(msg, field_desc, k), i, sink);
+      } else if (!step.has_filter || compare_field(msg, field_desc, k, step)) {
+        sink->Value(msg, field_desc, k);
+      }
+    }
+    return;
+  }
+  if (field_desc->has_presence() && !reflection->HasField(msg, field_desc)) {
+    return;
+  }
+  if (is_message) {
+    visit_message(query, reflection->GetMessage(msg, field_desc), i, sink);
+  } else if (!step.has_filter || compare_field(msg, field_desc, -1, step)) {
+    sink->Value(msg, field_desc, -1);
+  }
+}
+
+void run_query(const Query& query, const ::google::protobuf::Message& msg, QuerySink* sink) {
+  run_steps(query, msg, 0, sink);
+}
+
+void run_query(const Query& query, const ::google::protobuf::Message& msg, QueryOutput output, std::string* out) {
+  OutputSink sink(query, output, out);
+  run_steps(query, msg, 0, &sink);
+}
+
+void run_query_parallel(const Query& query, const ::google::protobuf::Message& msg,
+                        const std::vector<QuerySink*>& sinks) {
+  const QueryStep& first = query.steps[0];
+  const auto* reflection = msg.GetReflection();
+  if (!first.field_desc->is_repeated() ||
+      first.field_desc->cpp_type() != ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE || first.index >= 0) {
+    run_steps(query, msg, 0, sinks[0]);
+    return;
+  }
+  parallel_for(
+      static_cast<size_t>(reflection->FieldSize(msg, first.field_desc)),
+      [&](size_t chunk, size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+          visit_message(query, reflection->GetRepeatedMessage(msg, first.field_desc, static_cast<int>(k)), 0,
+                        sinks[chunk]);
+        }
+      },
+      1024);
+}
+
+// A piece of an input file evaluated on its own.
+struct QueryItem {
+  enum Kind {
+    kRecord,   // a record of a log, parsed whole
+    kElement,  // element |index| of the repeated message field of the first step, parsed alone
+    kFields,   // a whole message, of which only the field of the first step is parsed
+  };
+  Kind kind;
+  size_t file;
+  uint64_t begin;
+  uint64_t end;
+  int index;
+};
+
+static bool merge_range(const uint8_t* data, uint64_t size, ::google::protobuf::Message* msg) {
+  ::google::protobuf::io::CodedInputStream input(data, static_cast<int>(size));
+  input.SetRecursionLimit(kMaxParseDepth);
+  return msg->MergePartialFromCodedStream(&input);
+}
+
+// Parses |item| and hands its results to |sink|. |root| and |element| are reused between items.
+static bool run_item(const Query& query, const QueryItem& item, const uint8_t* data, ::google::protobuf::Message* root,
+                     ::google::protobuf::Message* element, QuerySink* sink) {
+  const auto* begin = data + item.begin;
+  uint64_t size = item.end - item.begin;
+  switch (item.kind) {
+    case QueryItem::kRecord:
+      root->Clear();
+      if (!merge_range(begin, size, root)) {
+        return false;
+      }
+      run_steps(query, *root, 0, sink);
+      return true;
+    case QueryItem::kElement:
+      element->Clear();
+      if (!merge_range(begin, size, element)) {
+        return false;
+      }
+      visit_message(query, *element, 0, sink);
+      return true;
+    case QueryItem::kFields: {
+      root->Clear();
+      uint32_t field_number = static_cast<uint32_t>(query.steps[0].field_desc->number());
+      WireField wire;
+      for (uint64_t offset = item.begin; offset < item.end; offset = wire.end) {
+        if (!decode_field(data, offset, item.end, &wire)) {
+          return false;
+        }
+        if (wire.field_number != field_number) {
+          continue;
+        }
+        // the field with its tag parses like a message holding only it, and merges like the whole would
+        if (!merge_range(data + wire.offset, wire.end - wire.offset, root)) {
+          return false;
+        }
+      }
+      run_steps(query, *root, 0, sink);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Splits |data| into items, from |*offset| on, until there are kBatchSize in |items|. |*next_index| counts the
+// elements of the first step's field seen so far.
+static bool split_file(const Query& query, size_t file, const uint8_t* data, uint64_t size, bool delimited,
+                       uint64_t* offset, int* next_index, std::vector<QueryItem>* items) {
+  const auto* first = query.steps[0].field_desc;
+  bool per_element = first->is_repeated() && first->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE;
+  if (!delimited && !per_element) {
+    if (size > INT_MAX) {
+      return false;
+    }
+    items->push_back({QueryItem::kFields, file, 0, size, -1});
+    *offset = size;
+    return true;
+  }
+  WireField wire;
+  while (*offset < size && items->size() < kBatchSize) {
+    if (delimited) {
+      uint64_t begin;
+      uint64_t end;
+      if (!next_delimited(data, size, offset, &begin, &end) || end - begin > INT_MAX) {
+        return false;
+      }
+      items->push_back({QueryItem::kRecord, file, begin, end, -1});
+      continue;
+    }
+    if (!decode_field(data, *offset, size, &wire)) {
+      return false;
+    }
+    *offset = wire.end;
+    bool payload = wire.wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED ||
+                   wire.wire_type == WireFormatLite::WIRETYPE_START_GROUP;
+    if (wire.field_number != static_cast<uint32_t>(first->number()) || !payload) {
+      continue;
+    }
+    int index = (*next_index)++;
+    if (query.steps[0].index >= 0 && index != query.steps[0].index) {
+      continue;
+    }
+    if (wire.payload_end - wire.payload_begin > INT_MAX) {
+      return false;
+    }
+    items->push_back({QueryItem::kElement, file, wire.payload_begin, wire.payload_end, index});
+  }
+  return true;
+}
+
+bool scan_files(const Query& query, const ::google::protobuf::Message& prototype,
+                const std::vector<std::string>& paths, bool delimited, const std::vector<QuerySink*>& sinks,
+                const std::function<bool()>& end_batch) {
+  std::vector<std::unique_ptr<MappedFile>> files;
+  for (const auto& path : paths) {
+    files.emplace_back(new MappedFile());
+    if (!files.back()->Open(path, true)) {
+      return false;
+    }
+  }
+  const auto* first = query.steps[0].field_desc;
+  const ::google::protobuf::Message* element_prototype = nullptr;
+  if (first->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+    element_prototype = prototype.GetReflection()->GetMessageFactory()->GetPrototype(first->message_type());
+  }
+
+  std::atomic<bool> ok{true};
+  std::vector<QueryItem> items;
+  auto run_batch = [&]() {
+    parallel_for(
+        items.size(),
+        [&](size_t chunk, size_t begin, size_t end) {
+          std::unique_ptr<::google::protobuf::Message> root(prototype.New());
+          std::unique_ptr<::google::protobuf::Message> element(
+              nullptr == element_prototype ? nullptr : element_prototype->New());
+          for (size_t i = begin; i < end; ++i) {
+            const QueryItem& item = items[i];
+            if (!run_item(query, item, files[item.file]->data(), root.get(), element.get(), sinks[chunk])) {
+              PBE_LOG_ERROR("%s: can't parse the message at offset %llu\n", paths[item.file].c_str(),
+                            static_cast<unsigned long long>(item.begin));
+              ok = false;
+            }
+          }
+        },
+        64);
+    items.clear();
+    if (!end_batch()) {
+      ok = false;
+    }
+  };
+
+  for (size_t file = 0; file < files.size() && ok; ++file) {
+    uint64_t offset = 0;
+    int next_index = 0;
+    const uint8_t* data = files[file]->data();
+    uint64_t size = files[file]->size();
+    do {
+      if (!split_file(query, file, data, size, delimited, &offset, &next_index, &items)) {
+        PBE_LOG_ERROR("%s: malformed at offset %llu\n", paths[file].c_str(), static_cast<unsigned long long>(offset));
+        ok = false;
+        break;
+      }
+      if (items.size() >= kBatchSize) {
+        run_batch();
+      }
+    } while (offset < size);
+  }
+  if (ok) {
+    run_batch();
+  }
+  return ok;
+}
+
+bool query_files(const Query& query, const ::google::protobuf::Message& prototype,
+                 const std::vector<std::string>& paths, bool delimited, QueryOutput output, FILE* out) {
+  std::vector<std::string> outputs(worker_count());
+  std::vector<OutputSink> sinks;
+  std::vector<QuerySink*> sink_ptrs;
+  sinks.reserve(outputs.size());
+  for (auto& chunk_out : outputs) {
+    sinks.emplace_back(query, output, &chunk_out);
+    sink_ptrs.push_back(&sinks.back());
+  }
+  return scan_files(query, prototype, paths, delimited, sink_ptrs, [&]() {
+    // chunks are consecutive ranges of items, so this keeps the order of the input
+    bool written = true;
+    for (auto& chunk_out : outputs) {
+      if (!chunk_out.empty() && fwrite(chunk_out.data(), 1, chunk_out.size(), out) != chunk_out.size()) {
+        written = false;
+      }
+      chunk_out.clear();
+    }
+    return written;
+  });
+}
@@ -0,0 +1,114 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QUERY_H_
+#define QUERY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "protobuf_include.h"
+
+// How a filter compares a field to its literal.
+enum class QueryOp { kEqual, kNotEqual, kLess, kLessEqual, kGreater, kGreaterEqual };
+
+// The literal of a filter, already converted to the type of the field it's compared with.
+struct QueryLiteral {
+  int64_t int_value = 0;  // signed integers and enums
+  uint64_t uint_value = 0;
+  // rounded to the field's own type, as a stored value would be
+  float float_value = 0.0f;
+  double double_value = 0.0;
+  bool bool_value = false;
+  std::string string_value;
+};
+
+// One name of a query with what follows it in brackets: "phones[*]", "people[3]" or
+// "phones[type=PHONE_TYPE_MOBILE]".
+struct QueryStep {
+  const ::google::protobuf::FieldDescriptor* field_desc = nullptr;
+  // the only element taken, -1 for all of them
+  int index = -1;
+  bool has_filter = false;
+  // the field compared, through singular messages from an element; empty to compare the element itself
+  std::vector<const ::google::protobuf::FieldDescriptor*> filter_fields;
+  QueryOp op = QueryOp::kEqual;
+  QueryLiteral literal;
+};
+
+// A parsed field-path expression like "people[*].phones[type=PHONE_TYPE_MOBILE].number". It ends either in a
+// field, whose values are the results, or in a projection "{name,email}" of the messages it leads to.
+struct Query {
+  std::vector<QueryStep> steps;
+  std::vector<const ::google::protobuf::FieldDescriptor*> projection;
+};
+
+enum class QueryOutput {
+  kText,       // a line per result: the value, or the message in single-line text format
+  kJson,       // a JSON value per line
+  kDelimited,  // messages only, each after its varint length
+};
+
+// Logs where |text| goes wrong, and returns false.
+bool parse_query(const ::google::protobuf::Descriptor* root_desc, const std::string& text, Query* out);
+
+// Whether results of |query| are messages, which kDelimited output needs.
+bool query_yields_messages(const Query& query);
+
+// Receives the results of a query.
+class QuerySink {
+ public:
+  virtual ~QuerySink() = default;
+  // a message the query ends on
+  virtual void Message(const ::google::protobuf::Message& msg) = 0;
+  // element |index| (-1 if not repeated) of the scalar field |field_desc| of |msg| the query ends on
+  virtual void Value(const ::google::protobuf::Message& msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                     int index) = 0;
+};
+
+void run_query(const Query& query, const ::google::protobuf::Message& msg, QuerySink* sink);
+
+// Spreads the elements of the repeated message field |query| starts with over worker_count() threads, each
+// handing its results to its own sink in |sinks|.
+void run_query_parallel(const Query& query, const ::google::protobuf::Message& msg,
+                        const std::vector<QuerySink*>& sinks);
+
+// Appends the results of |query| in |msg|, a message of the type it was parsed for, to |out|.
+void run_query(const Query& query, const ::google::protobuf::Message& msg, QueryOutput output, std::string* out);
+
+// Runs |query| over |paths|, each one message of the type of |prototype| or, with |delimited|, a log of them.
+// Records, and the elements of the repeated field a query on a single message starts with, are parsed one at a
+// time, in batches spread over worker_count() threads. Each thread hands its results to its own sink in |sinks|,
+// and |end_batch|, called between batches, may return false to fail the scan.
+bool scan_files(const Query& query, const ::google::protobuf::Message& prototype,
+                const std::vector<std::string>& paths, bool delimited, const std::vector<QuerySink*>& sinks,
+                const std::function<bool()>& end_batch);
+
+// Runs |query| over |paths| with scan_files(), and writes the results in order to |out|.
+bool query_files(const Query& query, const ::google::protobuf::Message& prototype,
+                 const std::vector<std::string>& paths, bool delimited, QueryOutput output, FILE* out);
+
+#endif  // QUERY_H_
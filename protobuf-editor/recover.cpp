@@ -0,0 +1,241 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "recover.h"
+
+#include <limits.h>
+
+#include <memory>
+#include <vector>
+
+#include "file.h"
+#include "log.h"
+#include "proto.h"
+#include "wire.h"
+
+// complete fields merged per parse; protobuf parses at most INT_MAX bytes at once
+static const uint64_t kMergeChunk = 64 << 20;
+
+// deepest submessage salvage_range() goes into
+static const int kMaxDepth = 100;
+
+// an upper bound on the records of a log, used to reject garbage length prefixes while resyncing
+static const uint64_t kMaxRecordSize = INT_MAX;
+
+static void mark_damage(SalvageReport* report, uint64_t offset) {
+  if (!report->damaged) {
+    report->damaged = true;
+    report->damage_offset = offset;
+  }
+}
+
+static bool merge_range(const uint8_t* data, uint64_t begin, uint64_t end, ::google::protobuf::Message* msg) {
+  ::google::protobuf::io::CodedInputStream input(data + begin, static_cast<int>(end - begin));
+  input.SetRecursionLimit(kMaxParseDepth);
+  return msg->MergePartialFromCodedStream(&input) && input.ConsumedEntireMessage() &&
+         input.CurrentPosition() == static_cast<int>(end - begin);
+}
+
+static bool salvage_range(const uint8_t* data, uint64_t begin, uint64_t end, ::google::protobuf::Message* msg,
+                          int depth, SalvageReport* report);
+
+// Salvages the payload [begin, end) of |field_number| into |msg|, if it is a message field.
+static void salvage_submessage(const uint8_t* data, uint64_t begin, uint64_t end, uint32_t field_number,
+                               ::google::protobuf::Message* msg, int depth, SalvageReport* report) {
+  const auto* field_desc = msg->GetDescriptor()->FindFieldByNumber(static_cast<int>(field_number));
+  if (nullptr == field_desc || field_desc->type() != ::google::protobuf::FieldDescriptor::TYPE_MESSAGE ||
+      depth >= kMaxDepth) {
+    return;
+  }
+  auto* reflection = msg->GetReflection();
+  if (field_desc->is_repeated()) {
+    salvage_range(data, begin, end, reflection->AddMessage(msg, field_desc), depth + 1, report);
+  } else if (!reflection->HasField(*msg, field_desc)) {
+    salvage_range(data, begin, end, reflection->MutableMessage(msg, field_desc), depth + 1, report);
+  } else {
+    // the field appeared before; on the wire a second occurrence merges into the first
+    std::unique_ptr<::google::protobuf::Message> sub(reflection->GetMessage(*msg, field_desc).New());
+    salvage_range(data, begin, end, sub.get(), depth + 1, report);
+    reflection->MutableMessage(msg, field_desc)->MergeFrom(*sub);
+  }
+}
+
+// |msg| must be empty. Returns true if the whole range was used.
+static bool salvage_range(const uint8_t* data, uint64_t begin, uint64_t end, ::google::protobuf::Message* msg,
+                          int depth, SalvageReport* report) {
+  // the complete fields, cut into chunks that each parse in one go
+  std::vector<uint64_t> chunks = {begin};
+  uint64_t good_end = begin;
+  WireField field;
+  while (good_end < end && decode_field(data, good_end, end, &field)) {
+    if (field.end - chunks.back() > kMergeChunk && good_end > chunks.back()) {
+      chunks.push_back(good_end);
+    }
+    good_end = field.end;
+  }
+  chunks.push_back(good_end);
+
+  for (size_t i = 0; i + 1 < chunks.size(); ++i) {
+    if (merge_range(data, chunks[i], chunks[i + 1], msg)) {
+      continue;
+    }
+    // well-formed on the wire but not for the schema; redo it one field at a time to find where
+    msg->Clear();
+    for (size_t j = 0; j < i; ++j) {
+      merge_range(data, chunks[j], chunks[j + 1], msg);
+    }
+    std::unique_ptr<::google::protobuf::Message> piece(msg->New());
+    for (uint64_t offset = chunks[i]; offset < chunks[i + 1]; offset = field.end) {
+      decode_field(data, offset, end, &field);
+      piece->Clear();
+      if (!merge_range(data, offset, field.end, piece.get())) {
+        if (field.wire_type == ::google::protobuf::internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+          salvage_submessage(data, field.payload_begin, field.payload_end, field.field_number, msg, depth, report);
+        }
+        mark_damage(report, offset);
+        return false;
+      }
+      msg->MergeFrom(*piece);
+    }
+  }
+  if (good_end == end) {
+    return true;
+  }
+
+  // the field at good_end is cut short or broken; a submessage keeps what it has
+  if (decode_header(data, good_end, end, &field) &&
+      field.wire_type == ::google::protobuf::internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+    salvage_submessage(data, field.payload_begin, std::min(field.payload_end, end), field.field_number, msg, depth,
+                       report);
+  }
+  mark_damage(report, good_end);
+  return false;
+}
+
+bool salvage_message(const uint8_t* data, size_t size, ::google::protobuf::Message* msg, SalvageReport* report) {
+  msg->Clear();
+  *report = SalvageReport();
+  salvage_range(data, 0, size, msg, 0, report);
+  return !report->damaged || msg->ByteSizeLong() > 0;
+}
+
+static bool read_length(const uint8_t* data, uint64_t* offset, uint64_t size, uint64_t* length) {
+  *length = 0;
+  for (int shift = 0; shift < 64 && *offset < size; shift += 7) {
+    uint8_t byte = data[(*offset)++];
+    *length |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return *length <= kMaxRecordSize;
+    }
+  }
+  return false;
+}
+
+// Whether a record made of well-formed fields starts at |offset|, and if so where it ends.
+static bool whole_record_at(const uint8_t* data, uint64_t offset, uint64_t size, uint64_t* record_end) {
+  uint64_t length;
+  if (!read_length(data, &offset, size, &length) || length > size - offset) {
+    return false;
+  }
+  *record_end = offset + length;
+  WireField field;
+  for (; offset < *record_end; offset = field.end) {
+    if (!decode_field(data, offset, *record_end, &field)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Whether |offset| is the end of the log or the start of a non-empty well-formed record.
+static bool record_boundary(const uint8_t* data, uint64_t offset, uint64_t size) {
+  uint64_t record_end;
+  return offset == size || (whole_record_at(data, offset, size, &record_end) && record_end > offset + 1);
+}
+
+bool salvage_delimited(const uint8_t* data, size_t size, ::google::protobuf::Message* scratch,
+                       const std::function<void(const ::google::protobuf::Message&)>& on_record,
+                       SalvageReport* report) {
+  *report = SalvageReport();
+
+  // salvages the payload [begin, end) of a record, returns whether it was whole
+  auto keep = [&](uint64_t begin, uint64_t end) {
+    scratch->Clear();
+    SalvageReport record_report;
+    bool whole = salvage_range(data, begin, end, scratch, 0, &record_report);
+    if (!whole) {
+      mark_damage(report, record_report.damage_offset);
+      if (scratch->ByteSizeLong() == 0) {
+        report->skipped_bytes += end - begin;
+        return;
+      }
+      ++report->partial_records;
+    }
+    ++report->records;
+    on_record(*scratch);
+  };
+
+  uint64_t offset = 0;
+  uint64_t record_end;
+  while (offset < size) {
+    uint64_t payload_begin = offset;
+    uint64_t length;
+    bool has_length = read_length(data, &payload_begin, size, &length);
+    if (has_length && length <= size - payload_begin) {
+      // trust the length when the record is well-formed, or when a well-formed one follows it
+      uint64_t end = payload_begin + length;
+      if (whole_record_at(data, offset, size, &record_end) || record_boundary(data, end, size)) {
+        keep(payload_begin, end);
+        offset = end;
+        continue;
+      }
+    }
+
+    mark_damage(report, offset);
+    uint64_t next = offset + 1;
+    for (; next < size; ++next) {
+      if (whole_record_at(data, next, size, &record_end) && record_end > next + 1 &&
+          record_boundary(data, record_end, size)) {
+        break;
+      }
+    }
+    if (next == size && has_length && length > size - payload_begin) {
+      // nothing whole follows, so this is a record cut off by the end of the file
+      keep(payload_begin, size);
+      break;
+    }
+    report->skipped_bytes += next - offset;
+    offset = next;
+  }
+  return report->records > 0;
+}
+
+bool salvage_file(const std::string& path, ::google::protobuf::Message* msg, SalvageReport* report) {
+  MappedFile file;
+  if (!file.Open(path, true)) {
+    return false;
+  }
+  bool ret = salvage_message(file.data(), file.size(), msg, report);
+  if (report->damaged) {
+    PBE_LOG_WARNING("%s is damaged at offset %llu of %zu\n", path.c_str(),
+                    static_cast<unsigned long long>(report->damage_offset), file.size());
+  }
+  return ret;
+}
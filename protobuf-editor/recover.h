@@ -0,0 +1,57 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef RECOVER_H_
+#define RECOVER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+
+#include "protobuf_include.h"
+
+struct SalvageReport {
+  bool damaged = false;
+  uint64_t damage_offset = 0;  // first byte that couldn't be used
+  // delimited logs only
+  size_t records = 0;          // kept, including partial ones
+  size_t partial_records = 0;
+  uint64_t skipped_bytes = 0;  // jumped over while looking for the next record
+};
+
+// Keeps every complete field of the message in [data, data + size) up to the first damage. A submessage that
+// the damage cuts through is kept with its own complete fields. Required fields may end up missing. Returns
+// false if nothing could be recovered.
+bool salvage_message(const uint8_t* data, size_t size, ::google::protobuf::Message* msg, SalvageReport* report);
+
+// A log of records, each one prefixed with its varint length. Damaged records are salvaged as above; when a
+// length prefix itself is broken, bytes are skipped up to the next offset where a whole record parses.
+// |on_record| gets every record kept, in order.
+bool salvage_delimited(const uint8_t* data, size_t size, ::google::protobuf::Message* scratch,
+                       const std::function<void(const ::google::protobuf::Message&)>& on_record,
+                       SalvageReport* report);
+
+// salvage_message() over a memory-mapped file.
+bool salvage_file(const std::string& path, ::google::protobuf::Message* msg, SalvageReport* report);
+
+#endif  // RECOVER_H_
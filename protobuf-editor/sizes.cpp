@@ -0,0 +1,509 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "sizes.h"
+
+#include <algorithm>
+#include <vector>
+
+// values measured per document lock: fields of a message, elements of a field, or scalars
+static const size_t kValuesPerLock = 16384;
+
+typedef ::google::protobuf::internal::WireFormatLite WireFormatLite;
+
+static size_t tag_size(const ::google::protobuf::FieldDescriptor* field_desc) {
+  // both tags of a group
+  return WireFormatLite::TagSize(field_desc->number(), static_cast<WireFormatLite::FieldType>(field_desc->type()));
+}
+
+static bool is_set(const ::google::protobuf::Message& msg, const ::google::protobuf::FieldDescriptor* field_desc) {
+  const auto* reflection = msg.GetReflection();
+  return field_desc->is_repeated() ? reflection->FieldSize(msg, field_desc) > 0 : reflection->HasField(msg, field_desc);
+}
+
+// Wire size, without the tag, and RAM of one value of a scalar field: element |index| if it's repeated, or else
+// the singular value, whose RAM is counted with the message holding it when |inline_ram| is false.
+static void scalar_value_size(const ::google::protobuf::Message& msg,
+                              const ::google::protobuf::FieldDescriptor* field_desc, int index, bool inline_ram,
+                              uint64_t* wire, uint64_t* ram) {
+  typedef ::google::protobuf::FieldDescriptor FieldDescriptor;
+  const auto* reflection = msg.GetReflection();
+  bool repeated = index >= 0;
+  size_t value_wire = 0;
+  size_t value_ram = 0;
+  switch (field_desc->type()) {
+    case FieldDescriptor::TYPE_DOUBLE:
+    case FieldDescriptor::TYPE_FIXED64:
+    case FieldDescriptor::TYPE_SFIXED64:
+      value_wire = value_ram = 8;
+      break;
+    case FieldDescriptor::TYPE_FLOAT:
+    case FieldDescriptor::TYPE_FIXED32:
+    case FieldDescriptor::TYPE_SFIXED32:
+      value_wire = value_ram = 4;
+      break;
+    case FieldDescriptor::TYPE_BOOL:
+      value_wire = 1;
+      value_ram = sizeof(bool);
+      break;
+    case FieldDescriptor::TYPE_INT32:
+      value_wire = WireFormatLite::Int32Size(repeated ? reflection->GetRepeatedInt32(msg, field_desc, index)
+                                                      : reflection->GetInt32(msg, field_desc));
+      value_ram = 4;
+      break;
+    case FieldDescriptor::TYPE_SINT32:
+      value_wire = WireFormatLite::SInt32Size(repeated ? reflection->GetRepeatedInt32(msg, field_desc, index)
+                                                       : reflection->GetInt32(msg, field_desc));
+      value_ram = 4;
+      break;
+    case FieldDescriptor::TYPE_UINT32:
+      value_wire = WireFormatLite::UInt32Size(repeated ? reflection->GetRepeatedUInt32(msg, field_desc, index)
+                                                       : reflection->GetUInt32(msg, field_desc));
+      value_ram = 4;
+      break;
+    case FieldDescriptor::TYPE_ENUM:
+      value_wire = WireFormatLite::EnumSize(repeated ? reflection->GetRepeatedEnumValue(msg, field_desc, index)
+                                                     : reflection->GetEnumValue(msg, field_desc));
+      value_ram = 4;
+      break;
+    case FieldDescriptor::TYPE_INT64:
+      value_wire = WireFormatLite::Int64Size(repeated ? reflection->GetRepeatedInt64(msg, field_desc, index)
+                                                      : reflection->GetInt64(msg, field_desc));
+      value_ram = 8;
+      break;
+    case FieldDescriptor::TYPE_SINT64:
+      value_wire = WireFormatLite::SInt64Size(repeated ? reflection->GetRepeatedInt64(msg, field_desc, index)
+                                                       : reflection->GetInt64(msg, field_desc));
+      value_ram = 8;
+      break;
+    case FieldDescriptor::TYPE_UINT64:
+      value_wire = WireFormatLite::UInt64Size(repeated ? reflection->GetRepeatedUInt64(msg, field_desc, index)
+                                                       : reflection->GetUInt64(msg, field_desc));
+      value_ram = 8;
+      break;
+    case FieldDescriptor::TYPE_STRING:
+    case FieldDescriptor::TYPE_BYTES: {
+      std::string scratch;
+      const std::string& str = repeated ? reflection->GetRepeatedStringReference(msg, field_desc, index, &scratch)
+                                        : reflection->GetStringReference(msg, field_desc, &scratch);
+      value_wire = WireFormatLite::LengthDelimitedSize(str.size());
+      // strings are held by pointer, so they are never inline
+      *wire += value_wire;
+      *ram += sizeof(std::string) + (str.capacity() > 15 ? str.capacity() : 0);
+      return;
+    }
+    case FieldDescriptor::TYPE_GROUP:
+    case FieldDescriptor::TYPE_MESSAGE:
+      return;
+  }
+  *wire += value_wire;
+  if (repeated || inline_ram) {
+    *ram += value_ram;
+  }
+}
+
+// Measures one field of a message, and the messages below it, a bounded number of values at a time so that
+// the document mutex can be released in between. The position is a stack of the fields and messages being
+// summed, whose messages are found again from the root on each step.
+class FieldWalk {
+ public:
+  FieldWalk(const FieldPath& path, int field_number) : path_(path), field_number_(field_number) {}
+
+  // Measures at most |budget| more values. Returns false if the field is gone.
+  bool Step(::google::protobuf::Message* root, size_t budget, bool* done);
+  const SubtreeSize& size() const { return size_; }
+
+ private:
+  struct Frame {
+    // the fields of |msg| are being summed, or else the values of field |field_desc| of |msg|
+    bool message;
+    const ::google::protobuf::Message* msg;
+    const ::google::protobuf::FieldDescriptor* field_desc;
+    int index;  // of a message frame, in the field frame below it, -1 if that is singular
+    int count;  // of a field frame: its elements, or 1 if a singular field is set
+    int next;   // the next field, or element, to measure
+    uint64_t wire;
+    uint64_t ram;
+  };
+
+  bool Resolve(::google::protobuf::Message* root);
+  void PushField(const ::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc);
+  void FinishField();
+  void FinishMessage();
+  uint64_t ObjectSize(const ::google::protobuf::Message& msg);
+
+  FieldPath path_;
+  int field_number_;
+  bool started_ = false;
+  std::vector<Frame> stack_;
+  SubtreeSize size_;
+  std::unordered_map<const ::google::protobuf::Descriptor*, uint64_t> object_sizes_;
+};
+
+bool FieldWalk::Resolve(::google::protobuf::Message* root) {
+  const ::google::protobuf::Message* owner = resolve_path(root, path_);
+  if (nullptr == owner) {
+    return false;
+  }
+  for (size_t k = 0; k < stack_.size(); ++k) {
+    Frame& frame = stack_[k];
+    if (!frame.message) {
+      frame.msg = owner;
+      continue;
+    }
+    // the counts were taken under an earlier lock, edits that change them also stop the walk
+    const auto* field_desc = stack_[k - 1].field_desc;
+    const auto* reflection = owner->GetReflection();
+    bool exists = frame.index < 0 ? reflection->HasField(*owner, field_desc)
+                                  : frame.index < reflection->FieldSize(*owner, field_desc);
+    if (!exists) {
+      return false;
+    }
+    frame.msg = frame.index < 0 ? &reflection->GetMessage(*owner, field_desc)
+                                : &reflection->GetRepeatedMessage(*owner, field_desc, frame.index);
+    owner = frame.msg;
+  }
+  return true;
+}
+
+void FieldWalk::PushField(const ::google::protobuf::Message* msg,
+                          const ::google::protobuf::FieldDescriptor* field_desc) {
+  const auto* reflection = msg->GetReflection();
+  int count = field_desc->is_repeated() ? reflection->FieldSize(*msg, field_desc)
+                                        : (reflection->HasField(*msg, field_desc) ? 1 : 0);
+  stack_.push_back({false, msg, field_desc, -1, count, 0, 0, 0});
+}
+
+void FieldWalk::FinishField() {
+  Frame field = stack_.back();
+  stack_.pop_back();
+  const auto* field_desc = field.field_desc;
+  uint64_t wire = field.wire;
+  if (field_desc->cpp_type() != ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE && field.count > 0) {
+    // the scalar values were summed without their tags
+    if (field_desc->is_packed()) {
+      wire = tag_size(field_desc) + WireFormatLite::LengthDelimitedSize(wire);
+    } else {
+      wire += static_cast<uint64_t>(field.count) * tag_size(field_desc);
+    }
+  }
+  if (stack_.empty()) {
+    size_.items = static_cast<uint64_t>(field.count);
+    size_.wire = wire;
+    size_.ram = field.ram;
+    return;
+  }
+  stack_.back().wire += wire;
+  stack_.back().ram += field.ram;
+}
+
+void FieldWalk::FinishMessage() {
+  Frame message = stack_.back();
+  stack_.pop_back();
+  const auto& unknown = message.msg->GetReflection()->GetUnknownFields(*message.msg);
+  uint64_t wire = message.wire + ::google::protobuf::internal::WireFormat::ComputeUnknownFieldsSize(unknown);
+  uint64_t ram = message.ram + ObjectSize(*message.msg) + unknown.SpaceUsedExcludingSelfLong();
+  Frame& field = stack_.back();
+  bool is_group = field.field_desc->type() == ::google::protobuf::FieldDescriptor::TYPE_GROUP;
+  field.wire += tag_size(field.field_desc) + (is_group ? wire : WireFormatLite::LengthDelimitedSize(wire));
+  field.ram += ram + (field.field_desc->is_repeated() ? sizeof(void*) : 0);
+}
+
+uint64_t FieldWalk::ObjectSize(const ::google::protobuf::Message& msg) {
+  const auto* desc = msg.GetDescriptor();
+  auto found = object_sizes_.find(desc);
+  if (found == object_sizes_.end()) {
+    // an empty message takes just its object
+    const auto* prototype = msg.GetReflection()->GetMessageFactory()->GetPrototype(desc);
+    found = object_sizes_.emplace(desc, prototype->SpaceUsedLong()).first;
+  }
+  return found->second;
+}
+
+bool FieldWalk::Step(::google::protobuf::Message* root, size_t budget, bool* done) {
+  *done = false;
+  if (!started_) {
+    auto* owner = resolve_path(root, path_);
+    const auto* field_desc = nullptr == owner ? nullptr : owner->GetDescriptor()->FindFieldByNumber(field_number_);
+    if (nullptr == field_desc) {
+      return false;
+    }
+    started_ = true;
+    PushField(owner, field_desc);
+  } else if (!Resolve(root)) {
+    return false;
+  }
+
+  while (budget > 0 && !stack_.empty()) {
+    Frame& top = stack_.back();
+    if (top.message) {
+      const auto* desc = top.msg->GetDescriptor();
+      if (top.next == desc->field_count()) {
+        FinishMessage();
+        continue;
+      }
+      const auto* msg = top.msg;
+      const auto* field_desc = desc->field(top.next++);
+      --budget;
+      if (is_set(*msg, field_desc)) {
+        PushField(msg, field_desc);
+      }
+      continue;
+    }
+
+    if (top.next == top.count) {
+      FinishField();
+      continue;
+    }
+    const auto* reflection = top.msg->GetReflection();
+    const auto* field_desc = top.field_desc;
+    bool repeated = field_desc->is_repeated();
+    if (field_desc->cpp_type() == ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+      int index = repeated ? top.next : -1;
+      const auto* element = repeated ? &reflection->GetRepeatedMessage(*top.msg, field_desc, index)
+                                     : &reflection->GetMessage(*top.msg, field_desc);
+      ++top.next;
+      --budget;
+      stack_.push_back({true, element, nullptr, index, 0, 0, 0, 0});
+      continue;
+    }
+    // a value that is part of the object holding it is counted with that object, except at the top
+    bool inline_ram = stack_.size() == 1;
+    int end = top.count - top.next < static_cast<int>(budget) ? top.count : top.next + static_cast<int>(budget);
+    for (int k = top.next; k < end; ++k) {
+      scalar_value_size(*top.msg, field_desc, repeated ? k : -1, inline_ram, &top.wire, &top.ram);
+    }
+    budget -= static_cast<size_t>(end - top.next);
+    top.next = end;
+  }
+  *done = stack_.empty();
+  return true;
+}
+
+SizeCache::~SizeCache() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+std::string SizeCache::Key(const FieldPath& path, int field_number) {
+  std::string key;
+  for (const auto& step : path) {
+    key += std::to_string(step.field_number) + ":" + std::to_string(step.index) + "/";
+  }
+  return key + "#" + std::to_string(field_number);
+}
+
+bool SizeCache::Lookup(const FieldPath& path, int field_number, SubtreeSize* out, bool* stale) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string key = Key(path, field_number);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    it = entries_.emplace(key, Entry()).first;
+    it->second.path = path;
+    it->second.field_number = field_number;
+    it->second.generation = ++generations_;
+  }
+  Entry& entry = it->second;
+  if (!entry.fresh && !entry.pending) {
+    entry.pending = true;
+    queue_.push_back(key);
+    if (!worker_.joinable()) {
+      worker_ = std::thread(&SizeCache::Run, this);
+    }
+    wake_.notify_one();
+  }
+  if (nullptr != stale) {
+    *stale = entry.known && !entry.fresh;
+  }
+  *out = entry.size;
+  return entry.known;
+}
+
+bool SizeCache::Affected(const Entry& entry, const FieldPath& path, int field_number) {
+  // entries above the edit: the fields on the way down to it, and the messages containing it
+  size_t common = 0;
+  while (common < entry.path.size() && common < path.size() &&
+         entry.path[common].field_number == path[common].field_number &&
+         entry.path[common].index == path[common].index) {
+    ++common;
+  }
+  if (common == entry.path.size()) {
+    if (entry.field_number == kWholeMessage) {
+      return true;
+    }
+    int edited_field = common < path.size() ? path[common].field_number : field_number;
+    return entry.field_number == edited_field;
+  }
+  // entries below the edited field, whose elements may have moved
+  return common == path.size() && entry.path[common].field_number == field_number;
+}
+
+void SizeCache::Invalidate(const FieldPath& path, int field_number) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& key_entry : entries_) {
+    if (Affected(key_entry.second, path, field_number)) {
+      key_entry.second.fresh = false;
+      key_entry.second.generation = ++generations_;
+    }
+  }
+}
+
+void SizeCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  queue_.clear();
+}
+
+void SizeCache::Run() {
+  while (true) {
+    std::string key;
+    FieldPath path;
+    int field_number;
+    uint64_t generation;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (stop_) {
+        return;
+      }
+      key = std::move(queue_.front());
+      queue_.pop_front();
+      auto it = entries_.find(key);
+      if (it == entries_.end()) {
+        continue;
+      }
+      path = it->second.path;
+      field_number = it->second.field_number;
+      generation = it->second.generation;
+    }
+
+    SubtreeSize size;
+    bool ok = field_number == kWholeMessage ? ComputeMessage(key, generation, path, &size)
+                                            : ComputeField(key, generation, path, field_number, &size);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      continue;
+    }
+    // if an edit touched it meanwhile, the next Lookup() queues it again
+    it->second.pending = false;
+    if (ok && generation == it->second.generation) {
+      it->second.size = size;
+      it->second.known = true;
+      it->second.fresh = true;
+    }
+  }
+}
+
+bool SizeCache::Current(const std::string& key, uint64_t generation) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  return !stop_ && it != entries_.end() && it->second.generation == generation;
+}
+
+void SizeCache::Store(const std::string& key, uint64_t generation, const SubtreeSize& size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it != entries_.end() && it->second.generation == generation) {
+    it->second.size = size;
+    it->second.known = true;
+    it->second.fresh = true;
+  }
+}
+
+bool SizeCache::ComputeField(const std::string& key, uint64_t generation, const FieldPath& path, int field_number,
+                             SubtreeSize* out) {
+  FieldWalk walk(path, field_number);
+  bool done = false;
+  while (!done) {
+    std::lock_guard<std::mutex> lock(*document_mutex_);
+    if (!Current(key, generation) || !walk.Step(root_, kValuesPerLock, &done)) {
+      return false;
+    }
+  }
+  *out = walk.size();
+  return true;
+}
+
+bool SizeCache::FieldSize(const FieldPath& path, int field_number, SubtreeSize* out) {
+  std::string key = Key(path, field_number);
+  uint64_t generation;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      it = entries_.emplace(key, Entry()).first;
+      it->second.path = path;
+      it->second.field_number = field_number;
+      it->second.generation = ++generations_;
+    }
+    if (it->second.fresh) {
+      *out = it->second.size;
+      return true;
+    }
+    generation = it->second.generation;
+  }
+  if (!ComputeField(key, generation, path, field_number, out)) {
+    return false;
+  }
+  Store(key, generation, *out);
+  return true;
+}
+
+bool SizeCache::ComputeMessage(const std::string& key, uint64_t generation, const FieldPath& path,
+                               SubtreeSize* out) {
+  std::vector<int> fields;
+  {
+    std::lock_guard<std::mutex> lock(*document_mutex_);
+    auto* msg = Current(key, generation) ? resolve_path(root_, path) : nullptr;
+    if (nullptr == msg) {
+      return false;
+    }
+    const auto* desc = msg->GetDescriptor();
+    const auto* reflection = msg->GetReflection();
+    const auto& unknown = reflection->GetUnknownFields(*msg);
+    out->items = 1;
+    out->wire = ::google::protobuf::internal::WireFormat::ComputeUnknownFieldsSize(unknown);
+    out->ram = reflection->GetMessageFactory()->GetPrototype(desc)->SpaceUsedLong() +
+               unknown.SpaceUsedExcludingSelfLong();
+    for (int i = 0; i < desc->field_count(); ++i) {
+      if (is_set(*msg, desc->field(i))) {
+        fields.push_back(desc->field(i)->number());
+      }
+    }
+  }
+  // an edit of one of the fields touches this entry too, so the sum is only stored if none was edited
+  for (int field_number : fields) {
+    SubtreeSize size;
+    if (!FieldSize(path, field_number, &size) || !Current(key, generation)) {
+      return false;
+    }
+    out->wire += size.wire;
+    out->ram += size.ram;
+  }
+  return true;
+}
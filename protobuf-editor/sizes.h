@@ -0,0 +1,103 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SIZES_H_
+#define SIZES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "field_path.h"
+#include "protobuf_include.h"
+
+struct SubtreeSize {
+  uint64_t items = 0;
+  uint64_t wire = 0;  // ByteSizeLong, including tags and length prefixes
+  uint64_t ram = 0;   // about SpaceUsedLong, without the spare capacity of repeated fields
+};
+
+// Sizes of document subtrees, computed on a background thread and kept until an edit touches them.
+// A subtree is either one field of a message or, with kWholeMessage, the message itself, whose size is the sum
+// of those of its fields. The worker holds |document_mutex| only while it measures a bounded number of values,
+// however large or deep the field, so whoever edits the document (and holds the mutex while doing so) never
+// waits long. An edit only stops the computations of the subtrees it touched.
+class SizeCache {
+ public:
+  static const int kWholeMessage = 0;
+
+  SizeCache(std::mutex* document_mutex, ::google::protobuf::Message* root)
+      : document_mutex_(document_mutex), root_(root) {}
+  ~SizeCache();
+
+  // Returns false if nothing is known yet, and queues the computation. |stale| is set when the
+  // returned value predates an edit and is being recomputed.
+  bool Lookup(const FieldPath& path, int field_number, SubtreeSize* out, bool* stale = nullptr);
+
+  // Called (with the document mutex held) after |field_number| of the message at |path| changed.
+  void Invalidate(const FieldPath& path, int field_number);
+  void Clear();
+
+ private:
+  struct Entry {
+    FieldPath path;
+    int field_number;
+    SubtreeSize size;
+    bool known = false;    // |size| was computed at some point
+    bool fresh = false;    // and no edit touched it since
+    bool pending = false;  // queued or being computed
+    uint64_t generation = 0;  // changes whenever an edit touches it
+  };
+
+  static std::string Key(const FieldPath& path, int field_number);
+  static bool Affected(const Entry& entry, const FieldPath& path, int field_number);
+
+  void Run();
+  // Whether the entry of |key| is still at |generation|, and the cache still running.
+  bool Current(const std::string& key, uint64_t generation);
+  // Stores |size| as the entry of |key| if it is still at |generation|.
+  void Store(const std::string& key, uint64_t generation, const SubtreeSize& size);
+  // These return false if the subtree changed under them.
+  bool ComputeField(const std::string& key, uint64_t generation, const FieldPath& path, int field_number,
+                    SubtreeSize* out);
+  bool ComputeMessage(const std::string& key, uint64_t generation, const FieldPath& path, SubtreeSize* out);
+  // The size of a field of the message at |path|, from its entry if that is fresh, or else computed into it.
+  bool FieldSize(const FieldPath& path, int field_number, SubtreeSize* out);
+
+  std::mutex* document_mutex_;
+  ::google::protobuf::Message* root_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::unordered_map<std::string, Entry> entries_;
+  std::deque<std::string> queue_;
+  uint64_t generations_ = 0;  // handed out, never twice, so that a computation started before Clear() is dropped
+  bool stop_ = false;
+  std::thread worker_;
+};
+
+#endif  // SIZES_H_
@@ -1,5 +1,7 @@
 #include "string.h"
 
+#include <stdio.h>
+
 #include <algorithm>
 #include <fstream>
 
@@ -14,3 +16,28 @@ void split_by_multiple_delimiters(const std::string &delims, const std::string &
     out->push_back(str.substr(beg, pos - beg));
   }
 }
+
+bool ends_with(const std::string &str, const std::string &suffix) {
+  return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static std::string with_suffix(uint64_t value, const char *unit) {
+  static const char *kPrefixes[] = {"", "K", "M", "G", "T", "P"};
+  size_t prefix = 0;
+  double scaled = static_cast<double>(value);
+  while (scaled >= 1000 && prefix + 1 < sizeof(kPrefixes) / sizeof(kPrefixes[0])) {
+    scaled /= 1000;
+    ++prefix;
+  }
+  char buf[32];
+  if (prefix == 0) {
+    snprintf(buf, sizeof(buf), "%llu%s", static_cast<unsigned long long>(value), unit);
+  } else {
+    snprintf(buf, sizeof(buf), scaled < 10 ? "%.1f%s%s" : "%.0f%s%s", scaled, kPrefixes[prefix], unit);
+  }
+  return buf;
+}
+
+std::string human_count(uint64_t count) { return with_suffix(count, ""); }
+
+std::string human_bytes(uint64_t bytes) { return with_suffix(bytes, "B"); }
@@ -1,10 +1,20 @@
 #ifndef STRING_H_
 #define STRING_H_
 
+#include <stdint.h>
+
 #include <sstream>
 #include <string>
 #include <vector>
 
 void split_by_multiple_delimiters(const std::string &delims, const std::string &str, std::vector<std::string> *out);
 
+bool ends_with(const std::string &str, const std::string &suffix);
+
+// 1234567 -> "1.2M"
+std::string human_count(uint64_t count);
+
+// 1234567 -> "1.2MB"
+std::string human_bytes(uint64_t bytes);
+
 #endif  // STRING_H_`
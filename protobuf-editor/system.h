@@ -1,9 +0,0 @@
-#ifndef SYSTEM_H_
-#define SYSTEM_H_
-
-#include <string>
-
-// https://stackoverflow.com/questions/478898/how-do-i-execute-a-command-and-get-the-output-of-the-command-within-c-using-po
-std::string exec(const char* cmd);
-
-#endif  // SYSTEM_H_
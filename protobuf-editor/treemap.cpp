@@ -0,0 +1,103 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "treemap.h"
+
+#include <algorithm>
+
+// worst aspect ratio of a row of areas laid along a side of length |side|
+static double worst_ratio(double sum, double smallest, double largest, double side) {
+  double side_sq = side * side;
+  double sum_sq = sum * sum;
+  return std::max(side_sq * largest / sum_sq, sum_sq / (side_sq * smallest));
+}
+
+void squarify(const std::vector<double>& values, float x, float y, float w, float h, std::vector<TreemapRect>* out) {
+  if (nullptr == out) {
+    return;
+  }
+  out->clear();
+  if (w <= 0 || h <= 0) {
+    return;
+  }
+
+  std::vector<size_t> order;
+  double total = 0;
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (values[i] > 0) {
+      order.push_back(i);
+      total += values[i];
+    }
+  }
+  if (order.empty()) {
+    return;
+  }
+  std::sort(order.begin(), order.end(), [&values](size_t a, size_t b) { return values[a] > values[b]; });
+
+  double scale = static_cast<double>(w) * static_cast<double>(h) / total;
+  double rx = x, ry = y, rw = w, rh = h;
+  size_t begin = 0;
+  while (begin < order.size()) {
+    double side = std::min(rw, rh);
+    double sum = values[order[begin]] * scale;
+    double largest = sum;
+    double smallest = sum;
+    double worst = worst_ratio(sum, smallest, largest, side);
+    size_t end = begin + 1;
+    // areas are sorted, so the newest one is always the smallest of the row
+    for (; end < order.size(); ++end) {
+      double area = values[order[end]] * scale;
+      double next = worst_ratio(sum + area, area, largest, side);
+      if (next > worst) {
+        break;
+      }
+      sum += area;
+      smallest = area;
+      worst = next;
+    }
+
+    if (rw >= rh) {
+      // column along the left edge
+      double width = sum / rh;
+      double cy = ry;
+      for (size_t i = begin; i < end; ++i) {
+        double height = values[order[i]] * scale / width;
+        out->push_back({order[i], static_cast<float>(rx), static_cast<float>(cy), static_cast<float>(width),
+                        static_cast<float>(height)});
+        cy += height;
+      }
+      rx += width;
+      rw -= width;
+    } else {
+      // row along the top edge
+      double height = sum / rw;
+      double cx = rx;
+      for (size_t i = begin; i < end; ++i) {
+        double width = values[order[i]] * scale / height;
+        out->push_back({order[i], static_cast<float>(cx), static_cast<float>(ry), static_cast<float>(width),
+                        static_cast<float>(height)});
+        cx += width;
+      }
+      ry += height;
+      rh -= height;
+    }
+    begin = end;
+  }
+}
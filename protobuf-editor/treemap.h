@@ -0,0 +1,38 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TREEMAP_H_
+#define TREEMAP_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+struct TreemapRect {
+  size_t index;  // into the values passed to squarify()
+  float x, y, w, h;
+};
+
+// Squarified treemap (Bruls, Huizing, van Wijk): lays |values| out in the rectangle (x, y, w, h) with areas
+// proportional to the values, keeping the rectangles as close to square as it can. Non-positive values get
+// no rectangle.
+void squarify(const std::vector<double>& values, float x, float y, float w, float h, std::vector<TreemapRect>* out);
+
+#endif  // TREEMAP_H_
@@ -0,0 +1,317 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "undo.h"
+
+#include <memory>
+#include <utility>
+
+#include "log.h"
+
+static const std::chrono::milliseconds kCoalesceWindow(1000);
+
+constexpr size_t UndoStack::kDefaultMemoryCap;
+
+static bool merge_partial(::google::protobuf::Message* msg, const std::string& encoded) {
+  ::google::protobuf::io::CodedInputStream input(reinterpret_cast<const uint8_t*>(encoded.data()),
+                                                 static_cast<int>(encoded.size()));
+  return msg->MergePartialFromCodedStream(&input) && input.ConsumedEntireMessage();
+}
+
+static void add_element_copy(const ::google::protobuf::Message& from,
+                             const ::google::protobuf::FieldDescriptor* field_desc, int index,
+                             ::google::protobuf::Message* to) {
+  auto* from_reflection = from.GetReflection();
+  auto* to_reflection = to->GetReflection();
+  switch (field_desc->cpp_type()) {
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+      to_reflection->AddInt32(to, field_desc, from_reflection->GetRepeatedInt32(from, field_desc, index));
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+      to_reflection->AddInt64(to, field_desc, from_reflection->GetRepeatedInt64(from, field_desc, index));
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+      to_reflection->AddUInt32(to, field_desc, from_reflection->GetRepeatedUInt32(from, field_desc, index));
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+      to_reflection->AddUInt64(to, field_desc, from_reflection->GetRepeatedUInt64(from, field_desc, index));
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+      to_reflection->AddDouble(to, field_desc, from_reflection->GetRepeatedDouble(from, field_desc, index));
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+      to_reflection->AddFloat(to, field_desc, from_reflection->GetRepeatedFloat(from, field_desc, index));
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+      to_reflection->AddBool(to, field_desc, from_reflection->GetRepeatedBool(from, field_desc, index));
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_ENUM:
+      to_reflection->AddEnumValue(to, field_desc, from_reflection->GetRepeatedEnumValue(from, field_desc, index));
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+      to_reflection->AddString(to, field_desc, from_reflection->GetRepeatedString(from, field_desc, index));
+      break;
+    case ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE:
+      to_reflection->AddMessage(to, field_desc)->CopyFrom(from_reflection->GetRepeatedMessage(from, field_desc, index));
+      break;
+  }
+}
+
+std::string encode_field(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                         int index) {
+  auto* reflection = msg->GetReflection();
+  std::string out;
+  if (index < 0) {
+    if (field_desc->is_repeated() ? 0 == reflection->FieldSize(*msg, field_desc)
+                                  : !reflection->HasField(*msg, field_desc)) {
+      return out;
+    }
+    // move the field into an empty message, serialize it there and move it back, so nothing is copied
+    std::unique_ptr<::google::protobuf::Message> scratch(msg->New());
+    reflection->SwapFields(msg, scratch.get(), {field_desc});
+    scratch->SerializePartialToString(&out);
+    reflection->SwapFields(msg, scratch.get(), {field_desc});
+    return out;
+  }
+
+  if (field_desc->type() == ::google::protobuf::FieldDescriptor::TYPE_MESSAGE) {
+    const auto& element = reflection->GetRepeatedMessage(*msg, field_desc, index);
+    ::google::protobuf::io::StringOutputStream stream(&out);
+    ::google::protobuf::io::CodedOutputStream output(&stream);
+    output.WriteTag(::google::protobuf::internal::WireFormatLite::MakeTag(
+        field_desc->number(), ::google::protobuf::internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    output.WriteVarint32(static_cast<uint32_t>(element.ByteSizeLong()));
+    element.SerializeWithCachedSizes(&output);
+    return out;
+  }
+
+  std::unique_ptr<::google::protobuf::Message> scratch(msg->New());
+  add_element_copy(*msg, field_desc, index, scratch.get());
+  scratch->SerializePartialToString(&out);
+  return out;
+}
+
+bool restore_field(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc, int index,
+                   const std::string& encoded) {
+  auto* reflection = msg->GetReflection();
+  if (index < 0) {
+    reflection->ClearField(msg, field_desc);
+    return merge_partial(msg, encoded);
+  }
+
+  // the encoded element is appended, then takes the place of the old one
+  int size = reflection->FieldSize(*msg, field_desc);
+  if (index >= size || !merge_partial(msg, encoded) || reflection->FieldSize(*msg, field_desc) != size + 1) {
+    return false;
+  }
+  reflection->SwapElements(msg, field_desc, index, size);
+  reflection->RemoveLast(msg, field_desc);
+  return true;
+}
+
+bool insert_repeated_element(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                             int index, const std::string& encoded) {
+  auto* reflection = msg->GetReflection();
+  int size = reflection->FieldSize(*msg, field_desc);
+  if (index > size || !merge_partial(msg, encoded) || reflection->FieldSize(*msg, field_desc) != size + 1) {
+    return false;
+  }
+  for (int m = size; m > index; --m) {
+    reflection->SwapElements(msg, field_desc, m, m - 1);
+  }
+  return true;
+}
+
+void remove_repeated_element(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                             int index) {
+  auto* reflection = msg->GetReflection();
+  int size = reflection->FieldSize(*msg, field_desc);
+  for (int m = index; m < size - 1; ++m) {
+    reflection->SwapElements(msg, field_desc, m, m + 1);
+  }
+  // delete elements from reflection
+  reflection->RemoveLast(msg, field_desc);
+}
+
+void UndoStack::RecordSet(const FieldPath& path, const ::google::protobuf::FieldDescriptor* field_desc, int index,
+                          std::string before, std::string after) {
+  auto now = std::chrono::steady_clock::now();
+  if (!undo_.empty()) {
+    auto& last = undo_.back();
+    if (last.kind == Kind::kSet && last.field_number == field_desc->number() && last.index == index &&
+        now - last.time < kCoalesceWindow && same_path(last.path, path)) {
+      for (const auto& delta : redo_) {
+        memory_used_ -= Cost(delta);
+      }
+      redo_.clear();
+      memory_used_ -= Cost(last);
+      last.after = std::move(after);
+      last.time = now;
+      if (last.before == last.after) {
+        undo_.pop_back();
+      } else {
+        memory_used_ += Cost(last);
+        Trim();
+      }
+      return;
+    }
+  }
+  Push({Kind::kSet, path, field_desc->number(), index, std::move(before), std::move(after), now});
+}
+
+void UndoStack::RecordInsert(const FieldPath& path, const ::google::protobuf::FieldDescriptor* field_desc, int index,
+                             std::string element) {
+  Push({Kind::kInsert, path, field_desc->number(), index, std::string(), std::move(element),
+        std::chrono::steady_clock::now()});
+}
+
+void UndoStack::RecordRemove(const FieldPath& path, const ::google::protobuf::FieldDescriptor* field_desc, int index,
+                             std::string element) {
+  Push({Kind::kRemove, path, field_desc->number(), index, std::move(element), std::string(),
+        std::chrono::steady_clock::now()});
+}
+
+void UndoStack::RecordUntracked() {
+  for (const auto& delta : redo_) {
+    memory_used_ -= Cost(delta);
+  }
+  redo_.clear();
+  if (!undo_.empty()) {
+    undo_.back().time = std::chrono::steady_clock::time_point();
+  }
+}
+
+bool UndoStack::Undo(::google::protobuf::Message* root, FieldPath* path, int* field_number) {
+  if (undo_.empty()) {
+    return false;
+  }
+  Delta delta = std::move(undo_.back());
+  undo_.pop_back();
+  if (!Apply(root, delta, false)) {
+    // the document does not match the history anymore
+    PBE_LOG_WARNING("can't undo, dropping history\n");
+    memory_used_ -= Cost(delta);
+    Clear();
+    return false;
+  }
+  if (nullptr != path) {
+    *path = delta.path;
+  }
+  if (nullptr != field_number) {
+    *field_number = delta.field_number;
+  }
+  redo_.push_back(std::move(delta));
+  return true;
+}
+
+bool UndoStack::Redo(::google::protobuf::Message* root, FieldPath* path, int* field_number) {
+  if (redo_.empty()) {
+    return false;
+  }
+  Delta delta = std::move(redo_.back());
+  redo_.pop_back();
+  if (!Apply(root, delta, true)) {
+    PBE_LOG_WARNING("can't redo, dropping history\n");
+    memory_used_ -= Cost(delta);
+    Clear();
+    return false;
+  }
+  if (nullptr != path) {
+    *path = delta.path;
+  }
+  if (nullptr != field_number) {
+    *field_number = delta.field_number;
+  }
+  delta.time = std::chrono::steady_clock::time_point();  // never merge into a redone edit
+  undo_.push_back(std::move(delta));
+  return true;
+}
+
+void UndoStack::Clear() {
+  undo_.clear();
+  redo_.clear();
+  memory_used_ = 0;
+}
+
+void UndoStack::set_memory_cap(size_t memory_cap) {
+  memory_cap_ = memory_cap;
+  Trim();
+}
+
+size_t UndoStack::Cost(const Delta& delta) {
+  return sizeof(Delta) + delta.path.size() * sizeof(PathStep) + delta.before.size() + delta.after.size();
+}
+
+bool UndoStack::Apply(::google::protobuf::Message* root, const Delta& delta, bool forward) const {
+  auto* msg = resolver_(root, delta.path);
+  if (nullptr == msg) {
+    return false;
+  }
+  auto* field_desc = msg->GetDescriptor()->FindFieldByNumber(delta.field_number);
+  if (nullptr == field_desc) {
+    return false;
+  }
+  switch (delta.kind) {
+    case Kind::kSet:
+      return restore_field(msg, field_desc, delta.index, forward ? delta.after : delta.before);
+    case Kind::kInsert:
+      if (forward) {
+        return insert_repeated_element(msg, field_desc, delta.index, delta.after);
+      }
+      remove_repeated_element(msg, field_desc, delta.index);
+      return true;
+    case Kind::kRemove:
+      if (!forward) {
+        return insert_repeated_element(msg, field_desc, delta.index, delta.before);
+      }
+      remove_repeated_element(msg, field_desc, delta.index);
+      return true;
+  }
+  return false;
+}
+
+void UndoStack::Push(Delta delta) {
+  for (const auto& old : redo_) {
+    memory_used_ -= Cost(old);
+  }
+  redo_.clear();
+
+  size_t cost = Cost(delta);
+  if (cost > memory_cap_) {
+    // older deltas can't be replayed without this one
+    PBE_LOG_WARNING("edit is larger than the undo memory cap, dropping history\n");
+    Clear();
+    return;
+  }
+  undo_.push_back(std::move(delta));
+  memory_used_ += cost;
+  Trim();
+}
+
+void UndoStack::Trim() {
+  while (memory_used_ > memory_cap_ && !redo_.empty()) {
+    memory_used_ -= Cost(redo_.front());
+    redo_.pop_front();
+  }
+  while (memory_used_ > memory_cap_ && !undo_.empty()) {
+    memory_used_ -= Cost(undo_.front());
+    undo_.pop_front();
+  }
+}
@@ -0,0 +1,116 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef UNDO_H_
+#define UNDO_H_
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <string>
+#include <utility>
+
+#include "field_path.h"
+#include "protobuf_include.h"
+
+// Encodes |field_desc| of |msg| as a message holding only that field. |index| selects a single
+// element of a repeated field, -1 takes the whole field. An unset singular field encodes as "".
+std::string encode_field(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                         int index);
+
+// Replaces the field (or element |index|) with a value produced by encode_field().
+bool restore_field(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc, int index,
+                   const std::string& encoded);
+
+// Inserts the single element encoded in |encoded| at |index|, shifting later elements up.
+bool insert_repeated_element(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                             int index, const std::string& encoded);
+
+// Removes element |index|, shifting later elements down.
+void remove_repeated_element(::google::protobuf::Message* msg, const ::google::protobuf::FieldDescriptor* field_desc,
+                             int index);
+
+// Undo/redo history made of small reversible deltas. Each delta names the edited field by its path
+// from the root and keeps only the encoded bytes of that field (or repeated element), never a copy of
+// the document. Oldest deltas are dropped once the history grows beyond the memory cap.
+class UndoStack {
+ public:
+  static constexpr size_t kDefaultMemoryCap = 64 << 20;
+
+  // finds the message at a path from the root, or nullptr
+  typedef std::function<::google::protobuf::Message*(::google::protobuf::Message* root, const FieldPath& path)>
+      Resolver;
+
+  explicit UndoStack(size_t memory_cap = kDefaultMemoryCap) : memory_cap_(memory_cap) {}
+
+  // |before| / |after| are encode_field() results. Consecutive edits of the same field are merged.
+  void RecordSet(const FieldPath& path, const ::google::protobuf::FieldDescriptor* field_desc, int index,
+                 std::string before, std::string after);
+  void RecordInsert(const FieldPath& path, const ::google::protobuf::FieldDescriptor* field_desc, int index,
+                    std::string element);
+  void RecordRemove(const FieldPath& path, const ::google::protobuf::FieldDescriptor* field_desc, int index,
+                    std::string element);
+  // For an edit too large to record. The redo history is dropped as by any edit, and the undo history kept,
+  // but not merged into.
+  void RecordUntracked();
+
+  // On success |path| and |field_number| (if given) tell which field was touched.
+  bool Undo(::google::protobuf::Message* root, FieldPath* path = nullptr, int* field_number = nullptr);
+  bool Redo(::google::protobuf::Message* root, FieldPath* path = nullptr, int* field_number = nullptr);
+
+  bool CanUndo() const { return !undo_.empty(); }
+  bool CanRedo() const { return !redo_.empty(); }
+  void Clear();
+
+  // for documents with messages resolve_path() can't reach, which is what is used otherwise
+  void set_resolver(Resolver resolver) { resolver_ = std::move(resolver); }
+
+  void set_memory_cap(size_t memory_cap);
+  size_t memory_cap() const { return memory_cap_; }
+  size_t memory_used() const { return memory_used_; }
+
+ private:
+  enum class Kind { kSet, kInsert, kRemove };
+
+  struct Delta {
+    Kind kind;
+    FieldPath path;
+    int field_number;
+    int index;
+    std::string before;
+    std::string after;
+    std::chrono::steady_clock::time_point time;
+  };
+
+  static size_t Cost(const Delta& delta);
+  bool Apply(::google::protobuf::Message* root, const Delta& delta, bool forward) const;
+
+  void Push(Delta delta);
+  void Trim();
+
+  std::deque<Delta> undo_;
+  std::deque<Delta> redo_;
+  size_t memory_cap_;
+  size_t memory_used_ = 0;
+  Resolver resolver_ = resolve_path;
+};
+
+#endif  // UNDO_H_
@@ -0,0 +1,184 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "validate.h"
+
+#include <utility>
+
+#include "parallel.h"
+
+// fewest elements of a repeated message field a worker thread is given to check
+static const size_t kMinCheckChunk = 1024;
+
+void RequiredCheck::CheckUnset(const ::google::protobuf::Message& msg, Node* node) {
+  const auto* desc = msg.GetDescriptor();
+  const auto* reflection = msg.GetReflection();
+  node->unset.clear();
+  for (int i = 0; i < desc->field_count(); ++i) {
+    const auto* field_desc = desc->field(i);
+    if (field_desc->is_required() && !reflection->HasField(msg, field_desc)) {
+      node->unset.push_back(field_desc);
+    }
+  }
+}
+
+void RequiredCheck::CheckMessage(const ::google::protobuf::Message& msg, Node* node) {
+  CheckUnset(msg, node);
+  node->children.clear();
+  const auto* desc = msg.GetDescriptor();
+  for (int i = 0; i < desc->field_count(); ++i) {
+    CheckField(msg, desc->field(i), node);
+  }
+  Sum(node);
+}
+
+void RequiredCheck::CheckField(const ::google::protobuf::Message& msg,
+                               const ::google::protobuf::FieldDescriptor* field_desc, Node* node) {
+  node->children.erase(field_desc->number());
+  if (field_desc->cpp_type() != ::google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+    return;
+  }
+  const auto* reflection = msg.GetReflection();
+  // IsInitialized() finds the valid subtrees without allocating, only the others are walked into nodes
+  auto check = [](const ::google::protobuf::Message& element) -> std::unique_ptr<Node> {
+    if (element.IsInitialized()) {
+      return nullptr;
+    }
+    std::unique_ptr<Node> child(new Node());
+    CheckMessage(element, child.get());
+    return child;
+  };
+
+  std::map<int, std::unique_ptr<Node>> children;
+  if (!field_desc->is_repeated()) {
+    if (reflection->HasField(msg, field_desc)) {
+      auto child = check(reflection->GetMessage(msg, field_desc));
+      if (nullptr != child) {
+        children[-1] = std::move(child);
+      }
+    }
+  } else {
+    size_t size = static_cast<size_t>(reflection->FieldSize(msg, field_desc));
+    std::vector<std::vector<std::pair<int, std::unique_ptr<Node>>>> chunks(worker_count());
+    parallel_for(
+        size,
+        [&](size_t chunk, size_t begin, size_t end) {
+          for (size_t i = begin; i < end; ++i) {
+            auto child = check(reflection->GetRepeatedMessage(msg, field_desc, static_cast<int>(i)));
+            if (nullptr != child) {
+              chunks[chunk].emplace_back(static_cast<int>(i), std::move(child));
+            }
+          }
+        },
+        kMinCheckChunk);
+    for (auto& chunk : chunks) {
+      for (auto& child : chunk) {
+        children.emplace_hint(children.end(), child.first, std::move(child.second));
+      }
+    }
+  }
+  if (!children.empty()) {
+    node->children[field_desc->number()] = std::move(children);
+  }
+}
+
+void RequiredCheck::Sum(Node* node) {
+  node->missing = node->unset.size();
+  for (const auto& field : node->children) {
+    for (const auto& child : field.second) {
+      node->missing += child.second->missing;
+    }
+  }
+}
+
+void RequiredCheck::Build(const ::google::protobuf::Message& root) {
+  root_ = Node();
+  CheckMessage(root, &root_);
+}
+
+void RequiredCheck::Update(::google::protobuf::Message* root, const FieldPath& path, int field_number) {
+  auto* msg = resolver_(root, path);
+  if (nullptr == msg) {
+    // gone with an edit above it, which is checked on its own
+    return;
+  }
+  std::vector<Node*> above;
+  Node* node = &root_;
+  for (const auto& step : path) {
+    above.push_back(node);
+    auto& child = node->children[step.field_number][step.index];
+    if (nullptr == child) {
+      child.reset(new Node());
+    }
+    node = child.get();
+  }
+
+  uint64_t before = node->missing;
+  const auto* field_desc =
+      field_number == kWholeMessage ? nullptr : msg->GetDescriptor()->FindFieldByNumber(field_number);
+  if (nullptr == field_desc) {
+    CheckMessage(*msg, node);
+  } else {
+    CheckUnset(*msg, node);
+    CheckField(*msg, field_desc, node);
+    Sum(node);
+  }
+  uint64_t after = node->missing;
+
+  // the messages above change by as much, and those left without missing fields are dropped
+  for (size_t i = above.size(); i-- > 0;) {
+    above[i]->missing = above[i]->missing - before + after;
+    if (node->missing == 0) {
+      auto field = above[i]->children.find(path[i].field_number);
+      field->second.erase(path[i].index);
+      if (field->second.empty()) {
+        above[i]->children.erase(field);
+      }
+    }
+    node = above[i];
+  }
+}
+
+void RequiredCheck::Clear() { root_ = Node(); }
+
+void RequiredCheck::ListNode(const Node& node, FieldPath* path, size_t max, std::vector<Problem>* out) {
+  for (const auto* field_desc : node.unset) {
+    if (out->size() >= max) {
+      return;
+    }
+    out->push_back({*path, field_desc});
+  }
+  for (const auto& field : node.children) {
+    for (const auto& child : field.second) {
+      if (out->size() >= max) {
+        return;
+      }
+      path->push_back({field.first, child.first});
+      ListNode(*child.second, path, max, out);
+      path->pop_back();
+    }
+  }
+}
+
+void RequiredCheck::List(size_t max, std::vector<Problem>* out) const {
+  out->clear();
+  FieldPath path;
+  ListNode(root_, &path, max, out);
+}
@@ -0,0 +1,86 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef VALIDATE_H_
+#define VALIDATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "field_path.h"
+#include "protobuf_include.h"
+
+// Unset required fields of a document, counted per subtree so that an edit only checks again the field it
+// touched, and the subtrees above it are updated by the difference. Subtrees without any are not kept, so a
+// valid document costs no more than its root.
+class RequiredCheck {
+ public:
+  static const int kWholeMessage = 0;
+
+  typedef std::function<::google::protobuf::Message*(::google::protobuf::Message* root, const FieldPath& path)>
+      Resolver;
+
+  // one unset required field |field_desc| of the message at |path|
+  struct Problem {
+    FieldPath path;
+    const ::google::protobuf::FieldDescriptor* field_desc;
+  };
+
+  // How Update() finds the message at a path, resolve_path() by default.
+  void set_resolver(Resolver resolver) { resolver_ = std::move(resolver); }
+
+  // Checks all of |root|, the elements of large repeated message fields on the worker threads.
+  void Build(const ::google::protobuf::Message& root);
+  // Checks |field_number| of the message at |path| again after it was edited, or all of that message with
+  // kWholeMessage.
+  void Update(::google::protobuf::Message* root, const FieldPath& path, int field_number);
+  void Clear();
+
+  // in the whole document
+  uint64_t missing() const { return root_.missing; }
+  // The first |max| of them, in the order of the fields in the document.
+  void List(size_t max, std::vector<Problem>* out) const;
+
+ private:
+  struct Node {
+    uint64_t missing = 0;  // in this message and below
+    std::vector<const ::google::protobuf::FieldDescriptor*> unset;
+    // by field number and element index, -1 for singular fields, only those with missing fields
+    std::map<int, std::map<int, std::unique_ptr<Node>>> children;
+  };
+
+  static void CheckMessage(const ::google::protobuf::Message& msg, Node* node);
+  static void CheckUnset(const ::google::protobuf::Message& msg, Node* node);
+  static void CheckField(const ::google::protobuf::Message& msg,
+                         const ::google::protobuf::FieldDescriptor* field_desc, Node* node);
+  static void Sum(Node* node);
+  static void ListNode(const Node& node, FieldPath* path, size_t max, std::vector<Problem>* out);
+
+  Node root_;
+  Resolver resolver_ = resolve_path;
+};
+
+#endif  // VALIDATE_H_
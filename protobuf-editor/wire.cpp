@@ -0,0 +1,323 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "wire.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "number.h"
+#include "protobuf_include.h"
+
+typedef ::google::protobuf::internal::WireFormatLite WireFormatLite;
+
+// nesting of groups decode_field() follows before giving up
+static const int kMaxGroupDepth = 64;
+
+static bool read_varint(const uint8_t* data, uint64_t* offset, uint64_t end, uint64_t* out) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64 && *offset < end; shift += 7) {
+    uint8_t byte = data[(*offset)++];
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *out = value;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool read_tag(const uint8_t* data, uint64_t* offset, uint64_t end, uint32_t* field_number, int* wire_type) {
+  uint64_t tag;
+  if (!read_varint(data, offset, end, &tag) || tag > UINT32_MAX) {
+    return false;
+  }
+  *field_number = static_cast<uint32_t>(tag >> 3);
+  *wire_type = static_cast<int>(tag & 7);
+  return *field_number != 0;
+}
+
+static bool decode(const uint8_t* data, uint64_t offset, uint64_t end, WireField* out, int depth) {
+  out->offset = offset;
+  if (!read_tag(data, &offset, end, &out->field_number, &out->wire_type)) {
+    return false;
+  }
+  switch (out->wire_type) {
+    case WireFormatLite::WIRETYPE_VARINT:
+      if (!read_varint(data, &offset, end, &out->value)) {
+        return false;
+      }
+      break;
+    case WireFormatLite::WIRETYPE_FIXED64:
+      if (end - offset < 8) {
+        return false;
+      }
+      memcpy(&out->value, data + offset, 8);
+      offset += 8;
+      break;
+    case WireFormatLite::WIRETYPE_FIXED32: {
+      if (end - offset < 4) {
+        return false;
+      }
+      uint32_t value;
+      memcpy(&value, data + offset, 4);
+      out->value = value;
+      offset += 4;
+      break;
+    }
+    case WireFormatLite::WIRETYPE_LENGTH_DELIMITED: {
+      uint64_t length;
+      if (!read_varint(data, &offset, end, &length) || length > end - offset) {
+        return false;
+      }
+      out->payload_begin = offset;
+      out->payload_end = offset + length;
+      offset += length;
+      break;
+    }
+    case WireFormatLite::WIRETYPE_START_GROUP: {
+      if (depth >= kMaxGroupDepth) {
+        return false;
+      }
+      out->payload_begin = offset;
+      while (true) {
+        uint64_t tag_offset = offset;
+        uint32_t field_number;
+        int wire_type;
+        if (!read_tag(data, &offset, end, &field_number, &wire_type)) {
+          return false;
+        }
+        if (wire_type == WireFormatLite::WIRETYPE_END_GROUP) {
+          if (field_number != out->field_number) {
+            return false;
+          }
+          out->payload_end = tag_offset;
+          break;
+        }
+        WireField inner;
+        if (!decode(data, tag_offset, end, &inner, depth + 1)) {
+          return false;
+        }
+        offset = inner.end;
+      }
+      break;
+    }
+    default:
+      // a stray end-group tag, or wire types 6 and 7 which don't exist
+      return false;
+  }
+  out->end = offset;
+  return true;
+}
+
+bool decode_field(const uint8_t* data, uint64_t offset, uint64_t end, WireField* out) {
+  return offset < end && decode(data, offset, end, out, 0);
+}
+
+bool decode_header(const uint8_t* data, uint64_t offset, uint64_t end, WireField* out) {
+  out->offset = offset;
+  if (!read_tag(data, &offset, end, &out->field_number, &out->wire_type)) {
+    return false;
+  }
+  if (out->wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+    uint64_t length;
+    if (!read_varint(data, &offset, end, &length) || length > UINT64_MAX - offset) {
+      return false;
+    }
+    out->payload_begin = offset;
+    out->payload_end = offset + length;
+  }
+  return true;
+}
+
+bool looks_like_message(const uint8_t* data, uint64_t begin, uint64_t end, size_t max_fields) {
+  if (begin == end) {
+    return false;
+  }
+  WireField field;
+  for (size_t i = 0; i < max_fields && begin < end; ++i) {
+    if (!decode_field(data, begin, end, &field)) {
+      return false;
+    }
+    begin = field.end;
+  }
+  return true;
+}
+
+bool next_delimited(const uint8_t* data, uint64_t size, uint64_t* offset, uint64_t* begin, uint64_t* end) {
+  uint64_t length;
+  if (!read_varint(data, offset, size, &length) || length > size - *offset) {
+    return false;
+  }
+  *begin = *offset;
+  *end = *offset + length;
+  *offset = *end;
+  return true;
+}
+
+const char* wire_type_name(int wire_type) {
+  switch (wire_type) {
+    case WireFormatLite::WIRETYPE_VARINT:
+      return "varint";
+    case WireFormatLite::WIRETYPE_FIXED64:
+      return "fixed64";
+    case WireFormatLite::WIRETYPE_LENGTH_DELIMITED:
+      return "bytes";
+    case WireFormatLite::WIRETYPE_START_GROUP:
+      return "group";
+    case WireFormatLite::WIRETYPE_END_GROUP:
+      return "end group";
+    case WireFormatLite::WIRETYPE_FIXED32:
+      return "fixed32";
+    default:
+      return "invalid";
+  }
+}
+
+std::string wire_value_string(const uint8_t* data, const WireField& field) {
+  // longest payload prefix shown
+  static const uint64_t kPreview = 48;
+
+  char buf[128];
+  switch (field.wire_type) {
+    case WireFormatLite::WIRETYPE_VARINT:
+      snprintf(buf, sizeof(buf), "%llu (zigzag %lld)", static_cast<unsigned long long>(field.value),
+               static_cast<long long>(WireFormatLite::ZigZagDecode64(field.value)));
+      return buf;
+    case WireFormatLite::WIRETYPE_FIXED64: {
+      double as_double;
+      memcpy(&as_double, &field.value, sizeof(as_double));
+      snprintf(buf, sizeof(buf), "0x%016llx (", static_cast<unsigned long long>(field.value));
+      return buf + format_number(as_double) + ")";
+    }
+    case WireFormatLite::WIRETYPE_FIXED32: {
+      uint32_t bits = static_cast<uint32_t>(field.value);
+      float as_float;
+      memcpy(&as_float, &bits, sizeof(as_float));
+      snprintf(buf, sizeof(buf), "0x%08x (", bits);
+      return buf + format_number(as_float) + ")";
+    }
+    case WireFormatLite::WIRETYPE_LENGTH_DELIMITED:
+    case WireFormatLite::WIRETYPE_START_GROUP:
+      break;
+    default:
+      return "";
+  }
+
+  uint64_t length = field.payload_end - field.payload_begin;
+  snprintf(buf, sizeof(buf), "%llu bytes", static_cast<unsigned long long>(length));
+  std::string str = buf;
+  if (field.wire_type == WireFormatLite::WIRETYPE_START_GROUP || length == 0) {
+    return str;
+  }
+  uint64_t shown = length < kPreview ? length : kPreview;
+  const uint8_t* payload = data + field.payload_begin;
+  bool printable = true;
+  for (uint64_t i = 0; i < shown && printable; ++i) {
+    printable = (payload[i] >= 0x20 && payload[i] < 0x7f) || payload[i] == '\n' || payload[i] == '\t';
+  }
+  str += printable ? " \"" : " ";
+  for (uint64_t i = 0; i < shown; ++i) {
+    if (printable) {
+      str += payload[i] == '\n' ? ' ' : static_cast<char>(payload[i]);
+    } else {
+      snprintf(buf, sizeof(buf), "%02x ", payload[i]);
+      str += buf;
+    }
+  }
+  if (printable) {
+    str += "\"";
+  }
+  if (shown < length) {
+    str += "...";
+  }
+  return str;
+}
+
+size_t RawNode::Index(size_t max_fields) {
+  size_t count = 0;
+  WireField field;
+  while (count < max_fields && !indexed()) {
+    if (!decode_field(data_, next_, end_, &field)) {
+      has_error_ = true;
+      break;
+    }
+    offsets_.push_back(next_);
+    next_ = field.end;
+    ++count;
+  }
+  for (auto& index_child : children_) {
+    if (count >= max_fields) {
+      break;
+    }
+    count += index_child.second->Index(max_fields - count);
+  }
+  return count;
+}
+
+RawNode* RawNode::Child(size_t i) const {
+  auto it = children_.find(i);
+  return it == children_.end() ? nullptr : it->second.get();
+}
+
+RawNode* RawNode::Expand(size_t i) {
+  WireField field;
+  if (i >= offsets_.size() || !Field(i, &field) || field.payload_begin == field.payload_end) {
+    return nullptr;
+  }
+  auto& child = children_[i];
+  if (!child) {
+    child.reset(new RawNode(data_, field.payload_begin, field.payload_end));
+  }
+  return child.get();
+}
+
+void RawNode::Collapse(size_t i) { children_.erase(i); }
+
+size_t RawNode::RowCount() const {
+  size_t rows = offsets_.size() + (has_error_ ? 1 : 0);
+  for (const auto& index_child : children_) {
+    rows += index_child.second->RowCount();
+  }
+  return rows;
+}
+
+void RawNode::Locate(size_t row, RawNode** node, size_t* field_index, int* depth) {
+  // fields [first, i] come before the rows of the child of field i
+  size_t first = 0;
+  for (auto& index_child : children_) {
+    size_t fields = index_child.first - first + 1;
+    if (row < fields) {
+      break;
+    }
+    row -= fields;
+    size_t child_rows = index_child.second->RowCount();
+    if (row < child_rows) {
+      index_child.second->Locate(row, node, field_index, depth);
+      ++*depth;
+      return;
+    }
+    row -= child_rows;
+    first = index_child.first + 1;
+  }
+  *node = this;
+  *field_index = first + row;
+  *depth = 0;
+}
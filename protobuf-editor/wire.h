@@ -0,0 +1,105 @@
+/************************************************************************
+ * Copyright (c) 2023 Ophir Carmi
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WIRE_H_
+#define WIRE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One field of the protobuf wire format, decoded without a schema. Offsets are into the buffer given to
+// decode_field().
+struct WireField {
+  uint64_t offset = 0;  // of the tag
+  uint64_t end = 0;     // one past the field
+  uint32_t field_number = 0;
+  int wire_type = 0;           // a WireFormatLite::WireType
+  uint64_t value = 0;          // varint, fixed32 and fixed64 fields
+  uint64_t payload_begin = 0;  // length-delimited fields and groups (without the end-group tag)
+  uint64_t payload_end = 0;
+};
+
+// Decodes the field whose tag starts at |offset|. Returns false if it is malformed or runs past |end|.
+bool decode_field(const uint8_t* data, uint64_t offset, uint64_t end, WireField* out);
+
+// Reads only the tag at |offset|, and the length of a length-delimited field, so payload_end may lie past
+// |end| for a truncated field. |out->end| is not set.
+bool decode_header(const uint8_t* data, uint64_t offset, uint64_t end, WireField* out);
+
+// Whether [begin, end) starts with a sequence of well-formed fields, checking at most |max_fields| of them.
+// Used to guess which length-delimited fields are submessages.
+bool looks_like_message(const uint8_t* data, uint64_t begin, uint64_t end, size_t max_fields = 64);
+
+// Steps over one record of a log of length-prefixed records: reads the varint length at |*offset| and sets
+// [*begin, *end) to the record after it. Returns false at the end of the log or if the record is cut off.
+bool next_delimited(const uint8_t* data, uint64_t size, uint64_t* offset, uint64_t* begin, uint64_t* end);
+
+const char* wire_type_name(int wire_type);
+
+// "150 (zigzag 75)", "0x3f800000 (1)", "12 bytes \"hello world!\"" ...
+std::string wire_value_string(const uint8_t* data, const WireField& field);
+
+// The fields of one message in a buffer, indexed by offset a bounded number at a time so that a multi-GB
+// buffer never blocks a frame. Fields with a length-delimited or group payload can be expanded into child
+// nodes, which are indexed the same way. Rows are the fields of a node, each followed by the rows of its
+// expanded child, plus one row for the malformed tail if there is one.
+class RawNode {
+ public:
+  RawNode(const uint8_t* data, uint64_t begin, uint64_t end) : data_(data), begin_(begin), end_(end), next_(begin) {}
+
+  // Indexes at most |max_fields| more fields here and in the expanded children. Returns the number indexed.
+  size_t Index(size_t max_fields);
+  bool indexed() const { return next_ == end_ || has_error_; }
+  uint64_t indexed_to() const { return next_; }
+
+  uint64_t begin() const { return begin_; }
+  uint64_t end() const { return end_; }
+  size_t field_count() const { return offsets_.size(); }
+  bool Field(size_t i, WireField* out) const { return decode_field(data_, offsets_[i], end_, out); }
+  bool has_error() const { return has_error_; }
+  // first byte that doesn't parse as a field
+  uint64_t error_offset() const { return next_; }
+
+  RawNode* Child(size_t i) const;
+  RawNode* Expand(size_t i);
+  void Collapse(size_t i);
+
+  size_t RowCount() const;
+  // Finds what |row| shows: field |*field_index| of |*node|, |*depth| levels below this node. A field index
+  // equal to field_count() is the malformed tail.
+  void Locate(size_t row, RawNode** node, size_t* field_index, int* depth);
+
+ private:
+  const uint8_t* data_;
+  uint64_t begin_;
+  uint64_t end_;
+  uint64_t next_;  // where indexing continues
+  bool has_error_ = false;
+  std::vector<uint64_t> offsets_;
+  std::map<size_t, std::unique_ptr<RawNode>> children_;
+};
+
+#endif  // WIRE_H_